@@ -0,0 +1,340 @@
+#pragma once
+
+// Асинхронный ввод: много интерактивных сессий на нескольких потоках.
+//
+// Поток, который блокируется в read() на вводе одной программы, простаивает
+// вместе со всеми ее соседями по очереди. Здесь машина не ждет: CowVM::run с
+// suspend_on_input останавливается перед инструкцией, которой не хватает
+// ввода, и возвращает RUN_WAITING_INPUT. Продолжить можно с того же места,
+// так что сама CowVM и есть сопрограмма - отдельный стек ей не нужен.
+//
+// SessionPool держит сессии (CowVM + AsyncIO + дескриптор ввода) и два вида
+// потоков: рабочие исполняют готовые сессии кусками по SESSION_SLICE
+// инструкций, а поток опроса ждет ввода в epoll. Сессия в каждый момент
+// принадлежит ровно одному из них: очереди готовых, рабочему потоку или epoll
+// (EPOLLONESHOT), поэтому ее CowVM и AsyncIO не нуждаются в блокировках.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "cow_lib.hpp"
+
+// Ввод, который подвозит цикл событий: feed() добавляет пришедшие байты,
+// close_input() - конец ввода. Вывод пишется в out_fd как у FdIO; out_fd < 0 -
+// вывод отбрасывается.
+class AsyncIO : public FdIO {
+public:
+    explicit AsyncIO(int out_fd = STDOUT_FILENO) : FdIO(-1, out_fd) {}
+
+    void feed(std::string_view data) {
+        if (pending_pos_ == pending_.size()) {
+            pending_.clear();
+            pending_pos_ = 0;
+        }
+        pending_.append(data);
+    }
+    void close_input() { closed_ = true; }
+    bool input_closed() const { return closed_; }
+
+    bool can_read_char() override {
+        return closed_ || !buffered_input().empty() || pending_pos_ < pending_.size();
+    }
+
+    // read_int дочитывает строку до '\n', поэтому число готово, когда после
+    // его первого непробельного символа уже пришел перевод строки
+    bool can_read_int() override {
+        if (closed_) return true;
+        bool started = false;
+        for (std::string_view part : {buffered_input(), std::string_view(pending_).substr(pending_pos_)}) {
+            for (char c : part) {
+                if (started && c == '\n') return true;
+                if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '\v' && c != '\f') started = true;
+            }
+        }
+        return false;
+    }
+
+protected:
+    // Вызывается только когда буфер пуст; без InputGate 0 здесь - конец ввода
+    std::size_t read_some(char* data, std::size_t n) override {
+        std::size_t count = std::min(n, pending_.size() - pending_pos_);
+        pending_.copy(data, count, pending_pos_);
+        pending_pos_ += count;
+        return count;
+    }
+
+private:
+    std::string pending_;
+    std::size_t pending_pos_ = 0;
+    bool closed_ = false;
+};
+
+struct SessionResult {
+    // RUN_FINISHED или RUN_OUT_OF_TIME; RUN_WAITING_INPUT - опрос ввода сломался,
+    // и сессия его так и не дождалась (причина в error)
+    RunStatus status = RUN_FINISHED;
+    std::uint64_t instructions = 0;
+    std::string error;
+};
+
+class SessionPool {
+public:
+    // Инструкций за один заход рабочего потока: чем меньше, тем справедливее
+    // делится процессор между сессиями, чем больше - тем меньше переключений
+    static constexpr std::uint64_t SESSION_SLICE = 1 << 20;
+    // Сколько байт ввода читать за одно пробуждение
+    static constexpr std::size_t READ_CHUNK = 1 << 16;
+
+    // time_limit ограничивает время исполнения каждой сессии (ожидание ввода
+    // не считается); 0 - без ограничения
+    explicit SessionPool(std::size_t workers, std::chrono::nanoseconds time_limit = {},
+                         const RunOptions& options = {})
+        : workers_(std::max<std::size_t>(workers, 1)), time_limit_(time_limit), options_(options) {}
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    // in_fd < 0 - без ввода; in_fd переводится в неблокирующий режим. Пул
+    // не закрывает дескрипторы. Возвращает номер сессии для result()
+    std::size_t add(const CowProgram& program, int in_fd, int out_fd) {
+        auto session = std::make_unique<Session>(options_, out_fd);
+        session->in_fd = in_fd;
+        session->vm.set_io(&session->io);
+        session->vm.load(program);
+        if (in_fd < 0) {
+            session->io.close_input();
+        } else {
+            int flags = ::fcntl(in_fd, F_GETFL);
+            if (flags >= 0) ::fcntl(in_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        sessions_.push_back(std::move(session));
+        return sessions_.size() - 1;
+    }
+
+    // Исполняет все сессии и возвращается, когда закончилась последняя.
+    // false - не удалось создать epoll или сломался опрос ввода; причина в
+    // error() и в error у результатов сессий, которые из-за этого не доработали
+    bool run() {
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = ::eventfd(0, EFD_CLOEXEC);
+        epoll_event wake{};
+        wake.events = EPOLLIN;
+        wake.data.ptr = nullptr;
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &wake) != 0) {
+            error_ = std::string("epoll: ") + std::strerror(errno);
+            close_fds();
+            for (auto& session : sessions_) session->result.error = error_;
+            return false;
+        }
+
+        active_ = sessions_.size();
+        for (auto& session : sessions_) ready_.push_back(session.get());
+
+        std::thread poller([this] { poll_loop(); });
+        std::vector<std::thread> threads;
+        for (std::size_t w = 0; w < workers_; ++w) threads.emplace_back([this] { work_loop(); });
+        for (std::thread& t : threads) t.join();
+
+        std::uint64_t one = 1;
+        [[maybe_unused]] ssize_t put = ::write(wake_fd_, &one, sizeof(one));
+        poller.join();
+        close_fds();
+        return !poll_failed_;
+    }
+
+    const SessionResult& result(std::size_t session) const { return sessions_[session]->result; }
+    const std::string& error() const { return error_; }
+
+private:
+    struct Session {
+        CowVM vm;
+        AsyncIO io;
+        int in_fd = -1;
+        bool polled = false;   // in_fd уже добавлен в epoll
+        bool pollable = true;  // false - обычный файл: epoll его не принимает, читаем сразу
+        std::chrono::nanoseconds used{0};
+        SessionResult result;
+
+        Session(const RunOptions& options, int out_fd) : vm(options), io(out_fd) {}
+    };
+
+    std::size_t workers_;
+    std::chrono::nanoseconds time_limit_;
+    RunOptions options_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    std::string error_;
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::deque<Session*> ready_;
+    std::unordered_set<Session*> parked_; // сессии, отданные epoll
+    std::size_t active_ = 0; // сессий, которые еще не закончились
+    bool poll_failed_ = false;
+
+    void close_fds() {
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+        if (wake_fd_ >= 0) ::close(wake_fd_);
+        epoll_fd_ = wake_fd_ = -1;
+    }
+
+    void make_ready(Session* session) {
+        std::lock_guard lock(mutex_);
+        ready_.push_back(session);
+        ready_cv_.notify_one();
+    }
+
+    void work_loop() {
+        for (;;) {
+            Session* session;
+            {
+                std::unique_lock lock(mutex_);
+                ready_cv_.wait(lock, [this] { return !ready_.empty() || active_ == 0; });
+                if (ready_.empty()) return;
+                session = ready_.front();
+                ready_.pop_front();
+            }
+
+            RunStatus status = run_session(*session);
+            if (status == RUN_FINISHED || status == RUN_OUT_OF_TIME) {
+                finish(*session, status);
+                continue;
+            }
+            // Исчерпавшая квант сессия встает в конец очереди за остальными
+            if (status == RUN_WAITING_INPUT && wait_for_input(*session)) continue;
+            make_ready(session);
+        }
+    }
+
+    void finish(Session& session, RunStatus status) {
+        session.io.flush();
+        session.result.status = status;
+        session.result.instructions = session.vm.instructions_executed();
+        std::lock_guard lock(mutex_);
+        if (--active_ == 0) ready_cv_.notify_all();
+    }
+
+    RunStatus run_session(Session& session) {
+        RunBudget budget;
+        budget.max_instructions = SESSION_SLICE;
+        budget.suspend_on_input = true;
+        if (time_limit_.count() == 0) return session.vm.run(budget);
+
+        budget.time_limit = time_limit_ - session.used;
+        auto start = std::chrono::steady_clock::now();
+        RunStatus status = session.vm.run(budget);
+        session.used += std::chrono::steady_clock::now() - start;
+        if (status != RUN_FINISHED && session.used >= time_limit_) return RUN_OUT_OF_TIME;
+        return status;
+    }
+
+    // Отдает сессию epoll до прихода ввода. false - ввод прочитан сразу
+    // (обычный файл), и сессия по-прежнему у вызывающего. После успешного
+    // epoll_ctl сессия уже может исполняться другим потоком или даже
+    // закончиться, поэтому все поля меняются до него
+    bool wait_for_input(Session& session) {
+        if (session.pollable) {
+            {
+                std::lock_guard lock(mutex_);
+                if (poll_failed_) {
+                    session.result.error = error_;
+                } else {
+                    parked_.insert(&session);
+                }
+            }
+            if (!session.result.error.empty()) {
+                finish(session, RUN_WAITING_INPUT);
+                return true;
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.ptr = &session;
+            bool polled = session.polled;
+            session.polled = true;
+            if (::epoll_ctl(epoll_fd_, polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, session.in_fd, &event) == 0) {
+                return true;
+            }
+            // Если опрос успел сломаться, сессию уже завершил его поток
+            std::lock_guard lock(mutex_);
+            if (parked_.erase(&session) == 0) return true;
+            session.polled = polled;
+            session.pollable = false;
+        }
+        read_input(session);
+        return false;
+    }
+
+    // Дочитывает то, что уже есть в in_fd; 0 от read() - конец ввода
+    static void read_input(Session& session) {
+        char chunk[READ_CHUNK];
+        for (;;) {
+            ssize_t got = ::read(session.in_fd, chunk, sizeof(chunk));
+            if (got > 0) {
+                session.io.feed(std::string_view(chunk, static_cast<std::size_t>(got)));
+                return;
+            }
+            if (got < 0 && errno == EINTR) continue;
+            // Ложное пробуждение: сессия снова остановится и вернется в epoll
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            session.io.close_input();
+            return;
+        }
+    }
+
+    void poll_loop() {
+        epoll_event events[64];
+        for (;;) {
+            int n = ::epoll_wait(epoll_fd_, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                fail_parked(std::string("epoll_wait: ") + std::strerror(errno));
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.ptr == nullptr) return;
+                Session* session = static_cast<Session*>(events[i].data.ptr);
+                {
+                    std::lock_guard lock(mutex_);
+                    parked_.erase(session);
+                }
+                read_input(*session);
+                make_ready(session);
+            }
+        }
+    }
+
+    // Без потока опроса ввод ждущим сессиям больше не придет: они завершаются
+    // с ошибкой, а те, что остановятся на вводе позже, - в wait_for_input
+    void fail_parked(const std::string& reason) {
+        std::unordered_set<Session*> parked;
+        {
+            std::lock_guard lock(mutex_);
+            error_ = reason;
+            poll_failed_ = true;
+            parked.swap(parked_);
+        }
+        for (Session* session : parked) {
+            session->result.error = reason;
+            finish(*session, RUN_WAITING_INPUT);
+        }
+    }
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+// Пакетный режим: много независимых программ в одном процессе.
+//
+// Манифест - по заданию на строку: "<программа> <ввод> <вывод>", '-' вместо
+// ввода - пустой ввод, вместо вывода - вывод отбрасывается. Пустые строки и
+// строки с '#' в начале пропускаются, относительные пути считаются от каталога
+// манифеста. Задания исполняются пулом потоков с перехватом работы: у каждого
+// потока своя очередь и своя CowVM, опустевший поток забирает задания из
+// начала чужих очередей. Одинаковые программы компилируются один раз.
+//
+// С --async (run_async) ввод заданий может быть каналом или FIFO, который
+// наполняется по ходу работы: задания становятся сессиями SessionPool, и
+// программа, ждущая ввода, не занимает рабочий поток.
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "async_io.hpp"
+#include "cow_lib.hpp"
+#include "cow_source.hpp"
+
+struct BatchJob {
+    std::string program;
+    std::string input;  // пусто - без ввода
+    std::string output; // пусто - вывод отбрасывается
+};
+
+enum JobStatus {
+    JOB_OK,
+    JOB_TIMEOUT,
+    JOB_FAILED
+};
+
+struct JobResult {
+    JobStatus status = JOB_FAILED;
+    std::uint64_t instructions = 0;
+    std::string error;
+};
+
+struct BatchReport {
+    std::size_t ok = 0;
+    std::size_t timeouts = 0;
+    std::size_t failed = 0;
+    std::uint64_t instructions = 0; // только для заданий с таймаутом и --async (они идут через run_slice)
+    double seconds = 0;
+    std::vector<JobResult> results;
+};
+
+// Разбирает манифест; при ошибке возвращает false и номер строки в error
+inline bool parse_manifest(std::string_view text, const std::filesystem::path& base_dir,
+                           std::vector<BatchJob>& jobs, std::string& error) {
+    auto resolve = [&](const std::string& path) -> std::string {
+        if (path == "-") return "";
+        std::filesystem::path p(path);
+        return p.is_absolute() ? path : (base_dir / p).string();
+    };
+
+    std::size_t line_no = 0;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos) end = text.size();
+        std::string line(text.substr(pos, end - pos));
+        pos = end + 1;
+        ++line_no;
+
+        std::istringstream fields(line);
+        std::string program, input, output, extra;
+        if (!(fields >> program) || program[0] == '#') continue;
+        if (!(fields >> input >> output) || (fields >> extra)) {
+            error = "line " + std::to_string(line_no) + ": expected <program> <input> <output>";
+            return false;
+        }
+        jobs.push_back({resolve(program), resolve(input), resolve(output)});
+    }
+    return true;
+}
+
+// Пул с перехватом работы. Все задания известны заранее, поэтому поток
+// завершается, когда пусты и его очередь, и все чужие.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t workers) : queues_(std::max<std::size_t>(workers, 1)) {}
+
+    std::size_t workers() const { return queues_.size(); }
+
+    // task(worker, job) вызывается для каждого job из [0, count)
+    void run(std::size_t count, const std::function<void(std::size_t, std::size_t)>& task) {
+        // Раздаем задания подряд идущими блоками: соседние задания часто
+        // используют одну программу, и она остается в кэше потока
+        std::size_t n = queues_.size();
+        for (std::size_t w = 0; w < n; ++w) {
+            std::size_t begin = count * w / n;
+            std::size_t end = count * (w + 1) / n;
+            for (std::size_t job = begin; job < end; ++job) queues_[w].jobs.push_back(job);
+        }
+
+        std::vector<std::thread> threads;
+        for (std::size_t w = 0; w < n; ++w) {
+            threads.emplace_back([this, w, &task] {
+                std::size_t job;
+                while (pop(w, job) || steal(w, job)) task(w, job);
+            });
+        }
+        for (std::thread& t : threads) t.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> jobs;
+    };
+
+    std::vector<Queue> queues_;
+
+    bool pop(std::size_t worker, std::size_t& job) {
+        Queue& q = queues_[worker];
+        std::lock_guard lock(q.mutex);
+        if (q.jobs.empty()) return false;
+        job = q.jobs.back();
+        q.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t thief, std::size_t& job) {
+        for (std::size_t i = 1; i < queues_.size(); ++i) {
+            Queue& q = queues_[(thief + i) % queues_.size()];
+            std::lock_guard lock(q.mutex);
+            if (q.jobs.empty()) continue;
+            job = q.jobs.front();
+            q.jobs.pop_front();
+            return true;
+        }
+        return false;
+    }
+};
+
+class BatchRunner {
+public:
+    // timeout == 0 - без ограничения
+    BatchRunner(std::size_t workers, std::chrono::milliseconds timeout, const RunOptions& options = {})
+        : pool_(workers), timeout_(timeout), options_(options) {}
+
+    BatchReport run(const std::vector<BatchJob>& jobs) {
+        BatchReport report;
+        report.results.resize(jobs.size());
+
+        std::vector<CowVM> vms;
+        vms.reserve(pool_.workers());
+        for (std::size_t w = 0; w < pool_.workers(); ++w) vms.emplace_back(options_);
+
+        auto start = std::chrono::steady_clock::now();
+        pool_.run(jobs.size(), [&](std::size_t worker, std::size_t job) {
+            report.results[job] = run_job(vms[worker], jobs[job]);
+        });
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        summarize(report);
+        return report;
+    }
+
+    // Задания исполняются сессиями SessionPool: ввод читается по мере
+    // поступления, вывод пишется в файл сразу, а не по окончании задания
+    BatchReport run_async(const std::vector<BatchJob>& jobs) {
+        BatchReport report;
+        report.results.resize(jobs.size());
+        auto start = std::chrono::steady_clock::now();
+
+        SessionPool sessions(pool_.workers(), timeout_, options_);
+        std::vector<int> fds;
+        std::vector<std::pair<std::size_t, std::size_t>> started; // задание, сессия
+        for (std::size_t job = 0; job < jobs.size(); ++job) {
+            JobResult& result = report.results[job];
+            CowProgram program;
+            if (!load_program(jobs[job].program, program, result.error)) continue;
+
+            int in_fd = -1;
+            int out_fd = -1;
+            if (!jobs[job].input.empty()) {
+                in_fd = ::open(jobs[job].input.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+                if (in_fd < 0) {
+                    result.error = "could not open " + jobs[job].input;
+                    continue;
+                }
+                fds.push_back(in_fd);
+            }
+            if (!jobs[job].output.empty()) {
+                out_fd = ::open(jobs[job].output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (out_fd < 0) {
+                    result.error = "could not write " + jobs[job].output;
+                    continue;
+                }
+                fds.push_back(out_fd);
+            }
+            started.emplace_back(job, sessions.add(program, in_fd, out_fd));
+        }
+
+        sessions.run();
+        for (int fd : fds) ::close(fd);
+        for (const auto& [job, session] : started) {
+            JobResult& result = report.results[job];
+            if (!sessions.result(session).error.empty()) {
+                result.error = sessions.result(session).error;
+                continue;
+            }
+            result.instructions = sessions.result(session).instructions;
+            if (sessions.result(session).status == RUN_FINISHED) {
+                result.status = JOB_OK;
+            } else {
+                result.status = JOB_TIMEOUT;
+                result.error = "timed out";
+            }
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        summarize(report);
+        return report;
+    }
+
+private:
+    WorkStealingPool pool_;
+    std::chrono::milliseconds timeout_;
+    RunOptions options_;
+
+    std::mutex programs_mutex_;
+    std::map<std::string, CowProgram> programs_;
+
+    static void summarize(BatchReport& report) {
+        for (const JobResult& result : report.results) {
+            if (result.status == JOB_OK) ++report.ok;
+            else if (result.status == JOB_TIMEOUT) ++report.timeouts;
+            else ++report.failed;
+            report.instructions += result.instructions;
+        }
+    }
+
+    bool load_program(const std::string& path, CowProgram& program, std::string& error) {
+        {
+            std::lock_guard lock(programs_mutex_);
+            auto it = programs_.find(path);
+            if (it != programs_.end()) {
+                program = it->second;
+                return true;
+            }
+        }
+
+        MappedFile file(path.c_str());
+        if (!file.is_open()) {
+            error = "could not open " + path;
+            return false;
+        }
+        if (is_bytecode(file.view())) {
+            BytecodeView bytecode;
+            if (!bytecode.load(file.view())) {
+                error = path + ": " + bytecode.error();
+                return false;
+            }
+            program = CowProgram(bytecode);
+        } else {
+            program = CowProgram(file.view(), options_);
+        }
+
+        // Если программу параллельно скомпилировал другой поток, берем его копию
+        std::lock_guard lock(programs_mutex_);
+        program = programs_.emplace(path, program).first->second;
+        return true;
+    }
+
+    JobResult run_job(CowVM& vm, const BatchJob& job) {
+        JobResult result;
+        CowProgram program;
+        if (!load_program(job.program, program, result.error)) return result;
+
+        std::string input;
+        if (!job.input.empty()) {
+            MappedFile file(job.input.c_str());
+            if (!file.is_open()) {
+                result.error = "could not open " + job.input;
+                return result;
+            }
+            input.assign(file.view());
+        }
+
+        MemoryIO io(std::move(input));
+        vm.set_io(&io);
+        vm.load(program);
+
+        RunBudget budget;
+        budget.time_limit = timeout_;
+        RunStatus status = vm.run(budget);
+        result.instructions = vm.instructions_executed();
+        vm.set_io(nullptr);
+
+        if (status != RUN_FINISHED) {
+            result.status = JOB_TIMEOUT;
+            result.error = "timed out";
+            return result;
+        }
+
+        if (!job.output.empty()) {
+            std::ofstream out(job.output, std::ios::binary | std::ios::trunc);
+            out << io.output();
+            if (!out) {
+                result.error = "could not write " + job.output;
+                return result;
+            }
+        }
+        result.status = JOB_OK;
+        return result;
+    }
+};
+
+inline void print_batch_report(std::ostream& out, const BatchReport& report) {
+    std::size_t total = report.results.size();
+    out << "jobs: " << total << ", ok: " << report.ok << ", timeout: " << report.timeouts
+        << ", failed: " << report.failed << "\n";
+    out << "wall: " << report.seconds << " s";
+    if (report.seconds > 0) {
+        out << ", " << static_cast<double>(total) / report.seconds << " jobs/s";
+        if (report.instructions > 0) {
+            out << ", " << static_cast<double>(report.instructions) / report.seconds << " instr/s";
+        }
+    }
+    out << std::endl;
+}
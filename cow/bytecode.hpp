@@ -0,0 +1,190 @@
+#pragma once
+
+// Байткод: готовый к исполнению IR на диске.
+//
+//   BytecodeHeader              40 байт
+//   Instr[count]                12 байт на инструкцию (op, arg, arg2)
+//
+// Скобки уже связаны (link_loops): arg у MOO/moo - смещение до парной скобки.
+// Файл отображается через mmap, и движки читают инструкции прямо из него:
+// ни разбора исходника, ни поиска пар скобок со стеком.
+// Формат платформенный (порядок байт хоста) - это кэш, а не формат обмена.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#include <fstream>
+#include <filesystem>
+
+#include <unistd.h>
+
+#include "vm.hpp"
+
+constexpr char BYTECODE_MAGIC[8] = {'\x7F', 'C', 'O', 'W', 'B', 'C', '\r', '\n'};
+// 4: циклы переноса, заходящие левее входной ячейки, переписываются за OP_GUARD
+constexpr uint32_t BYTECODE_VERSION = 4;
+
+// Флаги, с которыми программа была скомпилирована
+enum BytecodeFlags : uint32_t {
+    BC_IDIOMS = 1u << 0
+};
+
+struct BytecodeHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t count;
+};
+
+static_assert(sizeof(BytecodeHeader) == 40, "BytecodeHeader layout is part of the file format");
+static_assert(sizeof(Instr) == 12, "Instr layout is part of the file format");
+
+// FNV-1a 64 - ключ кэша
+inline uint64_t hash_source(std::string_view source) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Хэш самого IR: снимки и трассы проверяют им, что относятся к той же программе
+inline uint64_t hash_program(std::span<const Instr> program) {
+    return hash_source(std::string_view(reinterpret_cast<const char*>(program.data()), program.size_bytes()));
+}
+
+inline uint32_t bytecode_flags(const RunOptions& options) {
+    return options.idioms ? static_cast<uint32_t>(BC_IDIOMS) : 0u;
+}
+
+inline bool is_bytecode(std::string_view data) {
+    return data.size() >= sizeof(BYTECODE_MAGIC) &&
+           std::memcmp(data.data(), BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0;
+}
+
+inline std::string serialize_bytecode(std::span<const Instr> instructions, std::string_view source, uint32_t flags) {
+    BytecodeHeader header{};
+    std::memcpy(header.magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC));
+    header.version = BYTECODE_VERSION;
+    header.flags = flags;
+    header.source_hash = hash_source(source);
+    header.source_size = source.size();
+    header.count = instructions.size();
+
+    std::string out;
+    out.reserve(sizeof(header) + instructions.size_bytes());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(instructions.data()), instructions.size_bytes());
+    return out;
+}
+
+// Пишет во временный файл и переименовывает, чтобы параллельные запуски
+// никогда не увидели недописанный байткод
+inline bool write_bytecode_file(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out.is_open()) return false;
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// Проверенный вид на байткод в памяти; сами данные принадлежат вызывающему
+class BytecodeView {
+public:
+    // false - файл поврежден или от другой версии; причина в error()
+    bool load(std::string_view data) {
+        if (!is_bytecode(data) || data.size() < sizeof(BytecodeHeader)) return fail("not a COW bytecode file");
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (header_.version != BYTECODE_VERSION) return fail("unsupported bytecode version");
+
+        std::size_t count = static_cast<std::size_t>(header_.count);
+        std::size_t expected = sizeof(BytecodeHeader) + count * sizeof(Instr);
+        if (header_.count > data.size() || data.size() != expected) return fail("truncated bytecode file");
+        // Смещения скобок - 32-битные
+        if (count > static_cast<std::size_t>(std::numeric_limits<int>::max())) return fail("bytecode file too large");
+
+        // Заголовок кратен 4, а mmap выравнивает начало по странице
+        code_ = std::span<const Instr>(reinterpret_cast<const Instr*>(data.data() + sizeof(BytecodeHeader)), count);
+
+        // Сколько ячеек левее указателя проверил GUARD перед текущей серией ADD_MUL
+        long long guarded = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const Instr& instr = code_[i];
+            if (instr.op < OP_LOOP_END || instr.op > OP_GUARD) return fail("invalid opcode in bytecode");
+            if (instr.op == OP_GUARD) {
+                // GUARD прыгает вперед на MOO исходного цикла
+                long long jump = static_cast<long long>(i) + instr.arg2;
+                if (instr.arg <= 0 || instr.arg2 <= 0 || jump >= static_cast<long long>(count) ||
+                    code_[jump].op != OP_LOOP_START) {
+                    return fail("invalid GUARD in bytecode");
+                }
+                guarded = instr.arg;
+            } else if (instr.op == OP_ADD_MUL) {
+                // Движки пишут цель ADD_MUL без проверки левого края ленты
+                if (-static_cast<long long>(instr.arg) > guarded) return fail("unguarded ADD_MUL offset in bytecode");
+            } else {
+                guarded = 0;
+            }
+        }
+
+        // Скобка должна указывать на парную, иначе движки уйдут за пределы кода
+        for (std::size_t i = next_loop_op(code_, 0); i < count; i = next_loop_op(code_, i + 1)) {
+            const Instr& instr = code_[i];
+            if (instr.arg == 0) continue;
+            long long jump = static_cast<long long>(i) + instr.arg;
+            bool forward = (instr.op == OP_LOOP_START);
+            bool paired = jump >= 0 && jump < static_cast<long long>(count) && (instr.arg > 0) == forward &&
+                          code_[jump].op == (forward ? OP_LOOP_END : OP_LOOP_START) &&
+                          code_[jump].arg == -instr.arg;
+            if (!paired) return fail("corrupt loop links in bytecode");
+        }
+        return true;
+    }
+
+    const BytecodeHeader& header() const { return header_; }
+    std::span<const Instr> code() const { return code_; }
+    const std::string& error() const { return error_; }
+
+private:
+    BytecodeHeader header_{};
+    std::span<const Instr> code_;
+    std::string error_;
+
+    bool fail(const char* reason) {
+        error_ = reason;
+        return false;
+    }
+};
+
+// Каталог кэша: $COW_CACHE_DIR, иначе $XDG_CACHE_HOME/cow, иначе ~/.cache/cow
+inline std::string default_cache_dir() {
+    if (const char* dir = std::getenv("COW_CACHE_DIR")) return dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) return std::string(xdg) + "/cow";
+    if (const char* home = std::getenv("HOME")) return std::string(home) + "/.cache/cow";
+    return ".cow_cache";
+}
+
+inline std::string cache_path(const std::string& dir, std::string_view source, uint32_t flags) {
+    char name[48];
+    std::snprintf(name, sizeof(name), "%016llx-%u.cowb",
+                  static_cast<unsigned long long>(hash_source(source)), flags);
+    return dir + "/" + name;
+}
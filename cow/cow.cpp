@@ -1,246 +1,452 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <stack>
-#include <cstdint>
-#include <optional>
-#include <limits>
-
-constexpr int MAX_RECURSION_DEPTH = 100;
-
-enum OpCode {
-    OP_LOOP_END   = 0,  // moo
-    OP_MOVE_LEFT  = 1,  // mOo
-    OP_MOVE_RIGHT = 2,  // moO
-    OP_EXEC_CELL  = 3,  // mOO
-    OP_IO_CHAR    = 4,  // Moo
-    OP_DEC        = 5,  // MOo
-    OP_INC        = 6,  // MoO
-    OP_LOOP_START = 7,  // MOO
-    OP_ZERO       = 8,  // OOO
-    OP_REGISTER   = 9,  // MMM
-    OP_PRINT_INT  = 10, // OOM
-    OP_READ_INT   = 11, // oom
-    OP_INVALID    = -1
-};
-
-struct VMState {
-    std::vector<int> memory;
-    std::size_t mem_ptr;
-    std::optional<int> reg_val;
-
-    VMState() : memory(10000, 0), mem_ptr(0), reg_val(std::nullopt) {}
-};
-
-inline bool is_cow_char(char c) {
-    return c == 'm' || c == 'M' || c == 'o' || c == 'O';
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+#include "vm.hpp"
+#include "cow_source.hpp"
+#include "bytecode.hpp"
+#include "jit_x86_64.hpp"
+#include "batch.hpp"
+#include "cow_lib.hpp"
+#include "profile.hpp"
+#include "tape_bounds.hpp"
+#include "trace.hpp"
+
+// Трассу пишут интерпретаторы с хуками; JIT cow_main заменяет на switch
+template <typename State>
+void run_traced(std::span<const Instr> instructions, State& state, Tracer& tracer, Engine engine) {
+    tracer.start(instructions);
+#ifdef COW_HAS_COMPUTED_GOTO
+    if (engine == ENGINE_THREADED) {
+        run_threaded(instructions, state, tracer);
+        return;
+    }
+#endif
+    (void)engine;
+    std::size_t instr_ptr = 0;
+    run_slice(instructions, state, instr_ptr, std::numeric_limits<std::uint64_t>::max(), tracer);
 }
 
-int get_command_code(char c1, char c2, char c3) {
-    uint32_t packed =
-        (static_cast<uint32_t>(static_cast<uint8_t>(c1)) << 16) |
-        (static_cast<uint32_t>(static_cast<uint8_t>(c2)) << 8) |
-        static_cast<uint32_t>(static_cast<uint8_t>(c3));
-
-    switch (packed) {
-        case 0x6D6F6F: return OP_LOOP_END;
-        case 0x6D4F6F: return OP_MOVE_LEFT;
-        case 0x6D6F4F: return OP_MOVE_RIGHT;
-        case 0x6D4F4F: return OP_EXEC_CELL;
-        case 0x4D6F6F: return OP_IO_CHAR;
-        case 0x4D4F6F: return OP_DEC;
-        case 0x4D6F4F: return OP_INC;
-        case 0x4D4F4F: return OP_LOOP_START;
-        case 0x4F4F4F: return OP_ZERO;
-        case 0x4D4D4D: return OP_REGISTER;
-        case 0x4F4F4D: return OP_PRINT_INT;
-        case 0x6F6F6D: return OP_READ_INT;
-        default: return OP_INVALID;
+template <typename State>
+void run(std::span<const Instr> instructions, State& state, const RunOptions& options = {}) {
+    if (options.tracer != nullptr) {
+        run_traced(instructions, state, *options.tracer, options.engine);
+        return;
+    }
+#ifdef COW_HAS_JIT
+    if (options.engine == ENGINE_JIT) {
+        // JIT генерирует код под плотную ленту из int, прочие состояния исполняет интерпретатор
+        if constexpr (std::is_same_v<State, VMState>) {
+            if (run_jit(instructions, state)) return;
+            std::cerr << "Warning: could not allocate executable memory, falling back to interpreter." << std::endl;
+        }
+    }
+#endif
+#ifdef COW_HAS_COMPUTED_GOTO
+    if (options.engine == ENGINE_THREADED) {
+        run_threaded(instructions, state);
+        return;
     }
+#endif
+    run_switch(instructions, state);
 }
 
-std::vector<int> parse(const std::string& source) {
-    std::vector<int> instructions;
-    instructions.reserve(source.length() / 3);
+// Под профилировщиком программа идет через run_slice с Profiler вместо NoHooks
+// (движок из options не используется); отчет печатается в stderr после вывода
+template <typename State>
+void run_profiled(std::span<const Instr> program, State& state, const SourceMap* map) {
+    Profiler profiler(program.size());
+    std::size_t instr_ptr = 0;
+    run_slice(program, state, instr_ptr, std::numeric_limits<std::uint64_t>::max(), profiler);
+    state.io->flush();
+    print_profile(std::cerr, profiler, program, map);
+}
+
+template <typename State>
+void execute_with_state(std::span<const Instr> program, const RunOptions& options, const SourceMap* map) {
+    State state;
+    if (options.io != nullptr) state.io = options.io;
+    if (options.profile) {
+        run_profiled(program, state, map);
+    } else {
+        run(program, state, options);
+    }
+}
 
-    for (size_t i = 0; i < source.length(); ++i) {
-        if (!is_cow_char(source[i])) {
-            continue;
+// Анализ доказал, что программе хватает bounds.tape_size() ячеек: лента
+// выделяется сразу, и движки исполняют сдвиги без проверок границ
+template <typename Cell>
+void execute_preallocated(std::span<const Instr> program, const TapeBounds& bounds, const RunOptions& options) {
+    std::size_t tape_size = std::max(INITIAL_TAPE_SIZE, bounds.tape_size());
+#ifdef COW_HAS_JIT
+    if constexpr (std::is_same_v<Cell, int>) {
+        if (options.engine == ENGINE_JIT) {
+            VMState state;
+            if (options.io != nullptr) state.io = options.io;
+            state.memory.resize(tape_size);
+            if (run_jit(program, state, true)) return;
+            std::cerr << "Warning: could not allocate executable memory, falling back to interpreter." << std::endl;
         }
-        if (i + 2 < source.length()) {
-            int cmd = get_command_code(source[i], source[i+1], source[i+2]);
-            if (cmd != OP_INVALID) {
-                instructions.push_back(cmd);
-                i += 2;
-            }
+    }
+#endif
+    BasicVMState<Cell, FixedTape<Cell>> state;
+    if (options.io != nullptr) state.io = options.io;
+    state.memory.resize(tape_size);
+    run(program, state, options);
+}
+
+template <typename Cell>
+void execute_with_cell(std::span<const Instr> program, const RunOptions& options, const SourceMap* map) {
+    if (options.tape == TAPE_PAGED) {
+        execute_with_state<BasicVMState<Cell, SegmentedTape<Cell>>>(program, options, map);
+        return;
+    }
+    if (!options.profile) {
+        TapeBounds bounds = analyze_tape(program);
+        if (bounds.bounded) {
+            execute_preallocated<Cell>(program, bounds, options);
+            return;
         }
     }
-    return instructions;
+    execute_with_state<BasicVMState<Cell>>(program, options, map);
+}
+
+// program - связанный IR (compile, compile_source или байткод);
+// map - карта смещений для отчета --profile (может отсутствовать)
+void execute_program(std::span<const Instr> program, const RunOptions& options = {},
+                     const SourceMap* map = nullptr) {
+    switch (options.cell) {
+        case CELL_U8:  execute_with_cell<uint8_t>(program, options, map); break;
+        case CELL_I64: execute_with_cell<int64_t>(program, options, map); break;
+        default:       execute_with_cell<int>(program, options, map); break;
+    }
 }
 
-void exec_single_op(int command, VMState& state) {
-    int effective_cmd = command;
+// Ищет байткод исходника в кэше; при промахе компилирует и кладет его туда
+void execute_cached(std::string_view source, const std::string& cache_dir, const RunOptions& options) {
+    uint32_t flags = bytecode_flags(options);
+    std::string path = cache_path(cache_dir, source, flags);
+
+    MappedFile cached(path.c_str());
+    BytecodeView bytecode;
+    if (cached.is_open() && bytecode.load(cached.view()) &&
+        bytecode.header().flags == flags &&
+        bytecode.header().source_hash == hash_source(source) &&
+        bytecode.header().source_size == source.size()) {
+        execute_program(bytecode.code(), options);
+        return;
+    }
 
-    for (int depth = 0; effective_cmd == OP_EXEC_CELL; ++depth) {
+    std::vector<Instr> program = compile_source(source, options);
 
-        if (depth > MAX_RECURSION_DEPTH) {
-            std::cerr << "Error: Maximum recursion depth exceeded via mOO." << std::endl;
-            return;
-        }
+    // Кэш - только ускорение: если каталог недоступен, просто работаем без него
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    write_bytecode_file(path, serialize_bytecode(program, source, flags));
 
-        int stored_val = state.memory[state.mem_ptr];
+    execute_program(program, options);
+}
 
-        if (stored_val == OP_LOOP_START || stored_val == OP_LOOP_END) {
-             return;
-        }
+void execute(const std::vector<int>& instructions, const RunOptions& options = {}) {
+    if (options.profile) {
+        // Источника нет: в отчете будут номера команд в instructions
+        SourceMap map;
+        std::vector<Instr> program = compile(instructions, options, &map.offsets);
+        execute_program(program, options, &map);
+        return;
+    }
+    execute_program(compile(instructions, options), options);
+}
 
-        // Подменяем команду и идем на следующую итерацию цикла
-        effective_cmd = stored_val;
-    }
-
-    switch (effective_cmd) {
-        case OP_LOOP_END:
-        case OP_LOOP_START:
-            break;
-        case OP_MOVE_LEFT:
-            if (state.mem_ptr > 0) state.mem_ptr--;
-            break;
-        case OP_MOVE_RIGHT:
-            state.mem_ptr++;
-            if (state.mem_ptr >= state.memory.size()) {
-                // Увеличиваем память, если вышли за границы
-                state.memory.resize(std::max(state.memory.size() * 2, state.mem_ptr + 1), 0);
-            }
-            break;
-        case OP_IO_CHAR:
-            if (state.memory[state.mem_ptr] == 0) {
-                // Чтение символа
-                char input_char;
-                if (std::cin.get(input_char)) {
-                    state.memory[state.mem_ptr] = static_cast<int>(static_cast<unsigned char>(input_char));
-                } else {
-                    state.memory[state.mem_ptr] = 0;
-                }
-            } else {
-                // Вывод символа
-                std::cout << static_cast<char>(state.memory[state.mem_ptr]);
-            }
-            break;
-
-        case OP_DEC:
-            state.memory[state.mem_ptr]--;
-            break;
-
-        case OP_INC:
-            state.memory[state.mem_ptr]++;
-            break;
-
-        case OP_ZERO:
-            state.memory[state.mem_ptr] = 0;
-            break;
-
-        case OP_REGISTER:
-            if (!state.reg_val.has_value()) {
-                state.reg_val = state.memory[state.mem_ptr];
-            } else {
-                state.memory[state.mem_ptr] = state.reg_val.value();
-                state.reg_val = std::nullopt;
-            }
-            break;
-
-        case OP_PRINT_INT:
-            std::cout << state.memory[state.mem_ptr];
-            break;
-
-        case OP_READ_INT:
-            {
-                int val;
-                if (std::cin >> val) {
-                    state.memory[state.mem_ptr] = val;
-                    // Очистка буфера от перевода строки, чтобы он не попал в следующий char
-                    if (std::cin.peek() == '\n') std::cin.ignore();
-                } else {
-                    std::cin.clear();
-                    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                    state.memory[state.mem_ptr] = 0;
-                }
-            }
-            break;
+// Компиляция с картой смещений и запуск под профилировщиком
+void execute_source_profiled(std::string_view source, const RunOptions& options) {
+    SourceMap map;
+    map.source = source;
+    std::vector<Instr> program = compile_source(source, options, &map.offsets);
+    execute_program(program, options, &map);
+}
+
+// Пакетный режим: задания из манифеста, сводка производительности в stdout
+int batch_main(const char* manifest_path, std::size_t jobs, std::chrono::milliseconds timeout,
+               bool async, const RunOptions& options) {
+    MappedFile manifest(manifest_path);
+    if (!manifest.is_open()) {
+        std::cerr << "Error: Could not open file " << manifest_path << std::endl;
+        return 1;
+    }
 
-        default:
-            break;
+    std::vector<BatchJob> batch;
+    std::string error;
+    if (!parse_manifest(manifest.view(), std::filesystem::path(manifest_path).parent_path(), batch, error)) {
+        std::cerr << "Error: " << manifest_path << ": " << error << std::endl;
+        return 1;
+    }
+
+    BatchRunner runner(jobs, timeout, options);
+    BatchReport report = async ? runner.run_async(batch) : runner.run(batch);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (report.results[i].status != JOB_OK) {
+            std::cerr << "Error: job " << i + 1 << " (" << batch[i].program << "): "
+                      << report.results[i].error << std::endl;
+        }
     }
+    print_batch_report(std::cout, report);
+    return (report.ok == batch.size()) ? 0 : 1;
 }
 
-void execute(const std::vector<int>& instructions) {
-    VMState state;
-    std::size_t instr_ptr = 0;
-    std::size_t n_instr = instructions.size();
-
-    // ИСПОЛЬЗУЕМ MAX() КАК МАРКЕР "НЕТ ПЕРЕХОДА"
-    constexpr std::size_t NO_JUMP = std::numeric_limits<std::size_t>::max();
-
-    // Инициализируем таблицу значением NO_JUMP вместо 0
-    std::vector<std::size_t> jump_table(n_instr, NO_JUMP);
-    std::stack<std::size_t> loop_stack;
-
-    // Предварительный проход
-    for (std::size_t i = 0; i < n_instr; ++i) {
-        if (instructions[i] == OP_LOOP_START) {
-            loop_stack.push(i);
-        } else if (instructions[i] == OP_LOOP_END) {
-            if (!loop_stack.empty()) {
-                std::size_t start = loop_stack.top();
-                loop_stack.pop();
-                jump_table[start] = i;
-                jump_table[i] = start;
+// Инструкций IR между снимками по умолчанию (порядка секунд работы)
+constexpr std::uint64_t DEFAULT_CHECKPOINT_INTERVAL = 1'000'000'000;
+
+inline bool is_regular_file(int fd) {
+    struct stat st {};
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Долгий прогон со снимками: каждые every инструкций состояние пишется в
+// checkpoint, и тот же запуск с resume продолжает с последнего снимка (если
+// его нет - с начала). output_fd >= 0 - вывод идет в обычный файл: перед
+// снимком он синхронизируется, а при продолжении обрезается до позиции
+// снимка, чтобы вывод после снимка не повторился. Успешно завершенный прогон
+// удаляет снимок.
+int run_with_checkpoints(const CowProgram& program, const RunOptions& options, const std::string& checkpoint,
+                         std::uint64_t every, bool resume, int output_fd) {
+    CowVM vm(options);
+    vm.load(program);
+
+    MappedFile saved(checkpoint.c_str());
+    if (resume && saved.is_open()) {
+        SnapshotView snapshot;
+        std::string error;
+        if (!snapshot.load(saved.view())) {
+            error = snapshot.error();
+        } else if (vm.restore(snapshot, error) && output_fd >= 0) {
+            struct stat st {};
+            fstat(output_fd, &st);
+            uint64_t offset = snapshot.header().output_offset;
+            if (static_cast<uint64_t>(st.st_size) < offset) {
+                error = "output file is shorter than at the snapshot";
+            } else if (ftruncate(output_fd, static_cast<off_t>(offset)) != 0 ||
+                       lseek(output_fd, static_cast<off_t>(offset), SEEK_SET) < 0) {
+                error = "could not truncate output to the snapshot";
             }
         }
+        if (!error.empty()) {
+            std::cerr << "Error: " << checkpoint << ": " << error << std::endl;
+            return 1;
+        }
     }
 
-    while (instr_ptr < n_instr) {
-        int command = instructions[instr_ptr];
+    while (vm.run({ .max_instructions = every }) == RUN_OUT_OF_BUDGET) {
+        std::string data = vm.snapshot();
+        if (output_fd >= 0) fsync(output_fd);
+        if (!write_snapshot_file(checkpoint, data)) {
+            std::cerr << "Error: Could not write file " << checkpoint << std::endl;
+            return 1;
+        }
+    }
+    vm.state().io->flush();
+    std::remove(checkpoint.c_str());
+    return 0;
+}
 
-        if (command == OP_LOOP_START) { // MOO
-            if (state.memory[state.mem_ptr] == 0) {
-                // Проверяем на NO_JUMP
-                if (jump_table[instr_ptr] != NO_JUMP) {
-                     instr_ptr = jump_table[instr_ptr];
-                } else {
-                    // Если парной скобки нет - просто идем дальше
-                }
-            }
-        } else if (command == OP_LOOP_END) { // moo
-            if (state.memory[state.mem_ptr] != 0) {
-                // Проверяем на NO_JUMP
-                if (jump_table[instr_ptr] != NO_JUMP) {
-                    instr_ptr = jump_table[instr_ptr];
-                    continue; // Прыжок назад, пропускаем инкремент в конце цикла
-                }
-            }
+// io - куда направить ввод/вывод программы; по умолчанию stdin/stdout через FdIO
+int cow_main(int argc, char* argv[], CowIO* io = nullptr) {
+    RunOptions options;
+    const char* path = nullptr;
+    const char* output = nullptr;
+    bool compile_only = false;
+    bool use_cache = false;
+    std::string cache_dir;
+    const char* manifest = nullptr;
+    std::size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    long timeout_ms = 0;
+    bool async = false;
+    std::string checkpoint;
+    std::uint64_t checkpoint_every = DEFAULT_CHECKPOINT_INTERVAL;
+    bool resume = false;
+    std::string trace_path;
+    bool bad_args = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-idioms") {
+            options.idioms = false;
+        } else if (arg == "--engine=switch") {
+            options.engine = ENGINE_SWITCH;
+        } else if (arg == "--engine=threaded") {
+#ifdef COW_HAS_COMPUTED_GOTO
+            options.engine = ENGINE_THREADED;
+#else
+            std::cerr << "Warning: threaded engine is not available, using switch." << std::endl;
+#endif
+        } else if (arg == "--engine=jit") {
+#ifdef COW_HAS_JIT
+            options.engine = ENGINE_JIT;
+#else
+            std::cerr << "Warning: JIT is not available on this platform, using interpreter." << std::endl;
+#endif
+        } else if (arg == "--cell=u8") {
+            options.cell = CELL_U8;
+        } else if (arg == "--cell=i32") {
+            options.cell = CELL_I32;
+        } else if (arg == "--cell=i64") {
+            options.cell = CELL_I64;
+        } else if (arg == "--tape=dense") {
+            options.tape = TAPE_DENSE;
+        } else if (arg == "--tape=paged") {
+            options.tape = TAPE_PAGED;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--compile") {
+            compile_only = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            use_cache = true;
+            cache_dir = arg.substr(std::string("--cache-dir=").size());
+        } else if (arg.rfind("--batch=", 0) == 0) {
+            manifest = argv[i] + std::string("--batch=").size();
+        } else if (arg.rfind("--jobs=", 0) == 0) {
+            jobs = std::strtoul(argv[i] + std::string("--jobs=").size(), nullptr, 10);
+            bad_args |= (jobs == 0);
+        } else if (arg.rfind("--timeout-ms=", 0) == 0) {
+            timeout_ms = std::strtol(argv[i] + std::string("--timeout-ms=").size(), nullptr, 10);
+            bad_args |= (timeout_ms <= 0);
+        } else if (arg == "--async") {
+            async = true;
+        } else if (arg.rfind("--checkpoint=", 0) == 0) {
+            checkpoint = arg.substr(std::string("--checkpoint=").size());
+            bad_args |= checkpoint.empty();
+        } else if (arg.rfind("--checkpoint-every=", 0) == 0) {
+            checkpoint_every = std::strtoull(argv[i] + std::string("--checkpoint-every=").size(), nullptr, 10);
+            bad_args |= (checkpoint_every == 0);
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            trace_path = arg.substr(std::string("--trace=").size());
+            bad_args |= trace_path.empty();
+        } else if (path == nullptr && arg.rfind("-", 0) != 0) {
+            path = argv[i];
         } else {
-            exec_single_op(command, state);
+            bad_args = true;
         }
-        instr_ptr++;
     }
-}
-int cow_main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+
+    // Трасса - одна программа через интерпретатор с хуками
+    if (!trace_path.empty()) {
+        bad_args |= manifest != nullptr || !checkpoint.empty() || options.profile || compile_only;
+#ifdef COW_HAS_JIT
+        if (options.engine == ENGINE_JIT) {
+            std::cerr << "Warning: JIT code cannot be traced, using switch." << std::endl;
+            options.engine = ENGINE_SWITCH;
+        }
+#endif
+    }
+
+    // Асинхронный ввод - только для пакетного режима
+    bad_args |= async && manifest == nullptr;
+
+    if (!bad_args && manifest != nullptr && path == nullptr) {
+        return batch_main(manifest, jobs, std::chrono::milliseconds(timeout_ms), async, options);
+    }
+
+    // Снимки поддерживает CowVM: ячейки int, плотная лента, без профилировщика
+    if (checkpoint.empty()) {
+        bad_args |= resume;
+    } else {
+        bad_args |= options.cell != CELL_I32 || options.tape != TAPE_DENSE || options.profile || compile_only;
+    }
+
+    if (bad_args || path == nullptr) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--no-idioms] [--engine=switch|threaded|jit] [--cell=u8|i32|i64] [--tape=dense|paged] [--profile]"
+                  << " [--cache | --cache-dir=<dir>] <file>" << std::endl;
+        std::cerr << "       " << argv[0] << " [--no-idioms] --compile [-o <out.cowb>] <file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch=<manifest> [--jobs=N] [--timeout-ms=N] [--async]" << std::endl;
+        std::cerr << "       " << argv[0] << " [--no-idioms] --checkpoint=<file> [--checkpoint-every=N] [--resume] <file>"
+                  << std::endl;
+        std::cerr << "       " << argv[0] << " [--no-idioms] [--engine=switch|threaded] --trace=<file.cowt> <file>"
+                  << std::endl;
         return 1;
     }
-    std::ifstream file(argv[1]);
+    MappedFile file(path);
     if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+        std::cerr << "Error: Could not open file " << path << std::endl;
         return 1;
     }
 
-    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string_view source = file.view();
+
+    if (compile_only) {
+        if (is_bytecode(source)) {
+            std::cerr << "Error: " << path << " is already compiled" << std::endl;
+            return 1;
+        }
+        std::string out_path = (output != nullptr) ? output : std::string(path) + "b";
+        std::vector<Instr> program = compile_source(source, options);
+        std::string data = serialize_bytecode(program, source, bytecode_flags(options));
+        if (!write_bytecode_file(out_path, data)) {
+            std::cerr << "Error: Could not write file " << out_path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
     if (source.empty()) return 0;
 
-    execute(parse(source));
+    FdIO fd_io;
+    options.io = (io != nullptr) ? io : &fd_io;
+
+    Tracer tracer;
+    if (!trace_path.empty()) {
+        if (!tracer.open(trace_path)) {
+            std::cerr << "Error: Could not write file " << trace_path << std::endl;
+            return 1;
+        }
+        options.tracer = &tracer;
+    }
+
+    if (!checkpoint.empty()) {
+        CowProgram program;
+        if (is_bytecode(source)) {
+            BytecodeView bytecode;
+            if (!bytecode.load(source)) {
+                std::cerr << "Error: " << path << ": " << bytecode.error() << std::endl;
+                return 1;
+            }
+            program = CowProgram(bytecode);
+        } else {
+            program = CowProgram(source, options);
+        }
+        int output_fd = (io == nullptr && is_regular_file(STDOUT_FILENO)) ? STDOUT_FILENO : -1;
+        return run_with_checkpoints(program, options, checkpoint, checkpoint_every, resume, output_fd);
+    }
+
+    if (is_bytecode(source)) {
+        BytecodeView bytecode;
+        if (!bytecode.load(source)) {
+            std::cerr << "Error: " << path << ": " << bytecode.error() << std::endl;
+            return 1;
+        }
+        execute_program(bytecode.code(), options);
+    } else if (options.profile) {
+        execute_source_profiled(source, options);
+    } else if (use_cache) {
+        execute_cached(source, cache_dir.empty() ? default_cache_dir() : cache_dir, options);
+    } else {
+        execute_program(compile_source(source, options), options);
+    }
+    options.io->flush();
+    if (!tracer.close()) {
+        std::cerr << "Error: Could not write file " << trace_path << std::endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "vm.hpp"
+#include "transpile_c.hpp"
+#include "cow_source.hpp"
+
+// Собирает C-файл системным компилятором ($CC или cc). Компилятор запускается
+// через execvp без оболочки, поэтому пути с кавычками и пробелами передаются
+// как есть; $CC делится по пробелам, чтобы работало, например, "ccache gcc"
+int build_native(const std::string& c_path, const std::string& binary_path) {
+    const char* cc = std::getenv("CC");
+    std::istringstream words(cc != nullptr ? cc : "");
+    std::vector<std::string> args{std::istream_iterator<std::string>(words), std::istream_iterator<std::string>()};
+    if (args.empty()) args.push_back("cc");
+    args.insert(args.end(), {"-O2", "-o", binary_path, c_path});
+
+    std::vector<char*> argv;
+    for (std::string& arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    pid_t pid = ::fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        ::execvp(argv[0], argv.data());
+        ::_exit(127);
+    }
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int cow2c_main(int argc, char* argv[]) {
+    RunOptions options;
+    bool build = false;
+    const char* output = nullptr;
+    const char* path = nullptr;
+    bool bad_args = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-idioms") {
+            options.idioms = false;
+        } else if (arg == "--build") {
+            build = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (path == nullptr && arg.rfind("-", 0) != 0) {
+            path = argv[i];
+        } else {
+            bad_args = true;
+        }
+    }
+
+    // Для --build нужен путь к бинарнику: C-файл ляжет рядом с ним
+    if (bad_args || path == nullptr || (build && output == nullptr)) {
+        std::cerr << "Usage: " << argv[0] << " [--no-idioms] [-o <out.c>] <file>" << std::endl;
+        std::cerr << "       " << argv[0] << " [--no-idioms] --build -o <binary> <file>" << std::endl;
+        return 1;
+    }
+
+    MappedFile file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return 1;
+    }
+
+    std::string c_code = emit_c(compile_source(file.view(), options));
+
+    if (output == nullptr) {
+        std::cout << c_code;
+        return 0;
+    }
+
+    std::string c_path = build ? std::string(output) + ".c" : std::string(output);
+    std::ofstream out(c_path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not write file " << c_path << std::endl;
+        return 1;
+    }
+    out << c_code;
+    out.close();
+
+    if (build && build_native(c_path, output) != 0) {
+        std::cerr << "Error: C compiler failed on " << c_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#ifndef UNIT_TEST
+int main(int argc, char* argv[]) {
+    return cow2c_main(argc, argv);
+}
+#endif
@@ -0,0 +1,312 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cow_lib.hpp"
+#include "cow_source.hpp"
+#include "jit_x86_64.hpp"
+
+// Бенчмарк движков: каждый пример из cow_examples и синтетические программы
+// прогоняются на каждом доступном движке. Замер идет в дочернем процессе,
+// чтобы пиковый RSS (ru_maxrss из wait4) относился к одному прогону.
+
+#ifndef COW_EXAMPLES_DIR
+#define COW_EXAMPLES_DIR "cow_examples"
+#endif
+
+// Ввод из строки, вывод отбрасывается: печать не должна влиять на замер
+class NullIO : public BufferedIO {
+public:
+    explicit NullIO(std::string input = "") : input_(std::move(input)) {}
+
+protected:
+    std::size_t read_some(char* data, std::size_t n) override {
+        std::size_t count = std::min(n, input_.size() - pos_);
+        input_.copy(data, count, pos_);
+        pos_ += count;
+        return count;
+    }
+
+    void write_all(const char*, std::size_t) override {}
+
+private:
+    std::string input_;
+    std::size_t pos_ = 0;
+};
+
+struct BenchProgram {
+    std::string name;
+    std::string source;
+    std::string input;
+};
+
+struct BenchResult {
+    std::string program;
+    Engine engine;
+    std::uint64_t instructions = 0;
+    std::uint64_t wall_ns = 0;
+    long peak_rss_kb = 0;
+    bool ok = false;
+};
+
+inline const char* engine_name(Engine engine) {
+    switch (engine) {
+        case ENGINE_SWITCH:   return "switch";
+        case ENGINE_THREADED: return "threaded";
+        case ENGINE_JIT:      return "jit";
+    }
+    return "?";
+}
+
+inline std::vector<Engine> available_engines() {
+    std::vector<Engine> engines = { ENGINE_SWITCH };
+#ifdef COW_HAS_COMPUTED_GOTO
+    engines.push_back(ENGINE_THREADED);
+#endif
+#ifdef COW_HAS_JIT
+    engines.push_back(ENGINE_JIT);
+#endif
+    return engines;
+}
+
+inline std::string repeat(std::string_view command, int count) {
+    std::string out;
+    for (int i = 0; i < count; ++i) {
+        out += command;
+        out += ' ';
+    }
+    return out;
+}
+
+// depth вложенных циклов, каждый на своей ячейке и по 2 итерации: 2^depth проходов
+inline std::string deep_nesting_program(int depth) {
+    return repeat("moO MoO MoO MOO", depth) + repeat("MOo moo mOo", depth);
+}
+
+// Длинные серии MoO/MOo, разбитые сдвигами. Пара MMM (запомнить и вернуть
+// значение) не меняет ячейку, но не дает свернуть цикл в ADD_MUL
+inline std::string inc_runs_program(int iterations) {
+    std::string body;
+    for (int i = 0; i < 16; ++i) body += "moO " + repeat("MoO", 37) + "moO " + repeat("MOo", 37) + "mOo mOo ";
+    return repeat("MoO", iterations) + "MOO " + body + "MMM MMM MOo moo";
+}
+
+// mOO в горячем цикле: ячейка 1 хранит код moO, который mOO и исполняет
+inline std::string exec_cell_program(int iterations) {
+    return repeat("MoO", iterations) +
+           "moO MoO MoO mOo "
+           "MOO " + repeat("moO mOO mOo mOo", 8) + "MOo moo";
+}
+
+inline std::vector<BenchProgram> bench_programs(const std::string& examples_dir) {
+    std::vector<BenchProgram> programs;
+
+    std::vector<std::pair<std::string, std::string>> examples = {
+        {"hello.cow", ""}, {"fib.cow", ""}, {"99.cow", ""}, {"add.cow", "7 35\n"}
+    };
+    for (const auto& [name, input] : examples) {
+        std::ifstream file(std::filesystem::path(examples_dir) / name, std::ios::binary);
+        if (!file) continue;
+        std::stringstream source;
+        source << file.rdbuf();
+        programs.push_back({name, source.str(), input});
+    }
+
+    programs.push_back({"synthetic/deep_nesting", deep_nesting_program(20), ""});
+    programs.push_back({"synthetic/inc_runs", inc_runs_program(20000), ""});
+    programs.push_back({"synthetic/exec_cell", exec_cell_program(200000), ""});
+    return programs;
+}
+
+// Число исполненных инструкций IR (одинаково для всех движков)
+inline std::uint64_t count_instructions(const CowProgram& program, const std::string& input) {
+    NullIO io(input);
+    RunOptions options;
+    options.engine = ENGINE_SWITCH;
+    options.io = &io;
+    CowVM vm(options);
+    vm.load(program);
+    vm.run({ .max_instructions = std::numeric_limits<std::uint64_t>::max() });
+    return vm.instructions_executed();
+}
+
+// Один прогон в дочернем процессе; время возвращается через pipe
+inline bool measure(const CowProgram& program, const std::string& input, Engine engine,
+                    std::uint64_t& wall_ns, long& peak_rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        NullIO io(input);
+        RunOptions options;
+        options.engine = engine;
+        options.io = &io;
+        CowVM vm(options);
+        vm.load(program);
+
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        std::uint64_t ns = static_cast<std::uint64_t>(elapsed.count());
+        bool written = write(fds[1], &ns, sizeof(ns)) == static_cast<ssize_t>(sizeof(ns));
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    std::uint64_t ns = 0;
+    bool got = read(fds[0], &ns, sizeof(ns)) == static_cast<ssize_t>(sizeof(ns));
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage {};
+    if (wait4(pid, &status, 0, &usage) != pid) return false;
+    if (!got || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+
+    wall_ns = ns;
+    peak_rss_kb = usage.ru_maxrss; // в Linux - килобайты
+    return true;
+}
+
+inline double instr_per_sec(const BenchResult& r) {
+    return r.wall_ns > 0 ? static_cast<double>(r.instructions) * 1e9 / static_cast<double>(r.wall_ns) : 0;
+}
+
+inline double ns_per_instr(const BenchResult& r) {
+    return r.instructions > 0 ? static_cast<double>(r.wall_ns) / static_cast<double>(r.instructions) : 0;
+}
+
+inline std::string json_escape(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+inline void print_json(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "{\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"program\": \"" << json_escape(r.program) << "\""
+            << ", \"engine\": \"" << engine_name(r.engine) << "\""
+            << ", \"ok\": " << (r.ok ? "true" : "false")
+            << ", \"instructions\": " << r.instructions
+            << ", \"wall_ns\": " << r.wall_ns
+            << ", \"instr_per_sec\": " << instr_per_sec(r)
+            << ", \"ns_per_instr\": " << ns_per_instr(r)
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+inline void print_table(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "program                   engine     instructions   wall ms    Minstr/s  ns/instr  peak RSS KB\n";
+    for (const BenchResult& r : results) {
+        char line[200];
+        if (!r.ok) {
+            std::snprintf(line, sizeof(line), "%-25s %-9s  FAILED\n", r.program.c_str(), engine_name(r.engine));
+        } else {
+            std::snprintf(line, sizeof(line), "%-25s %-9s %13llu %9.2f %11.1f %9.2f %12ld\n",
+                          r.program.c_str(), engine_name(r.engine),
+                          static_cast<unsigned long long>(r.instructions),
+                          static_cast<double>(r.wall_ns) / 1e6, instr_per_sec(r) / 1e6, ns_per_instr(r),
+                          r.peak_rss_kb);
+        }
+        out << line;
+    }
+}
+
+int cow_bench_main(int argc, char* argv[]) {
+    bool json = false;
+    int repeats = 3;
+    std::string examples_dir = COW_EXAMPLES_DIR;
+    std::vector<Engine> engines = available_engines();
+    bool bad_args = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg.rfind("--repeat=", 0) == 0) {
+            repeats = std::atoi(argv[i] + std::string("--repeat=").size());
+            bad_args |= (repeats <= 0);
+        } else if (arg.rfind("--examples=", 0) == 0) {
+            examples_dir = arg.substr(std::string("--examples=").size());
+        } else if (arg.rfind("--engine=", 0) == 0) {
+            std::string name = arg.substr(std::string("--engine=").size());
+            std::vector<Engine> selected;
+            for (Engine engine : available_engines()) {
+                if (name == engine_name(engine)) selected.push_back(engine);
+            }
+            bad_args |= selected.empty();
+            engines = selected;
+        } else {
+            bad_args = true;
+        }
+    }
+
+    if (bad_args) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--json] [--repeat=N] [--engine=switch|threaded|jit] [--examples=<dir>]" << std::endl;
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    for (const BenchProgram& bench : bench_programs(examples_dir)) {
+        CowProgram program(bench.source);
+        std::uint64_t instructions = count_instructions(program, bench.input);
+
+        for (Engine engine : engines) {
+            BenchResult result;
+            result.program = bench.name;
+            result.engine = engine;
+            result.instructions = instructions;
+            result.ok = true;
+            // Лучшее время из repeats прогонов, RSS - максимум
+            for (int r = 0; r < repeats && result.ok; ++r) {
+                std::uint64_t wall_ns = 0;
+                long rss = 0;
+                result.ok = measure(program, bench.input, engine, wall_ns, rss);
+                if (r == 0 || wall_ns < result.wall_ns) result.wall_ns = wall_ns;
+                result.peak_rss_kb = std::max(result.peak_rss_kb, rss);
+            }
+            results.push_back(result);
+        }
+    }
+
+    if (json) {
+        print_json(std::cout, results);
+    } else {
+        print_table(std::cout, results);
+    }
+
+    for (const BenchResult& r : results) {
+        if (!r.ok) return 1;
+    }
+    return 0;
+}
+
+#ifndef UNIT_TEST
+int main(int argc, char* argv[]) {
+    return cow_bench_main(argc, argv);
+}
+#endif
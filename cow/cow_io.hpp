@@ -0,0 +1,284 @@
+#pragma once
+
+// Ввод/вывод виртуальной машины.
+//
+// StreamIO - прежнее поведение через std::cin/std::cout (по одному символу).
+// BufferedIO копит вывод в большом буфере и читает ввод крупными блоками;
+// перед каждым обращением к источнику ввода вывод сбрасывается, чтобы
+// интерактивные программы успевали показать приглашение.
+//   FdIO     - сырые read/write по файловым дескрипторам (cow_app)
+//   MemoryIO - строки в памяти (юнит-тесты)
+//   AsyncIO  - ввод, который подвозит цикл событий (async_io.hpp)
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <limits>
+#include <charconv>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include <unistd.h>
+
+class CowIO {
+public:
+    virtual ~CowIO() = default;
+
+    virtual bool read_char(char& c) = 0;
+    // Семантика std::cin >> int: при ошибке (в том числе выходе за [min, max])
+    // строка ввода пропускается до '\n'
+    virtual bool read_int(long long& value,
+                          long long min = std::numeric_limits<int>::min(),
+                          long long max = std::numeric_limits<int>::max()) = 0;
+    virtual void write_char(char c) = 0;
+    virtual void write_int(long long value) = 0;
+    virtual void flush() {}
+
+    // Позиции для снимков состояния (snapshot.hpp): сколько байт ввода
+    // программа прочитала и сколько байт вывода выдала. StreamIO их не знает.
+    virtual std::uint64_t input_offset() const { return 0; }
+    virtual std::uint64_t output_offset() const { return 0; }
+    // Проматывает count байт ввода при продолжении со снимка; false - ввод кончился раньше
+    virtual bool skip_input(std::uint64_t count) { return count == 0; }
+
+    // Прочитает ли read_char/read_int без ожидания. Блокирующие источники
+    // просто ждут, поэтому по умолчанию - да; false возвращает только
+    // AsyncIO, когда нужных байт еще нет (InputGate в vm.hpp)
+    virtual bool can_read_char() { return true; }
+    virtual bool can_read_int() { return true; }
+};
+
+class StreamIO : public CowIO {
+public:
+    bool read_char(char& c) override {
+        return static_cast<bool>(std::cin.get(c));
+    }
+
+    bool read_int(long long& value,
+                  long long min = std::numeric_limits<int>::min(),
+                  long long max = std::numeric_limits<int>::max()) override {
+        if (std::cin >> value) {
+            if (value < min || value > max) {
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                return false;
+            }
+            // Очистка буфера от перевода строки, чтобы он не попал в следующий char
+            if (std::cin.peek() == '\n') std::cin.ignore();
+            return true;
+        }
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return false;
+    }
+
+    void write_char(char c) override { std::cout << c; }
+    void write_int(long long value) override { std::cout << value; }
+    void flush() override { std::cout.flush(); }
+};
+
+// Общий экземпляр для VMState по умолчанию
+inline StreamIO& stream_io() {
+    static StreamIO io;
+    return io;
+}
+
+class BufferedIO : public CowIO {
+public:
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+    ~BufferedIO() override = default;
+
+    bool read_char(char& c) override {
+        int next = take();
+        if (next < 0) return false;
+        c = static_cast<char>(next);
+        return true;
+    }
+
+    bool read_int(long long& value,
+                  long long min = std::numeric_limits<int>::min(),
+                  long long max = std::numeric_limits<int>::max()) override {
+        int c = peek();
+        while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+            take();
+            c = peek();
+        }
+
+        bool negative = false;
+        if (c == '+' || c == '-') {
+            negative = (c == '-');
+            take();
+            c = peek();
+        }
+
+        // Модуль копится в unsigned, чтобы вместить и min() для long long
+        unsigned long long magnitude = 0;
+        unsigned long long limit = negative ? 0ULL - static_cast<unsigned long long>(std::min(min, 0LL))
+                                            : static_cast<unsigned long long>(std::max(max, 0LL));
+        bool any_digit = false;
+        bool overflow = false;
+        while (c >= '0' && c <= '9') {
+            any_digit = true;
+            unsigned digit = static_cast<unsigned>(c - '0');
+            if (overflow || magnitude > (limit - digit) / 10) {
+                overflow = true;
+            } else {
+                magnitude = magnitude * 10 + digit;
+            }
+            take();
+            c = peek();
+        }
+
+        long long result = negative ? static_cast<long long>(0ULL - magnitude)
+                                    : static_cast<long long>(magnitude);
+        if (!any_digit || overflow || result < min || result > max) {
+            skip_line();
+            return false;
+        }
+
+        value = result;
+        if (c == '\n') take();
+        return true;
+    }
+
+    void write_char(char c) override {
+        if (out_len_ == BUFFER_SIZE) flush();
+        out_[out_len_++] = c;
+    }
+
+    void write_int(long long value) override {
+        if (BUFFER_SIZE - out_len_ < 24) flush();
+        auto res = std::to_chars(out_ + out_len_, out_ + BUFFER_SIZE, value);
+        out_len_ = static_cast<std::size_t>(res.ptr - out_);
+    }
+
+    void flush() override {
+        if (out_len_ > 0) {
+            write_all(out_, out_len_);
+            out_flushed_ += out_len_;
+            out_len_ = 0;
+        }
+    }
+
+    std::uint64_t input_offset() const override { return in_base_ + in_pos_; }
+    std::uint64_t output_offset() const override { return out_flushed_ + out_len_; }
+
+    bool skip_input(std::uint64_t count) override {
+        for (; count > 0; --count) {
+            if (take() < 0) return false;
+        }
+        return true;
+    }
+
+protected:
+    // Читает до n байт; 0 - конец ввода
+    virtual std::size_t read_some(char* data, std::size_t n) = 0;
+    virtual void write_all(const char* data, std::size_t n) = 0;
+
+    // Уже прочитанный из источника, но еще не разобранный ввод
+    std::string_view buffered_input() const { return std::string_view(in_ + in_pos_, in_len_ - in_pos_); }
+
+private:
+    char in_[BUFFER_SIZE];
+    char out_[BUFFER_SIZE];
+    std::size_t in_pos_ = 0;
+    std::size_t in_len_ = 0;
+    std::size_t out_len_ = 0;
+    bool eof_ = false;
+    std::uint64_t in_base_ = 0;     // байт ввода в прежних заполнениях буфера
+    std::uint64_t out_flushed_ = 0; // байт вывода, уже отданных write_all
+
+    bool fill() {
+        if (eof_) return false;
+        flush();
+        in_base_ += in_len_;
+        in_pos_ = 0;
+        in_len_ = read_some(in_, BUFFER_SIZE);
+        if (in_len_ == 0) eof_ = true;
+        return in_len_ > 0;
+    }
+
+    int peek() {
+        if (in_pos_ == in_len_ && !fill()) return -1;
+        return static_cast<unsigned char>(in_[in_pos_]);
+    }
+
+    int take() {
+        int c = peek();
+        if (c >= 0) ++in_pos_;
+        return c;
+    }
+
+    void skip_line() {
+        int c;
+        do {
+            c = take();
+        } while (c >= 0 && c != '\n');
+    }
+};
+
+class FdIO : public BufferedIO {
+public:
+    FdIO(int in_fd = STDIN_FILENO, int out_fd = STDOUT_FILENO) : in_fd_(in_fd), out_fd_(out_fd) {}
+
+    ~FdIO() override { flush(); }
+
+protected:
+    std::size_t read_some(char* data, std::size_t n) override {
+        for (;;) {
+            ssize_t got = ::read(in_fd_, data, n);
+            if (got >= 0) return static_cast<std::size_t>(got);
+            if (errno != EINTR) return 0;
+        }
+    }
+
+    void write_all(const char* data, std::size_t n) override {
+        while (n > 0) {
+            ssize_t put = ::write(out_fd_, data, n);
+            if (put < 0) {
+                if (errno == EINTR) continue;
+                return; // писать некуда (например, закрытый pipe) - вывод теряется
+            }
+            data += put;
+            n -= static_cast<std::size_t>(put);
+        }
+    }
+
+private:
+    int in_fd_;
+    int out_fd_;
+};
+
+class MemoryIO : public BufferedIO {
+public:
+    explicit MemoryIO(std::string input = "") : input_(std::move(input)) {}
+
+    const std::string& output() {
+        flush();
+        return output_;
+    }
+
+    // Сколько раз вывод сбрасывался в приемник (для проверки буферизации)
+    int flush_count() const { return flushes_; }
+
+protected:
+    std::size_t read_some(char* data, std::size_t n) override {
+        std::size_t count = std::min(n, input_.size() - pos_);
+        input_.copy(data, count, pos_);
+        pos_ += count;
+        return count;
+    }
+
+    void write_all(const char* data, std::size_t n) override {
+        output_.append(data, n);
+        ++flushes_;
+    }
+
+private:
+    std::string input_;
+    std::size_t pos_ = 0;
+    std::string output_;
+    int flushes_ = 0;
+};
@@ -0,0 +1,155 @@
+#include "cow_lib.hpp"
+
+#include <algorithm>
+
+#include "jit_x86_64.hpp"
+
+CowProgram::CowProgram() : CowProgram(std::vector<Instr>{}) {}
+
+CowProgram::CowProgram(std::string_view source, const RunOptions& options)
+    : CowProgram(compile_source(source, options)) {}
+
+CowProgram::CowProgram(std::vector<Instr> code) {
+    auto compiled = std::make_shared<Compiled>();
+    link_loops(code);
+    compiled->bounds = analyze_tape(code);
+    compiled->code = std::move(code);
+    compiled_ = std::move(compiled);
+}
+
+CowProgram::CowProgram(const BytecodeView& bytecode) {
+    auto compiled = std::make_shared<Compiled>();
+    compiled->code.assign(bytecode.code().begin(), bytecode.code().end());
+    compiled->bounds = analyze_tape(compiled->code);
+    compiled_ = std::move(compiled);
+}
+
+CowVM::CowVM(const RunOptions& options) : engine_(options.engine) {
+    set_io(options.io);
+}
+
+void CowVM::load(const CowProgram& program) {
+    program_ = program;
+    reset();
+}
+
+void CowVM::reset() {
+    std::fill(state_.memory.begin(), state_.memory.end(), 0);
+    state_.mem_ptr = 0;
+    state_.reg_val.reset();
+    instr_ptr_ = 0;
+    executed_ = 0;
+    output_base_ = 0;
+}
+
+std::string CowVM::snapshot() {
+    state_.io->flush();
+    SnapshotPosition position;
+    position.instr_ptr = instr_ptr_;
+    position.executed = executed_;
+    position.input_offset = state_.io->input_offset();
+    position.output_offset = output_base_ + state_.io->output_offset();
+    return serialize_snapshot(program_.code(), state_, position);
+}
+
+bool CowVM::restore(const SnapshotView& snapshot, std::string& error) {
+    if (!snapshot.matches(program_.code())) {
+        error = "snapshot was taken from a different program";
+        return false;
+    }
+    SnapshotPosition position = snapshot.position();
+    CowIO& io = *state_.io;
+    if (io.input_offset() > position.input_offset || io.output_offset() > position.output_offset) {
+        error = "I/O has already advanced past the snapshot";
+        return false;
+    }
+    if (!io.skip_input(position.input_offset - io.input_offset())) {
+        error = "input is shorter than at the snapshot";
+        return false;
+    }
+    snapshot.restore(state_);
+    instr_ptr_ = static_cast<std::size_t>(position.instr_ptr);
+    executed_ = position.executed;
+    output_base_ = position.output_offset - io.output_offset();
+    return true;
+}
+
+RunStatus CowVM::run(const RunBudget& budget) {
+    // Указатель за пределами доказанной ленты возможен только после ручной
+    // правки state(); тогда просто работаем с проверками
+    const TapeBounds& bounds = program_.tape_bounds();
+    if (!bounds.bounded || state_.mem_ptr > bounds.max_cell) return run_interpreted(state_, budget);
+
+    if (state_.memory.size() < bounds.tape_size()) state_.memory.resize(bounds.tape_size(), 0);
+#ifdef COW_HAS_JIT
+    if (budget.unlimited() && instr_ptr_ == 0 && engine_ == ENGINE_JIT &&
+        run_jit(program_.code(), state_, true)) {
+        instr_ptr_ = program_.size();
+        return RUN_FINISHED;
+    }
+#endif
+
+    // Лента одалживается состоянию с FixedTape на время запуска, без копирования
+    BasicVMState<int, FixedTape<int>> fixed{FixedTape<int>{}};
+    fixed.memory.swap(state_.memory);
+    fixed.mem_ptr = state_.mem_ptr;
+    fixed.reg_val = state_.reg_val;
+    fixed.io = state_.io;
+    RunStatus status = run_interpreted(fixed, budget);
+    state_.memory.swap(fixed.memory);
+    state_.mem_ptr = fixed.mem_ptr;
+    state_.reg_val = fixed.reg_val;
+    return status;
+}
+
+template <typename State>
+RunStatus CowVM::run_interpreted(State& state, const RunBudget& budget) {
+    std::span<const Instr> code = program_.code();
+
+    if (budget.unlimited() && instr_ptr_ == 0) {
+#ifdef COW_HAS_JIT
+        if constexpr (std::is_same_v<State, VMState>) {
+            if (engine_ == ENGINE_JIT && run_jit(code, state)) {
+                instr_ptr_ = code.size();
+                return RUN_FINISHED;
+            }
+        }
+#endif
+#ifdef COW_HAS_COMPUTED_GOTO
+        if (engine_ != ENGINE_SWITCH) {
+            run_threaded(code, state);
+            instr_ptr_ = code.size();
+            return RUN_FINISHED;
+        }
+#endif
+    }
+
+    std::uint64_t remaining = budget.max_instructions;
+    bool timed = budget.time_limit.count() > 0;
+    auto deadline = std::chrono::steady_clock::now() + budget.time_limit;
+
+    while (!finished()) {
+        std::uint64_t slice = std::numeric_limits<std::uint64_t>::max();
+        if (budget.max_instructions != 0) {
+            if (remaining == 0) return RUN_OUT_OF_BUDGET;
+            slice = remaining;
+        }
+        if (timed) slice = std::min(slice, TIME_CHECK_INTERVAL);
+
+        std::uint64_t steps;
+        bool starved = false;
+        if (budget.suspend_on_input) {
+            InputGate gate;
+            steps = run_slice(code, state, instr_ptr_, slice, gate);
+            starved = gate.starved;
+        } else {
+            steps = run_slice(code, state, instr_ptr_, slice);
+        }
+        executed_ += steps;
+        if (budget.max_instructions != 0) remaining -= steps;
+        if (starved) return RUN_WAITING_INPUT;
+
+        if (timed && !finished() && std::chrono::steady_clock::now() >= deadline) return RUN_OUT_OF_TIME;
+    }
+    return RUN_FINISHED;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// libcow - встраиваемый API интерпретатора.
+//
+// CowProgram - скомпилированная программа (IR + таблица переходов). Неизменяема,
+// копируется за O(1) и может одновременно исполняться из нескольких потоков.
+// CowVM - переиспользуемая машина: load()/reset() обнуляют ленту, не отдавая
+// память, а run() с бюджетом останавливается по числу инструкций или времени
+// и продолжает с того же места при следующем вызове.
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "vm.hpp"
+#include "bytecode.hpp"
+#include "tape_bounds.hpp"
+#include "snapshot.hpp"
+
+class CowProgram {
+public:
+    // Пустая программа
+    CowProgram();
+    explicit CowProgram(std::string_view source, const RunOptions& options = {});
+    // Связывает скобки сам: подходит и IR, собранный вручную
+    explicit CowProgram(std::vector<Instr> code);
+    // Копирует код из проверенного байткода (BytecodeView::load вернул true)
+    explicit CowProgram(const BytecodeView& bytecode);
+
+    std::span<const Instr> code() const { return compiled_->code; }
+    std::size_t size() const { return compiled_->code.size(); }
+    // Считается один раз при создании программы
+    const TapeBounds& tape_bounds() const { return compiled_->bounds; }
+
+private:
+    struct Compiled {
+        std::vector<Instr> code;
+        TapeBounds bounds;
+    };
+
+    std::shared_ptr<const Compiled> compiled_;
+};
+
+// Ограничение одного вызова CowVM::run; нули - без ограничения
+struct RunBudget {
+    std::uint64_t max_instructions = 0;
+    std::chrono::nanoseconds time_limit{0};
+    // Не ждать ввода: остановиться перед инструкцией, которой не хватает уже
+    // полученных байт (CowIO::can_read_*), и вернуть RUN_WAITING_INPUT
+    bool suspend_on_input = false;
+
+    bool unlimited() const { return max_instructions == 0 && time_limit.count() == 0 && !suspend_on_input; }
+};
+
+enum RunStatus {
+    RUN_FINISHED,          // программа дошла до конца
+    RUN_OUT_OF_BUDGET,     // исчерпан лимит инструкций
+    RUN_OUT_OF_TIME,       // исчерпан лимит времени
+    RUN_WAITING_INPUT      // suspend_on_input: следующей инструкции нужен еще не пришедший ввод
+};
+
+class CowVM {
+public:
+    // Инструкций между проверками часов при лимите времени
+    static constexpr std::uint64_t TIME_CHECK_INTERVAL = 1 << 16;
+
+    // Используются options.io и options.engine
+    explicit CowVM(const RunOptions& options = {});
+
+    // Загружает программу и сбрасывает состояние
+    void load(const CowProgram& program);
+    // Возвращает машину к началу программы: лента обнуляется без перевыделения
+    void reset();
+
+    // Без бюджета первый запуск идет выбранным движком целиком; с бюджетом -
+    // через run_slice, и повторный вызов продолжает прерванное исполнение.
+    // Если у программы tape_bounds().bounded, лента растягивается до нужного
+    // размера до запуска и движки работают без проверок границ. Состояние
+    // должно быть достижимо из начала программы (load(), reset(), restore()):
+    // правка state().mem_ptr вручную этот расчет нарушает.
+    RunStatus run(const RunBudget& budget = {});
+
+    bool finished() const { return instr_ptr_ >= program_.size(); }
+    // Исполнено инструкций IR в запусках с бюджетом
+    std::uint64_t instructions_executed() const { return executed_; }
+
+    // Снимок для продолжения после сбоя (snapshot.hpp). Вывод перед снимком
+    // сбрасывается, так что все байты до output_offset уже отданы CowIO.
+    std::string snapshot();
+    // Продолжает загруженную программу с места снимка: ввод текущего CowIO
+    // проматывается до сохраненной позиции, счет вывода продолжается с
+    // сохраненного. false - снимок от другой программы или ввод короче; причина в error
+    bool restore(const SnapshotView& snapshot, std::string& error);
+
+    const CowProgram& program() const { return program_; }
+    VMState& state() { return state_; }
+    void set_io(CowIO* io) { state_.io = (io != nullptr) ? io : &stream_io(); }
+
+private:
+    CowProgram program_;
+    VMState state_;
+    Engine engine_;
+    std::size_t instr_ptr_ = 0;
+    std::uint64_t executed_ = 0;
+    // Вывод, выданный до снимка, с которого продолжили
+    std::uint64_t output_base_ = 0;
+
+    template <typename State>
+    RunStatus run_interpreted(State& state, const RunBudget& budget);
+};
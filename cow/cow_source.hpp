@@ -0,0 +1,69 @@
+#pragma once
+
+// Загрузка исходника через mmap: разбор идет прямо по отображенным страницам,
+// без копии файла в std::string. Для того, что нельзя отобразить (pipe,
+// /dev/stdin), файл читается в обычный буфер.
+
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile {
+public:
+    explicit MappedFile(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return;
+        open_ = true;
+
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ == 0) {
+                ::close(fd);
+                return;
+            }
+            void* mem = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mem != MAP_FAILED) {
+                madvise(mem, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(mem);
+                ::close(fd);
+                return;
+            }
+        }
+
+        // Отобразить не удалось - читаем как поток
+        char chunk[1 << 16];
+        ssize_t got;
+        while ((got = ::read(fd, chunk, sizeof(chunk))) > 0) {
+            fallback_.append(chunk, static_cast<std::size_t>(got));
+        }
+        ::close(fd);
+        size_ = fallback_.size();
+        data_ = fallback_.data();
+    }
+
+    ~MappedFile() {
+        if (data_ != nullptr && data_ != fallback_.data()) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return open_; }
+
+    std::string_view view() const {
+        return data_ != nullptr ? std::string_view(data_, size_) : std::string_view();
+    }
+
+private:
+    bool open_ = false;
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::string fallback_;
+};
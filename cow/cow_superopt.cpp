@@ -0,0 +1,213 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+
+#include "vm.hpp"
+#include "cow_source.hpp"
+#include "profile.hpp"
+
+// cow_superopt - генератор суперинструкций для шитого кода.
+//
+// Каждая программа корпуса компилируется в IR и прогоняется под Profiler.
+// Затем считаются n-граммы кодов IR (2..MAX_LENGTH подряд идущих инструкций
+// без скобок), взвешенные числом исполнений первой из них. Лучшие по числу
+// сэкономленных переходов (исполнения * (n - 1)) записываются в
+// superinstructions.hpp: таблица шаблонов, метки и готовые обработчики.
+
+// Сколько инструкций исполнять одну программу корпуса, прежде чем бросить
+constexpr std::uint64_t PROFILE_STEP_LIMIT = 100'000'000;
+
+using Ngram = std::vector<int>;
+
+struct NgramScore {
+    Ngram ops;
+    std::uint64_t executions = 0;
+
+    std::uint64_t saved_dispatches() const { return executions * (ops.size() - 1); }
+};
+
+// Ввод корпуса пустой, вывод отбрасывается
+class DiscardIO : public MemoryIO {
+protected:
+    void write_all(const char*, std::size_t) override {}
+};
+
+inline bool fusible(int op) {
+    // Скобки и GUARD прыгают, поэтому в серию не входят
+    return op != OP_LOOP_START && op != OP_LOOP_END && op >= 0 && op <= OP_SCAN;
+}
+
+// Добавляет к ngrams n-граммы одной программы с весами из профиля
+inline void count_ngrams(std::span<const Instr> program, const std::vector<std::uint64_t>& counts,
+                         std::size_t max_length, std::map<Ngram, std::uint64_t>& ngrams) {
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (counts[i] == 0) continue;
+        Ngram ops;
+        for (std::size_t k = i; k < program.size() && ops.size() < max_length && fusible(program[k].op); ++k) {
+            ops.push_back(program[k].op);
+            if (ops.size() >= 2) ngrams[ops] += counts[i];
+        }
+    }
+}
+
+// Возвращает число исполненных инструкций IR
+inline std::uint64_t profile_source(std::string_view source, std::size_t max_length,
+                                    std::map<Ngram, std::uint64_t>& ngrams) {
+    std::vector<Instr> program = compile_source(source, RunOptions{});
+
+    DiscardIO io;
+    VMState state;
+    state.io = &io;
+    Profiler profiler(program.size());
+    std::size_t instr_ptr = 0;
+    std::uint64_t executed =
+        run_slice(std::span<const Instr>(program), state, instr_ptr, PROFILE_STEP_LIMIT, profiler);
+
+    count_ngrams(program, profiler.counts(), max_length, ngrams);
+    return executed;
+}
+
+// Лучшие count шаблонов; в таблице - от длинных к коротким, чтобы при разборе
+// шитого кода побеждал самый длинный подходящий
+inline std::vector<NgramScore> select_superinstructions(const std::map<Ngram, std::uint64_t>& ngrams,
+                                                        std::size_t count) {
+    std::vector<NgramScore> scores;
+    for (const auto& [ops, executions] : ngrams) scores.push_back({ops, executions});
+    std::stable_sort(scores.begin(), scores.end(), [](const NgramScore& a, const NgramScore& b) {
+        return a.saved_dispatches() > b.saved_dispatches();
+    });
+    if (scores.size() > count) scores.resize(count);
+    std::stable_sort(scores.begin(), scores.end(), [](const NgramScore& a, const NgramScore& b) {
+        return a.ops.size() > b.ops.size();
+    });
+    return scores;
+}
+
+// Оператор, исполняющий k-ю инструкцию серии в обработчике run_threaded
+inline std::string step_code(int op, std::size_t k) {
+    std::string arg = "ip[" + std::to_string(k) + "].arg";
+    switch (op) {
+        case OP_ADD:       return "exec_add(" + arg + ", state);";
+        case OP_SHIFT:     return "exec_shift(" + arg + ", state);";
+        case OP_SET:       return "exec_set(" + arg + ", state);";
+        case OP_ADD_MUL:   return "exec_add_mul(" + arg + ", " + arg + "2, state);";
+        case OP_SCAN:      return "while (!exec_scan(" + arg + ", state)) {}";
+        case OP_MOVE_LEFT: return "op_move_left(state);";
+        case OP_MOVE_RIGHT:return "op_move_right(state);";
+        case OP_EXEC_CELL: return "exec_cell(state);";
+        case OP_IO_CHAR:   return "op_io_char(state);";
+        case OP_DEC:       return "op_dec(state);";
+        case OP_INC:       return "op_inc(state);";
+        case OP_ZERO:      return "op_zero(state);";
+        case OP_REGISTER:  return "op_register(state);";
+        case OP_PRINT_INT: return "op_print_int(state);";
+        case OP_READ_INT:  return "op_read_int(state);";
+        default:           return ";";
+    }
+}
+
+inline std::string op_enum_name(int op) {
+    static const char* const names[] = {
+        "OP_LOOP_END", "OP_MOVE_LEFT", "OP_MOVE_RIGHT", "OP_EXEC_CELL", "OP_IO_CHAR", "OP_DEC",
+        "OP_INC", "OP_LOOP_START", "OP_ZERO", "OP_REGISTER", "OP_PRINT_INT", "OP_READ_INT",
+        "OP_ADD", "OP_SHIFT", "OP_SET", "OP_ADD_MUL", "OP_SCAN", "OP_GUARD"
+    };
+    return names[op];
+}
+
+// Текст superinstructions.hpp. Файл включается в vm.hpp трижды: с
+// COW_SUPER_PATTERNS (таблица), COW_SUPER_LABELS (метки) и COW_SUPER_HANDLERS
+// (код обработчиков внутри run_threaded).
+inline std::string emit_superinstructions(const std::vector<NgramScore>& supers, std::uint64_t total) {
+    std::ostringstream out;
+    out << "// Сгенерировано cow_superopt по профилю корпуса, не редактировать вручную.\n";
+    out << "// Всего исполнено инструкций IR: " << total << "\n\n";
+
+    out << "#if defined(COW_SUPER_PATTERNS)\n";
+    out << "inline constexpr SuperPattern SUPER_PATTERN_TABLE[] = {\n";
+    for (const NgramScore& s : supers) {
+        out << "    {" << s.ops.size() << ", {";
+        for (std::size_t k = 0; k < s.ops.size(); ++k) out << (k ? ", " : "") << op_enum_name(s.ops[k]);
+        out << "}}, // " << s.saved_dispatches() << " переходов\n";
+    }
+    if (supers.empty()) out << "    {0, {}}\n";
+    out << "};\n";
+    out << "inline constexpr std::span<const SuperPattern> SUPER_PATTERNS{SUPER_PATTERN_TABLE, "
+        << supers.size() << "};\n";
+
+    out << "#elif defined(COW_SUPER_LABELS)\n";
+    for (std::size_t i = 0; i < supers.size(); ++i) out << "    &&do_super_" << i << ",\n";
+    if (supers.empty()) out << "    nullptr\n";
+
+    out << "#elif defined(COW_SUPER_HANDLERS)\n";
+    for (std::size_t i = 0; i < supers.size(); ++i) {
+        out << "do_super_" << i << ": //";
+        for (int op : supers[i].ops) out << " " << op_name(op);
+        out << "\n";
+        for (std::size_t k = 0; k < supers[i].ops.size(); ++k) out << "    " << step_code(supers[i].ops[k], k) << "\n";
+        out << "    ip += " << supers[i].ops.size() << ";\n";
+        out << "    COW_DISPATCH();\n";
+    }
+    out << "#endif\n";
+    return out.str();
+}
+
+int cow_superopt_main(int argc, char* argv[]) {
+    std::size_t count = 16;
+    std::size_t max_length = 3;
+    const char* output = nullptr;
+    std::vector<const char*> corpus;
+    bool bad_args = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg.rfind("--count=", 0) == 0) {
+            count = std::strtoul(argv[i] + std::string("--count=").size(), nullptr, 10);
+        } else if (arg.rfind("--max-length=", 0) == 0) {
+            max_length = std::strtoul(argv[i] + std::string("--max-length=").size(), nullptr, 10);
+            bad_args |= (max_length < 2 || max_length > SuperPattern::MAX_LENGTH);
+        } else if (arg.rfind("-", 0) != 0) {
+            corpus.push_back(argv[i]);
+        } else {
+            bad_args = true;
+        }
+    }
+
+    if (bad_args || output == nullptr) {
+        std::cerr << "Usage: " << argv[0] << " [--count=N] [--max-length=2..4] -o <superinstructions.hpp> <file.cow>..."
+                  << std::endl;
+        return 1;
+    }
+
+    std::map<Ngram, std::uint64_t> ngrams;
+    std::uint64_t total = 0;
+    for (const char* path : corpus) {
+        MappedFile file(path);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return 1;
+        }
+        total += profile_source(file.view(), max_length, ngrams);
+    }
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    out << emit_superinstructions(select_superinstructions(ngrams, count), total);
+    if (!out) {
+        std::cerr << "Error: Could not write file " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#ifndef UNIT_TEST
+int main(int argc, char* argv[]) {
+    return cow_superopt_main(argc, argv);
+}
+#endif
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include "cow_source.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
+// cow_trace - просмотр и сравнение трасс, записанных cow_app --trace.
+//
+//   cow_trace show <trace> [--limit=N]   записи по одной на строку
+//   cow_trace diff <a> <b>               первая запись, где трассы разошлись
+//
+// diff возвращает 0 для одинаковых трасс, 1 при расхождении и 2 при ошибке,
+// так что эталонный прогон на switch удобно сверять с быстрыми движками:
+//
+//   cow_app --engine=switch --trace=ref.cowt prog.cow
+//   cow_app --engine=threaded --trace=fast.cowt prog.cow
+//   cow_trace diff ref.cowt fast.cowt
+
+inline std::string format_record(const TraceRecord& record) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "#%-8u %-8s mem_ptr=%llu cell=%lld", record.ip, op_name(record.op),
+                  static_cast<unsigned long long>(record.mem_ptr), static_cast<long long>(record.cell));
+    return line;
+}
+
+// Проверяет отображенную трассу; при ошибке печатает причину
+inline bool open_trace(const char* path, const MappedFile& file, TraceReader& reader) {
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return false;
+    }
+    if (!reader.load(file.view())) {
+        std::cerr << "Error: " << path << ": " << reader.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int show_trace(const char* path, std::uint64_t limit) {
+    MappedFile file(path);
+    TraceReader reader;
+    if (!open_trace(path, file, reader)) return 2;
+
+    TraceRecord record;
+    while ((limit == 0 || reader.position() < limit) && reader.next(record)) {
+        std::cout << reader.position() - 1 << "\t" << format_record(record) << "\n";
+    }
+    if (!reader.error().empty()) {
+        std::cerr << "Error: " << path << ": " << reader.error() << std::endl;
+        return 2;
+    }
+    return 0;
+}
+
+int diff_trace_files(const char* path_a, const char* path_b) {
+    MappedFile file_a(path_a), file_b(path_b);
+    TraceReader a, b;
+    if (!open_trace(path_a, file_a, a) || !open_trace(path_b, file_b, b)) return 2;
+
+    TraceDiff diff = diff_traces(a, b);
+    if (!diff.error.empty()) {
+        std::cerr << "Error: " << diff.error << std::endl;
+        return 2;
+    }
+    if (diff.same) {
+        std::cout << "traces match: " << a.position() << " records" << std::endl;
+        return 0;
+    }
+
+    std::cout << "traces diverge at record " << diff.index << ":\n";
+    std::uint64_t first = diff.index - diff.context.size();
+    for (std::size_t k = 0; k < diff.context.size(); ++k) {
+        std::cout << "  " << first + k << "\t" << format_record(diff.context[k]) << "\n";
+    }
+    std::cout << "- " << diff.index << "\t" << (diff.a ? format_record(*diff.a) : "<end of trace>") << "\n";
+    std::cout << "+ " << diff.index << "\t" << (diff.b ? format_record(*diff.b) : "<end of trace>") << std::endl;
+    return 1;
+}
+
+int cow_trace_main(int argc, char* argv[]) {
+    std::string command = (argc > 1) ? argv[1] : "";
+    if (command == "show" && (argc == 3 || argc == 4)) {
+        std::uint64_t limit = 0;
+        if (argc == 4) {
+            std::string arg = argv[3];
+            if (arg.rfind("--limit=", 0) != 0) command.clear();
+            limit = std::strtoull(argv[3] + std::string("--limit=").size(), nullptr, 10);
+        }
+        if (!command.empty()) return show_trace(argv[2], limit);
+    } else if (command == "diff" && argc == 4) {
+        return diff_trace_files(argv[2], argv[3]);
+    }
+
+    std::cerr << "Usage: " << argv[0] << " show <trace> [--limit=N]" << std::endl;
+    std::cerr << "       " << argv[0] << " diff <a.cowt> <b.cowt>" << std::endl;
+    return 2;
+}
+
+#ifndef UNIT_TEST
+int main(int argc, char* argv[]) {
+    return cow_trace_main(argc, argv);
+}
+#endif
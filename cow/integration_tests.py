@@ -1,17 +1,166 @@
 import subprocess
 import sys
 import os
+import shutil
+import time
 
 GREEN = '\033[92m'
 RED = '\033[91m'
 RESET = '\033[0m'
 
+def reference_output(exe_path, cow_code, input_data=None):
+    # Эталон - вывод интерпретатора (switch-движок)
+    filename = "temp_reference.cow"
+    with open(filename, "w") as f:
+        f.write(cow_code)
+    try:
+        result = subprocess.run(
+            [exe_path, "--engine=switch", filename],
+            input=input_data,
+            capture_output=True,
+            text=True,
+            timeout=2
+        )
+        return result.stdout
+    finally:
+        os.remove(filename)
+
+def run_batch_test(exe_path, cases, async_io=False):
+    test_name = "batch mode: all examples" + (" (--async)" if async_io else "")
+    workdir = "temp_batch"
+    os.makedirs(workdir, exist_ok=True)
+    try:
+        lines = []
+        expected = []
+        for i, (name, input_data) in enumerate(cases * 4):
+            program = os.path.abspath(f"../cow_examples/{name}")
+            input_file = "-"
+            if input_data is not None:
+                input_file = f"in{i}.txt"
+                with open(os.path.join(workdir, input_file), "w") as f:
+                    f.write(input_data)
+            lines.append(f"{program} {input_file} out{i}.txt")
+            with open(program, 'r') as f:
+                expected.append(reference_output(exe_path, f.read(), input_data))
+
+        manifest = os.path.join(workdir, "manifest.txt")
+        with open(manifest, "w") as f:
+            f.write("\n".join(lines) + "\n")
+
+        args = [exe_path, f"--batch={manifest}", "--jobs=3", "--timeout-ms=2000"]
+        if async_io:
+            args.append("--async")
+        result = subprocess.run(
+            args,
+            capture_output=True,
+            text=True,
+            timeout=10
+        )
+
+        failures = []
+        for i, want in enumerate(expected):
+            with open(os.path.join(workdir, f"out{i}.txt"), 'r') as f:
+                if f.read() != want:
+                    failures.append(i)
+        if result.returncode == 0 and not failures and f"jobs: {len(expected)}, ok: {len(expected)}" in result.stdout:
+            print(f"{GREEN}[PASS]{RESET} {test_name}")
+            return True
+        print(f"{RED}[FAIL]{RESET} {test_name}")
+        print(f"  Exit code: {result.returncode}, mismatched jobs: {failures}")
+        print(f"  Report:    {result.stdout}{result.stderr}")
+        return False
+    except (subprocess.TimeoutExpired, FileNotFoundError) as e:
+        print(f"{RED}[FAIL]{RESET} {test_name} ({e})")
+        return False
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+def run_batch_timeout_test(exe_path, async_io=False):
+    # MoO MOO mOo moo: SCAN влево на ненулевой ячейке 0 не кончается,
+    # и --timeout-ms должен остановить задание так же, как без идиом
+    test_name = "batch mode: timeout stops a stuck scan" + (" (--async)" if async_io else "")
+    workdir = "temp_batch_timeout"
+    os.makedirs(workdir, exist_ok=True)
+    try:
+        program = os.path.join(workdir, "spin.cow")
+        with open(program, "w") as f:
+            f.write("MoO MOO mOo moo")
+        manifest = os.path.join(workdir, "manifest.txt")
+        with open(manifest, "w") as f:
+            f.write(f"{os.path.abspath(program)} - out.txt\n")
+
+        args = [exe_path, f"--batch={manifest}", "--timeout-ms=100"]
+        if async_io:
+            args.append("--async")
+        result = subprocess.run(args, capture_output=True, text=True, timeout=5)
+        if result.returncode != 0 and "jobs: 1, ok: 0, timeout: 1" in result.stdout:
+            print(f"{GREEN}[PASS]{RESET} {test_name}")
+            return True
+        print(f"{RED}[FAIL]{RESET} {test_name}")
+        print(f"  Exit code: {result.returncode}")
+        print(f"  Report:    {result.stdout}{result.stderr}")
+        return False
+    except (subprocess.TimeoutExpired, FileNotFoundError) as e:
+        print(f"{RED}[FAIL]{RESET} {test_name} ({e})")
+        return False
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+def run_checkpoint_test(exe_path):
+    # Процесс эхо-программы убивается, пока ждет ввода, и продолжается со снимка:
+    # выходной файл должен совпасть с вводом без потерь и повторов
+    test_name = "checkpoint: resume after kill"
+    workdir = "temp_checkpoint"
+    os.makedirs(workdir, exist_ok=True)
+    program = os.path.join(workdir, "echo.cow")
+    snapshot = os.path.join(workdir, "echo.snap")
+    output = os.path.join(workdir, "out.txt")
+    text = "".join(f"line {i}\n" for i in range(200))
+    try:
+        with open(program, "w") as f:
+            f.write("MoO MOO OOO Moo Moo moo")
+        args = [exe_path, f"--checkpoint={snapshot}", "--checkpoint-every=50", "--resume", program]
+
+        with open(output, "w") as out:
+            proc = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=out)
+            proc.stdin.write(text[:700].encode())
+            proc.stdin.flush()
+            for _ in range(200):
+                if os.path.exists(snapshot):
+                    break
+                time.sleep(0.01)
+            time.sleep(0.1)
+            proc.kill()
+            proc.wait()
+
+        if not os.path.exists(snapshot):
+            print(f"{RED}[FAIL]{RESET} {test_name} (no snapshot written)")
+            return False
+
+        with open(output, "a") as out:
+            result = subprocess.run(args, input=text.encode(), stdout=out, stderr=subprocess.PIPE, timeout=10)
+        with open(output, "r") as f:
+            got = f.read()
+        if result.returncode == 0 and got == text and not os.path.exists(snapshot):
+            print(f"{GREEN}[PASS]{RESET} {test_name}")
+            return True
+        print(f"{RED}[FAIL]{RESET} {test_name}")
+        print(f"  Exit code: {result.returncode}, stderr: {result.stderr.decode()}")
+        print(f"  Output matches: {got == text} ({len(got)} of {len(text)} bytes)")
+        return False
+    except (subprocess.TimeoutExpired, FileNotFoundError) as e:
+        print(f"{RED}[FAIL]{RESET} {test_name} ({e})")
+        return False
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
 def run_test(
         exe_path,
         test_name,
         cow_code,
         expected_output,
-        input_data=None
+        input_data=None,
+        args=()
 ):
     filename = "temp_test.cow"
 
@@ -20,7 +169,7 @@ def run_test(
 
     try:
         result = subprocess.run(
-            [exe_path, filename],
+            [exe_path, *args, filename],
             input=input_data,
             capture_output=True,
             text=True,
@@ -49,12 +198,39 @@ def run_test(
         if os.path.exists(filename):
             os.remove(filename)
 
+def run_native_test(cow2c_path, test_name, cow_file, expected_output, input_data=None):
+    # Кавычка и пробел в пути: cow2c не должен передавать его через оболочку
+    binary = os.path.abspath("temp native'")
+    try:
+        build = subprocess.run([cow2c_path, "--build", "-o", binary, cow_file], capture_output=True, text=True, timeout=60)
+        if build.returncode != 0:
+            print(f"{RED}[FAIL]{RESET} {test_name} (build failed)")
+            print(f"  {build.stderr}")
+            return False
+
+        result = subprocess.run([binary], input=input_data, capture_output=True, text=True, timeout=2)
+        if result.stdout == expected_output:
+            print(f"{GREEN}[PASS]{RESET} {test_name}")
+            return True
+        print(f"{RED}[FAIL]{RESET} {test_name}")
+        print(f"  Expected: '{expected_output}'")
+        print(f"  Got:      '{result.stdout}'")
+        return False
+    except subprocess.TimeoutExpired:
+        print(f"{RED}[FAIL]{RESET} {test_name} (Timed out - infinite loop?)")
+        return False
+    finally:
+        for path in (binary, binary + ".c"):
+            if os.path.exists(path):
+                os.remove(path)
+
 if __name__ == "__main__":
     if len(sys.argv) < 2:
-        print("Usage: python3 integration_tests.py <path_to_cow_executable>")
+        print("Usage: python3 integration_tests.py <path_to_cow_executable> [<path_to_cow2c>]")
         sys.exit(1)
 
     exe_path = sys.argv[1]
+    cow2c_path = sys.argv[2] if len(sys.argv) > 2 else None
     all_passed = True
 
     print("--- Starting Integration Tests ---")
@@ -122,6 +298,65 @@ if __name__ == "__main__":
     if not run_test(exe_path, f"99 bottles of beer", file, output_file):
         all_passed = False
 
+    # Тест 9: JIT против эталонного интерпретатора
+    # На всех примерах вывод --engine=jit должен совпасть с выводом --engine=switch
+    jit_cases = [
+        ("hello.cow", None),
+        ("fib.cow", None),
+        ("99.cow", None),
+        ("add.cow", "7 35"),
+    ]
+    for name, input_data in jit_cases:
+        with open(f"../cow_examples/{name}", 'r') as f:
+            file = f.read()
+        expected = reference_output(exe_path, file, input_data)
+        if not run_test(exe_path, f"JIT vs interpreter: {name}", file, expected, input_data=input_data, args=("--engine=jit",)):
+            all_passed = False
+
+    # Тест 10: нативные бинарники cow2c против эталонного интерпретатора
+    # cow2c --build транслирует программу в C и собирает ее системным компилятором
+    if cow2c_path:
+        for name, input_data in jit_cases:
+            with open(f"../cow_examples/{name}", 'r') as f:
+                file = f.read()
+            expected = reference_output(exe_path, file, input_data)
+            if not run_native_test(cow2c_path, f"cow2c vs interpreter: {name}", f"../cow_examples/{name}", expected, input_data):
+                all_passed = False
+        # Программы не из cow_examples: цикл переноса, заходящий левее входной
+        # ячейки у левого края ленты, и числа на границах и за пределами int
+        inline_cases = [
+            ("left edge", "moO MOo MOo mOo MOo MOO mOo MOo moO MoO moo mOo OOM", None),
+            ("out-of-range int", "oom OOM oom OOM oom OOM oom OOM oom OOM",
+             "99999999999 x\n2147483648\n-2147483648\n0002147483647\n-2147483649\n"),
+        ]
+        for name, code, input_data in inline_cases:
+            cow_file = "temp_native.cow"
+            with open(cow_file, "w") as f:
+                f.write(code)
+            try:
+                expected = reference_output(exe_path, code, input_data)
+                if not run_native_test(cow2c_path, f"cow2c vs interpreter: {name}", cow_file, expected, input_data):
+                    all_passed = False
+            finally:
+                os.remove(cow_file)
+
+    # Тест 11: пакетный режим
+    # Все примеры одним процессом на нескольких потоках, выводы сверяются с эталоном
+    if not run_batch_test(exe_path, jit_cases):
+        all_passed = False
+    # То же через сессии с асинхронным вводом
+    if not run_batch_test(exe_path, jit_cases, async_io=True):
+        all_passed = False
+    # Тайм-аут задания в пакетном режиме
+    if not run_batch_timeout_test(exe_path):
+        all_passed = False
+    if not run_batch_timeout_test(exe_path, async_io=True):
+        all_passed = False
+
+    # Тест 12: снимки состояния
+    if not run_checkpoint_test(exe_path):
+        all_passed = False
+
     if all_passed:
         print(f"\n{GREEN}All integration tests passed!{RESET}")
         sys.exit(0)
@@ -0,0 +1,330 @@
+#pragma once
+
+// JIT-компилятор IR в машинный код x86-64 (System V ABI).
+//
+// Регистры внутри сгенерированной функции:
+//   rbx - начало ленты (state.memory.data())
+//   r12 - mem_ptr (индекс текущей ячейки)
+//   r13 - JitContext*
+//   r14 - текущий размер ленты
+// Операции с вводом/выводом, mOO и регистром уходят в exec_single_op через
+// функции-помощники; после каждого вызова rbx/r12/r14 перечитываются из контекста,
+// так как лента могла переехать.
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "vm.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define COW_HAS_JIT 1
+#endif
+
+#ifdef COW_HAS_JIT
+
+#include <sys/mman.h>
+
+// Состояние, которое машинный код читает и пишет напрямую
+struct JitContext {
+    int* cells;
+    std::size_t size;
+    std::size_t ptr;
+    VMState* state;
+};
+
+inline void jit_refresh(JitContext* ctx) {
+    ctx->cells = ctx->state->memory.data();
+    ctx->size = ctx->state->memory.size();
+    ctx->ptr = ctx->state->mem_ptr;
+}
+
+// Помощники, которые вызывает сгенерированный код: (контекст, аргумент)
+inline void jit_exec_single(JitContext* ctx, std::size_t op) {
+    ctx->state->mem_ptr = ctx->ptr;
+    exec_single_op(static_cast<int>(op), *ctx->state);
+    jit_refresh(ctx);
+}
+
+inline void jit_ensure_cell(JitContext* ctx, std::size_t index) {
+    ctx->state->mem_ptr = ctx->ptr;
+    ensure_cell(index, *ctx->state);
+    jit_refresh(ctx);
+}
+
+class X86Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    void byte(uint8_t b) { code.push_back(b); }
+
+    void bytes(std::initializer_list<uint8_t> list) {
+        code.insert(code.end(), list.begin(), list.end());
+    }
+
+    void imm32(int32_t value) {
+        uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+
+    void imm64(uint64_t value) {
+        uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        code.insert(code.end(), raw, raw + 8);
+    }
+
+    std::size_t pos() const { return code.size(); }
+
+    // Условный переход с 32-битным смещением; возвращает место для patch()
+    std::size_t jcc(uint8_t cc) {
+        bytes({0x0F, cc});
+        imm32(0);
+        return pos() - 4;
+    }
+
+    std::size_t jmp() {
+        byte(0xE9);
+        imm32(0);
+        return pos() - 4;
+    }
+
+    // Направляет переход, записанный по адресу at, на позицию target
+    void patch(std::size_t at, std::size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+};
+
+// Коды условий для jcc
+constexpr uint8_t JIT_JB  = 0x82;
+constexpr uint8_t JIT_JE  = 0x84;
+constexpr uint8_t JIT_JNE = 0x85;
+
+class JitCompiler {
+public:
+    using EntryFn = void (*)(JitContext*);
+
+    // tape_fits: лента заранее выделена под всю программу (analyze_tape),
+    // сдвиги вправо и ADD_MUL пишутся без сравнения с r14
+    explicit JitCompiler(bool tape_fits = false) : tape_fits_(tape_fits) {}
+
+    std::vector<uint8_t> compile(std::span<const Instr> instructions) {
+        // Для каждой открывающей скобки - места ее прыжка вперед и начала тела
+        std::vector<std::size_t> forward_patch(instructions.size(), 0);
+        std::vector<std::size_t> body_start(instructions.size(), 0);
+        // Для MOO, на который прыгает GUARD, - место этого прыжка
+        std::vector<std::size_t> guard_patch(instructions.size(), 0);
+
+        emit_prologue();
+
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            const Instr& instr = instructions[i];
+            switch (instr.op) {
+                case OP_ADD:
+                    // add dword [rbx + r12*4], imm32
+                    e.bytes({0x42, 0x81, 0x04, 0xA3});
+                    e.imm32(instr.arg);
+                    break;
+                case OP_SET:
+                    set_cell(instr.arg);
+                    break;
+                case OP_ZERO:
+                    set_cell(0);
+                    break;
+                case OP_SHIFT:
+                    emit_shift(instr.arg);
+                    break;
+                case OP_ADD_MUL:
+                    emit_add_mul(instr.arg, instr.arg2);
+                    break;
+                case OP_SCAN: {
+                    std::size_t top = e.pos();
+                    cmp_cell_zero();
+                    std::size_t done = e.jcc(JIT_JE);
+                    emit_shift(instr.arg);
+                    e.patch(e.jmp(), top);
+                    e.patch(done, e.pos());
+                    break;
+                }
+                case OP_GUARD:
+                    e.bytes({0x49, 0x81, 0xFC});    // cmp r12, imm32
+                    e.imm32(instr.arg);
+                    guard_patch[i + static_cast<std::size_t>(instr.arg2)] = e.jcc(JIT_JB);
+                    break;
+                case OP_LOOP_START:
+                    if (guard_patch[i] != 0) e.patch(guard_patch[i], e.pos());
+                    if (instr.arg == 0) break; // непарная скобка - ничего не делает
+                    cmp_cell_zero();
+                    forward_patch[i] = e.jcc(JIT_JE);
+                    body_start[i] = e.pos();
+                    break;
+                case OP_LOOP_END: {
+                    if (instr.arg == 0) break;
+                    std::size_t start = jump_target(instr, i);
+                    cmp_cell_zero();
+                    e.patch(e.jcc(JIT_JNE), body_start[start]);
+                    e.patch(forward_patch[start], e.pos());
+                    break;
+                }
+                default:
+                    call_helper(reinterpret_cast<const void*>(&jit_exec_single), static_cast<uint32_t>(instr.op));
+                    break;
+            }
+        }
+
+        emit_epilogue();
+        return std::move(e.code);
+    }
+
+private:
+    X86Emitter e;
+    bool tape_fits_;
+
+    static constexpr uint8_t CELLS_OFF = offsetof(JitContext, cells);
+    static constexpr uint8_t SIZE_OFF = offsetof(JitContext, size);
+    static constexpr uint8_t PTR_OFF = offsetof(JitContext, ptr);
+
+    void load_context() {
+        e.bytes({0x49, 0x8B, 0x5D, CELLS_OFF}); // mov rbx, [r13 + cells]
+        e.bytes({0x4D, 0x8B, 0x75, SIZE_OFF});  // mov r14, [r13 + size]
+        e.bytes({0x4D, 0x8B, 0x65, PTR_OFF});   // mov r12, [r13 + ptr]
+    }
+
+    void store_ptr() {
+        e.bytes({0x4D, 0x89, 0x65, PTR_OFF});   // mov [r13 + ptr], r12
+    }
+
+    void emit_prologue() {
+        // Пять push выравнивают стек на 16 для вызовов помощников
+        e.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+        e.bytes({0x49, 0x89, 0xFD});            // mov r13, rdi
+        load_context();
+    }
+
+    void emit_epilogue() {
+        store_ptr();
+        e.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+    }
+
+    // Вызов помощника fn(ctx, rsi); аргумент уже лежит в rsi, если load_arg == false
+    void call_helper(const void* fn, uint32_t arg, bool load_arg = true) {
+        store_ptr();
+        e.bytes({0x4C, 0x89, 0xEF});            // mov rdi, r13
+        if (load_arg) {
+            e.byte(0xBE);                       // mov esi, imm32
+            e.imm32(static_cast<int32_t>(arg));
+        }
+        e.bytes({0x48, 0xB8});                  // mov rax, imm64
+        e.imm64(reinterpret_cast<uint64_t>(fn));
+        e.bytes({0xFF, 0xD0});                  // call rax
+        load_context();
+    }
+
+    void cmp_cell_zero() {
+        e.bytes({0x42, 0x83, 0x3C, 0xA3, 0x00}); // cmp dword [rbx + r12*4], 0
+    }
+
+    void set_cell(int value) {
+        e.bytes({0x42, 0xC7, 0x04, 0xA3});      // mov dword [rbx + r12*4], imm32
+        e.imm32(value);
+    }
+
+    void emit_shift(int shift) {
+        if (shift < 0) {
+            e.bytes({0x49, 0x81, 0xEC});        // sub r12, imm32
+            e.imm32(-shift);
+            e.bytes({0x73, 0x03});              // jae +3 (не было заема)
+            e.bytes({0x45, 0x31, 0xE4});        // xor r12d, r12d - упираемся в нулевую ячейку
+            return;
+        }
+        e.bytes({0x49, 0x81, 0xC4});            // add r12, imm32
+        e.imm32(shift);
+        if (tape_fits_) return;
+        e.bytes({0x4D, 0x39, 0xF4});            // cmp r12, r14
+        std::size_t fits = e.jcc(JIT_JB);
+        e.bytes({0x4C, 0x89, 0xE6});            // mov rsi, r12
+        call_helper(reinterpret_cast<const void*>(&jit_ensure_cell), 0, false);
+        e.patch(fits, e.pos());
+    }
+
+    void target_to_rcx(int offset) {
+        e.bytes({0x49, 0x8D, 0x8C, 0x24});      // lea rcx, [r12 + imm32]
+        e.imm32(offset);
+    }
+
+    // offset < 0 бывает только за GUARD, поэтому граница проверяется лишь справа
+    void emit_add_mul(int offset, int factor) {
+        cmp_cell_zero();
+        std::size_t skip = e.jcc(JIT_JE);
+
+        target_to_rcx(offset);
+        if (!tape_fits_ && offset > 0) {
+            e.bytes({0x4C, 0x39, 0xF1});        // cmp rcx, r14
+            std::size_t fits = e.jcc(JIT_JB);
+            e.bytes({0x48, 0x89, 0xCE});        // mov rsi, rcx
+            call_helper(reinterpret_cast<const void*>(&jit_ensure_cell), 0, false);
+            target_to_rcx(offset);              // rcx не сохраняется через вызов
+            e.patch(fits, e.pos());
+        }
+
+        e.bytes({0x42, 0x8B, 0x04, 0xA3});      // mov eax, [rbx + r12*4]
+        e.bytes({0x69, 0xC0});                  // imul eax, eax, imm32
+        e.imm32(factor);
+        e.bytes({0x01, 0x04, 0x8B});            // add [rbx + rcx*4], eax
+
+        e.patch(skip, e.pos());
+    }
+};
+
+// Исполняемый буфер с машинным кодом; освобождается в деструкторе
+class JitCode {
+public:
+    explicit JitCode(const std::vector<uint8_t>& bytes) : size_(bytes.size()) {
+        void* mem = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return;
+        std::memcpy(mem, bytes.data(), size_);
+        // W^X: после записи буфер только исполняемый
+        if (mprotect(mem, size_, PROT_READ | PROT_EXEC) != 0) {
+            munmap(mem, size_);
+            return;
+        }
+        mem_ = mem;
+    }
+
+    ~JitCode() {
+        if (mem_ != nullptr) munmap(mem_, size_);
+    }
+
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    bool ok() const { return mem_ != nullptr; }
+
+    void operator()(JitContext* ctx) const {
+        reinterpret_cast<JitCompiler::EntryFn>(mem_)(ctx);
+    }
+
+private:
+    void* mem_ = nullptr;
+    std::size_t size_;
+};
+
+// Компилирует и исполняет программу. false - если не удалось выделить
+// исполняемую память, тогда вызывающий должен откатиться на интерпретатор.
+// tape_fits - state.memory уже не меньше TapeBounds::tape_size() программы.
+inline bool run_jit(std::span<const Instr> instructions, VMState& state, bool tape_fits = false) {
+    JitCode code(JitCompiler(tape_fits).compile(instructions));
+    if (!code.ok()) return false;
+
+    JitContext ctx{};
+    ctx.state = &state;
+    jit_refresh(&ctx);
+    code(&ctx);
+    state.mem_ptr = ctx.ptr;
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+
+// Профилировщик исполнения (--profile).
+//
+// Profiler подставляется в run_slice вместо NoHooks и считает исполнения
+// каждой инструкции IR, обратные переходы каждого цикла и то, во что
+// разрешается mOO. Без --profile эта инстанциация не используется, и в
+// обычных движках нет ни одного лишнего счетчика.
+//
+// Отчет переводит индексы IR в смещения исходника (карта из compile_source),
+// так что горячие места ищутся прямо в .cow-файле.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "vm.hpp"
+
+inline const char* op_name(int op) {
+    static const char* const names[] = {
+        "moo", "mOo", "moO", "mOO", "Moo", "MOo", "MoO", "MOO", "OOO", "MMM", "OOM", "oom",
+        "ADD", "SHIFT", "SET", "ADD_MUL", "SCAN", "GUARD"
+    };
+    return (op >= 0 && op <= OP_GUARD) ? names[op] : "invalid";
+}
+
+class Profiler {
+public:
+    explicit Profiler(std::size_t program_size)
+        : counts_(program_size, 0), back_edges_(program_size, 0), exec_targets_(OP_READ_INT + 2, 0) {}
+
+    template <typename State>
+    void on_instr(std::size_t ip, State&) { ++counts_[ip]; }
+    void on_back_edge(std::size_t ip) { ++back_edges_[ip]; }
+
+    template <typename State>
+    void on_exec_cell(State& state) {
+        auto cell = state.memory[state.mem_ptr];
+        // Индекс 0 - значение, не являющееся кодом команды
+        std::size_t slot = (cell >= 0 && cell <= OP_READ_INT) ? static_cast<std::size_t>(cell) + 1 : 0;
+        ++exec_targets_[slot];
+    }
+
+    const std::vector<std::uint64_t>& counts() const { return counts_; }
+    // По индексу moo: сколько раз цикл прыгнул назад
+    const std::vector<std::uint64_t>& back_edges() const { return back_edges_; }
+    // [0] - некорректные значения, [op + 1] - mOO, исполнившие op
+    const std::vector<std::uint64_t>& exec_targets() const { return exec_targets_; }
+
+private:
+    std::vector<std::uint64_t> counts_;
+    std::vector<std::uint64_t> back_edges_;
+    std::vector<std::uint64_t> exec_targets_;
+};
+
+// "строка:столбец" для смещения; без исходника - просто смещение
+inline std::string source_position(std::string_view source, std::size_t offset) {
+    if (source.empty() || offset >= source.size()) return "@" + std::to_string(offset);
+    std::size_t line = 1 + static_cast<std::size_t>(std::count(source.begin(), source.begin() + offset, '\n'));
+    std::size_t line_start = source.rfind('\n', offset);
+    std::size_t column = (line_start == std::string_view::npos) ? offset + 1 : offset - line_start;
+    return std::to_string(line) + ":" + std::to_string(column) + " @" + std::to_string(offset);
+}
+
+// Откуда взялась каждая инструкция IR: смещение её первой команды в source.
+// Для программ без исходника (execute() по вектору команд) смещения - номера команд.
+struct SourceMap {
+    std::vector<std::size_t> offsets;
+    std::string_view source;
+};
+
+// map == nullptr (например, байткод) - в отчете индексы IR
+inline void print_profile(std::ostream& out, const Profiler& profiler, std::span<const Instr> program,
+                          const SourceMap* map, std::size_t top = 20) {
+    auto where = [&](std::size_t ip) {
+        return map == nullptr ? "#" + std::to_string(ip) : source_position(map->source, map->offsets[ip]);
+    };
+
+    const std::vector<std::uint64_t>& counts = profiler.counts();
+    std::uint64_t total = 0;
+    for (std::uint64_t c : counts) total += c;
+    out << "=== profile: " << total << " IR instructions executed ===\n";
+
+    std::vector<std::size_t> hot;
+    for (std::size_t ip = 0; ip < counts.size(); ++ip) {
+        if (counts[ip] > 0) hot.push_back(ip);
+    }
+    std::stable_sort(hot.begin(), hot.end(), [&](std::size_t a, std::size_t b) { return counts[a] > counts[b]; });
+    if (hot.size() > top) hot.resize(top);
+
+    char line[160];
+    out << "\nHot instructions:\n";
+    out << "         count      %  instr       source\n";
+    for (std::size_t ip : hot) {
+        std::snprintf(line, sizeof(line), "%14llu %6.2f  %-10s  %s\n",
+                      static_cast<unsigned long long>(counts[ip]),
+                      total ? 100.0 * static_cast<double>(counts[ip]) / static_cast<double>(total) : 0.0,
+                      op_name(program[ip].op), where(ip).c_str());
+        out << line;
+    }
+
+    // Цикл - пара MOO/moo; в run_slice moo прыгает на MOO, поэтому
+    // входов в цикл = исполнений MOO - обратных переходов
+    const std::vector<std::uint64_t>& back_edges = profiler.back_edges();
+    std::vector<std::pair<std::size_t, std::size_t>> loops;
+    for (std::size_t ip = 0; ip < program.size(); ++ip) {
+        if (program[ip].op == OP_LOOP_START && program[ip].arg != 0 && counts[ip] > 0) {
+            loops.emplace_back(ip, jump_target(program[ip], ip));
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(),
+                     [&](const auto& a, const auto& b) { return back_edges[a.second] > back_edges[b.second]; });
+    if (loops.size() > top) loops.resize(top);
+
+    if (!loops.empty()) {
+        out << "\nHot loops:\n";
+        out << "    back jumps        entries  MOO -> moo\n";
+        for (const auto& [start, end] : loops) {
+            std::snprintf(line, sizeof(line), "%14llu %14llu  %s -> %s\n",
+                          static_cast<unsigned long long>(back_edges[end]),
+                          static_cast<unsigned long long>(counts[start] - back_edges[end]),
+                          where(start).c_str(), where(end).c_str());
+            out << line;
+        }
+    }
+
+    const std::vector<std::uint64_t>& targets = profiler.exec_targets();
+    std::uint64_t exec_total = 0;
+    for (std::uint64_t c : targets) exec_total += c;
+    if (exec_total > 0) {
+        out << "\nmOO: " << exec_total << " indirect executions\n";
+        for (int op = OP_LOOP_END; op <= OP_READ_INT; ++op) {
+            if (targets[op + 1] > 0) out << "  -> " << op_name(op) << ": " << targets[op + 1] << "\n";
+        }
+        if (targets[0] > 0) out << "  -> invalid: " << targets[0] << "\n";
+    }
+    out.flush();
+}
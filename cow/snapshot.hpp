@@ -0,0 +1,208 @@
+#pragma once
+
+// Снимок состояния машины для продолжения долгих прогонов после сбоя.
+//
+//   SnapshotHeader              88 байт
+//   runs[run_count]             uint64_t start, uint64_t length, int32_t cells[length]
+//
+// Лента хранится разреженно: только серии ненулевых ячеек (короткие нулевые
+// промежутки внутри серии дешевле заголовка новой серии). Кроме ленты снимок
+// хранит mem_ptr, регистр, место в программе и позиции ввода/вывода, а также
+// хэш IR, чтобы не продолжить снимок чужой программой. Формат, как и у
+// байткода, платформенный.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vm.hpp"
+#include "bytecode.hpp"
+
+constexpr char SNAPSHOT_MAGIC[8] = {'\x7F', 'C', 'O', 'W', 'S', 'N', '\r', '\n'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+// Нулевых ячеек подряд, которые еще выгоднее записать внутри серии
+constexpr std::size_t SNAPSHOT_MAX_GAP = 4;
+
+enum SnapshotFlags : uint32_t {
+    SNAP_HAS_REGISTER = 1u << 0
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t program_hash;
+    uint64_t instr_ptr;
+    uint64_t executed;
+    uint64_t mem_ptr;
+    int64_t reg_val;
+    uint64_t input_offset;
+    uint64_t output_offset;
+    uint64_t tape_size;
+    uint64_t run_count;
+};
+
+static_assert(sizeof(SnapshotHeader) == 88, "SnapshotHeader layout is part of the file format");
+
+// Где стояла машина в момент снимка
+struct SnapshotPosition {
+    std::uint64_t instr_ptr = 0;
+    std::uint64_t executed = 0;
+    std::uint64_t input_offset = 0;
+    std::uint64_t output_offset = 0;
+};
+
+inline std::string serialize_snapshot(std::span<const Instr> program, const VMState& state,
+                                      const SnapshotPosition& position) {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.flags = state.reg_val.has_value() ? static_cast<uint32_t>(SNAP_HAS_REGISTER) : 0u;
+    header.program_hash = hash_program(program);
+    header.instr_ptr = position.instr_ptr;
+    header.executed = position.executed;
+    header.mem_ptr = state.mem_ptr;
+    header.reg_val = state.reg_val.value_or(0);
+    header.input_offset = position.input_offset;
+    header.output_offset = position.output_offset;
+    header.tape_size = state.memory.size();
+
+    std::string runs;
+    const std::vector<int>& tape = state.memory;
+    std::size_t i = 0;
+    while (i < tape.size()) {
+        if (tape[i] == 0) {
+            ++i;
+            continue;
+        }
+        // Серия заканчивается на последней ненулевой ячейке перед промежутком длиннее SNAPSHOT_MAX_GAP
+        std::size_t start = i;
+        std::size_t end = i + 1;
+        for (std::size_t j = end; j < tape.size() && j - end <= SNAPSHOT_MAX_GAP; ++j) {
+            if (tape[j] != 0) end = j + 1;
+        }
+        uint64_t fields[2] = { start, end - start };
+        runs.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+        runs.append(reinterpret_cast<const char*>(tape.data() + start), (end - start) * sizeof(int));
+        ++header.run_count;
+        i = end;
+    }
+
+    std::string out;
+    out.reserve(sizeof(header) + runs.size());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out += runs;
+    return out;
+}
+
+// Как write_bytecode_file, но с fsync: снимок должен пережить падение машины,
+// а прежний снимок остается целым, пока новый не записан полностью
+inline bool write_snapshot_file(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    const char* p = data.data();
+    std::size_t left = data.size();
+    bool ok = true;
+    while (ok && left > 0) {
+        ssize_t put = ::write(fd, p, left);
+        if (put < 0 && errno == EINTR) continue;
+        ok = put > 0;
+        if (ok) {
+            p += put;
+            left -= static_cast<std::size_t>(put);
+        }
+    }
+    ok = ok && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Проверенный вид на снимок в памяти; данные принадлежат вызывающему
+class SnapshotView {
+public:
+    // false - файл поврежден или от другой версии; причина в error()
+    bool load(std::string_view data) {
+        if (data.size() < sizeof(SnapshotHeader) ||
+            std::memcmp(data.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            return fail("not a COW snapshot");
+        }
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (header_.version != SNAPSHOT_VERSION) return fail("unsupported snapshot version");
+        if (header_.mem_ptr >= header_.tape_size) return fail("corrupt snapshot: pointer outside the tape");
+
+        // Серии должны идти по возрастанию, не пересекаться и лежать внутри ленты
+        runs_ = data.substr(sizeof(SnapshotHeader));
+        std::size_t pos = 0;
+        uint64_t next_free = 0;
+        for (uint64_t r = 0; r < header_.run_count; ++r) {
+            uint64_t fields[2];
+            if (runs_.size() - pos < sizeof(fields)) return fail("truncated snapshot");
+            std::memcpy(fields, runs_.data() + pos, sizeof(fields));
+            pos += sizeof(fields);
+            if (fields[0] < next_free || fields[1] > header_.tape_size - fields[0]) {
+                return fail("corrupt snapshot: tape run outside the tape");
+            }
+            if ((runs_.size() - pos) / sizeof(int) < fields[1]) return fail("truncated snapshot");
+            pos += fields[1] * sizeof(int);
+            next_free = fields[0] + fields[1];
+        }
+        if (pos != runs_.size()) return fail("trailing data in snapshot");
+        used_size_ = std::max<uint64_t>(next_free, header_.mem_ptr + 1);
+        return true;
+    }
+
+    const SnapshotHeader& header() const { return header_; }
+    const std::string& error() const { return error_; }
+
+    SnapshotPosition position() const {
+        return { header_.instr_ptr, header_.executed, header_.input_offset, header_.output_offset };
+    }
+
+    // Проверяет, что снимок сделан с этой программы
+    bool matches(std::span<const Instr> program) const {
+        return header_.program_hash == hash_program(program) && header_.instr_ptr <= program.size();
+    }
+
+    // Восстанавливает ленту, указатель и регистр. Нули за последней серией
+    // не выделяются: лента дорастет до них, как и при обычном исполнении.
+    void restore(VMState& state) const {
+        state.memory.assign(std::max<std::size_t>(used_size_, INITIAL_TAPE_SIZE), 0);
+        std::size_t pos = 0;
+        for (uint64_t r = 0; r < header_.run_count; ++r) {
+            uint64_t fields[2];
+            std::memcpy(fields, runs_.data() + pos, sizeof(fields));
+            pos += sizeof(fields);
+            std::memcpy(state.memory.data() + fields[0], runs_.data() + pos, fields[1] * sizeof(int));
+            pos += fields[1] * sizeof(int);
+        }
+        state.mem_ptr = header_.mem_ptr;
+        state.reg_val = (header_.flags & SNAP_HAS_REGISTER) ? std::optional<int>(static_cast<int>(header_.reg_val))
+                                                           : std::nullopt;
+    }
+
+private:
+    SnapshotHeader header_{};
+    std::string_view runs_;
+    uint64_t used_size_ = 0;
+    std::string error_;
+
+    bool fail(const char* reason) {
+        error_ = reason;
+        return false;
+    }
+};
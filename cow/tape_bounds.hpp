@@ -0,0 +1,149 @@
+#pragma once
+
+// Статический анализ ленты: абстрактная интерпретация IR по интервалу mem_ptr.
+//
+// Цикл сбалансирован, если каждый проход тела возвращает указатель туда же,
+// откуда начал: сдвиги в сумме дают ноль, вложенные циклы сбалансированы, нет
+// mOO (ячейка может оказаться moO/mOo) и SCAN. Для такого цикла известны
+// крайние ячейки тела относительно ячейки входа, и число проходов не важно.
+//
+// Если указатель проходит только через сбалансированные циклы, самая дальняя
+// ячейка программы известна до запуска: ленту можно выделить сразу, а сдвиги
+// вправо исполнять без проверок границ (FixedTape, run_jit с tape_fits).
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "vm.hpp"
+
+// Ячеек больше этого ленту заранее не выделяем: дешевле проверять границы
+constexpr std::size_t MAX_STATIC_TAPE = std::size_t{1} << 22;
+
+struct LoopBalance {
+    bool balanced = false;
+    // Крайние положения указателя и самая правая затронутая ячейка тела
+    // относительно ячейки входа в цикл
+    long long min_offset = 0;
+    long long max_offset = 0;
+};
+
+struct TapeBounds {
+    // true - программа не выходит за ячейку max_cell при любом вводе
+    bool bounded = false;
+    std::size_t max_cell = 0;
+    // По индексу MOO; для остальных инструкций не заполняется
+    std::vector<LoopBalance> loops;
+
+    std::size_t tape_size() const { return max_cell + 1; }
+};
+
+namespace tape_analysis {
+
+// Сводка тела цикла [start + 1, end). Вложенные циклы уже посчитаны: они
+// закрываются раньше внешнего.
+inline LoopBalance summarize_loop(std::span<const Instr> program, const std::vector<LoopBalance>& loops,
+                                  std::size_t start, std::size_t end) {
+    LoopBalance result;
+    long long offset = 0;
+    for (std::size_t i = start + 1; i < end; ++i) {
+        const Instr& instr = program[i];
+        switch (instr.op) {
+            case OP_MOVE_LEFT:  --offset; break;
+            case OP_MOVE_RIGHT: ++offset; break;
+            case OP_SHIFT:      offset += instr.arg; break;
+            case OP_ADD_MUL:
+                result.min_offset = std::min(result.min_offset, offset + instr.arg);
+                result.max_offset = std::max(result.max_offset, offset + instr.arg);
+                break;
+            case OP_EXEC_CELL:
+            case OP_SCAN:
+                return {};
+            case OP_LOOP_START: {
+                if (instr.arg == 0) break;
+                const LoopBalance& inner = loops[i];
+                if (!inner.balanced) return {};
+                result.min_offset = std::min(result.min_offset, offset + inner.min_offset);
+                result.max_offset = std::max(result.max_offset, offset + inner.max_offset);
+                i = jump_target(instr, i);
+                break;
+            }
+            default:
+                break;
+        }
+        result.min_offset = std::min(result.min_offset, offset);
+        result.max_offset = std::max(result.max_offset, offset);
+    }
+    result.balanced = (offset == 0);
+    return result;
+}
+
+// Интервал [lo, hi] возможных значений mem_ptr; сдвиг влево упирается в ноль
+inline void shift_interval(std::size_t& lo, std::size_t& hi, long long shift) {
+    if (shift >= 0) {
+        lo += static_cast<std::size_t>(shift);
+        hi += static_cast<std::size_t>(shift);
+        return;
+    }
+    std::size_t back = static_cast<std::size_t>(-shift);
+    lo = (lo > back) ? lo - back : 0;
+    hi = (hi > back) ? hi - back : 0;
+}
+
+} // namespace tape_analysis
+
+// Анализ связанной программы, исполняемой с начала на обнуленной ленте (mem_ptr == 0)
+inline TapeBounds analyze_tape(std::span<const Instr> program) {
+    using namespace tape_analysis;
+
+    TapeBounds bounds;
+    bounds.loops.resize(program.size());
+    for (std::size_t i = next_loop_op(program, 0); i < program.size(); i = next_loop_op(program, i + 1)) {
+        std::size_t start = jump_target(program[i], i);
+        if (program[i].op == OP_LOOP_END && start != NO_JUMP) {
+            bounds.loops[start] = summarize_loop(program, bounds.loops, start, i);
+        }
+    }
+
+    std::size_t lo = 0;
+    std::size_t hi = 0;
+    std::size_t max_cell = 0;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        const Instr& instr = program[i];
+        switch (instr.op) {
+            case OP_MOVE_LEFT:  shift_interval(lo, hi, -1); break;
+            case OP_MOVE_RIGHT: shift_interval(lo, hi, 1); break;
+            case OP_SHIFT:      shift_interval(lo, hi, instr.arg); break;
+            case OP_EXEC_CELL:
+                // Ячейка может исполнить mOo, moO или команду без сдвига
+                lo = (lo > 0) ? lo - 1 : 0;
+                hi += 1;
+                break;
+            case OP_ADD_MUL:
+                if (instr.arg > 0) max_cell = std::max(max_cell, hi + static_cast<std::size_t>(instr.arg));
+                break;
+            case OP_SCAN:
+                if (instr.arg > 0) return bounds;
+                lo = 0;
+                break;
+            case OP_LOOP_START: {
+                if (instr.arg == 0) break;
+                const LoopBalance& loop = bounds.loops[i];
+                // Упор в нулевую ячейку внутри тела нарушил бы баланс
+                if (!loop.balanced || static_cast<long long>(lo) + loop.min_offset < 0) return bounds;
+                max_cell = std::max(max_cell, hi + static_cast<std::size_t>(loop.max_offset));
+                i = jump_target(instr, i);
+                break;
+            }
+            default:
+                break;
+        }
+        max_cell = std::max(max_cell, hi);
+        if (max_cell >= MAX_STATIC_TAPE) return bounds;
+    }
+
+    bounds.bounded = true;
+    bounds.max_cell = max_cell;
+    return bounds;
+}
@@ -2,9 +2,18 @@
 #include <gmock/gmock.h>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <array>
+#include <sys/stat.h>
 
 #define UNIT_TEST
 #include "cow.cpp"
+#include "cow2c.cpp"
+#include "cow_lib.hpp"
+#include "cow_bench.cpp"
+#include "profile.hpp"
+#include "cow_superopt.cpp"
+#include "cow_trace.cpp"
 #include <gmock/gmock-matchers.h>
 
 // --- Класс-помощник для перехвата cin/cout ---
@@ -251,8 +260,8 @@ TEST(ExecuteTest, LoopSkip) {
 }
 
 TEST(ExecuteTest, UnmatchedLoops) {
-    // 1. Только начало цикла MOO (без moo) - должно игнорироваться как обычная команда (или прыгать в никуда, по коду jump_table = MAX)
-    // В коде: если jump_table == NO_JUMP, просто идем дальше.
+    // 1. Только начало цикла MOO (без moo) - должно игнорироваться как обычная команда
+    // link_loops оставляет у непарной скобки arg == 0, и она просто идет дальше.
     std::vector<int> prog1 = { OP_INC, OP_LOOP_START, OP_INC };
     // Память: 1 -> Start(1!=0) -> но пары нет -> продолжаем -> Inc -> Итог 2
     {
@@ -265,8 +274,7 @@ TEST(ExecuteTest, UnmatchedLoops) {
     // 2. Только конец цикла moo (без MOO)
     std::vector<int> prog2 = { OP_INC, OP_LOOP_END, OP_INC };
     // Память: 1 -> End(1!=0) -> но пары нет -> continue (пропуск инкремента указателя instr_ptr?? Нет, в коде continue внутри if(jump). else -> break switch -> instr_ptr++.)
-    // Если jump_table == NO_JUMP, условие if (jump != NO_JUMP) false.
-    // Выходит из if. Идет instr_ptr++.
+    // У непарной скобки arg == 0: прыжка нет, идет instr_ptr++.
     // Итог: выполнится INC, LOOP_END(nop), INC -> значение 2.
     {
          execute(prog2);
@@ -320,11 +328,12 @@ TEST(MainTest, RunFile) {
     f << "OOM";
     f.close();
 
-    IORedirect io("");
+    // cow_main пишет через FdIO, поэтому подставляем буфер в памяти
+    MemoryIO io;
     char* argv[] = { (char*)"./cow", (char*)"test.cow" };
-    int res = cow_main(2, argv);
+    int res = cow_main(2, argv, &io);
     EXPECT_EQ(res, 0);
-    EXPECT_EQ(io.getOutput(), "0");
+    EXPECT_EQ(io.output(), "0");
 
     remove("test.cow");
 }
@@ -366,7 +375,7 @@ TEST(CoverageBooster, MoveRightAggressiveResize) {
 
 TEST(CoverageBooster, UnmatchedLoopStartSkip) {
     // MOO (Loop Start), память = 0. Должен прыгнуть к концу.
-    // Но конца (moo) нет -> jump_table == NO_JUMP.
+    // Но конца (moo) нет -> arg == 0.
     // Код должен просто пойти дальше (instr_ptr++ в цикле while).
 
     // Программа: MOO (start) -> MOo (dec)
@@ -385,10 +394,7 @@ TEST(CoverageBooster, UnmatchedLoopStartSkip) {
 
     IORedirect io("");
 
-    // Если jump_table[i] == NO_JUMP, код делает:
-    // if (jump != NO_JUMP) instr_ptr = jump;
-    // else { /* ничего, просто выход из if */ }
-    // Далее instr_ptr++.
+    // Если arg == 0, прыжка нет: instr_ptr += 0, далее instr_ptr++.
 
     execute(instructions);
     EXPECT_EQ(io.getOutput(), "-1");
@@ -396,7 +402,7 @@ TEST(CoverageBooster, UnmatchedLoopStartSkip) {
 
 TEST(CoverageBooster, UnmatchedLoopEndRepeat) {
     // moo (Loop End), память != 0. Должен прыгнуть в начало.
-    // Но начала (MOO) нет -> jump_table == NO_JUMP.
+    // Но начала (MOO) нет -> arg == 0.
 
     // Программа: MOo (inc 0->1), moo (end), OOM (print)
     // Если бы прыжок сработал, был бы бесконечный цикл.
@@ -484,4 +490,1352 @@ TEST_F(VMSingleOpTest, LoopOpsAreNoOpsInSingleExecution) {
 
     EXPECT_EQ(state.mem_ptr, 0);
     EXPECT_EQ(state.memory[0], 777);
-}
\ No newline at end of file
+}
+TEST(FoldTest, FoldsIncDecRuns) {
+    std::vector<Instr> ir = fold({OP_INC, OP_INC, OP_INC, OP_DEC, OP_PRINT_INT});
+    ASSERT_EQ(ir.size(), 2);
+    EXPECT_EQ(ir[0].op, OP_ADD);
+    EXPECT_EQ(ir[0].arg, 2);
+    EXPECT_EQ(ir[1].op, OP_PRINT_INT);
+
+    // Серия с нулевым итогом исчезает
+    ir = fold({OP_INC, OP_DEC, OP_PRINT_INT});
+    ASSERT_EQ(ir.size(), 1);
+    EXPECT_EQ(ir[0].op, OP_PRINT_INT);
+}
+
+TEST(FoldTest, FoldsMoveRuns) {
+    std::vector<Instr> ir = fold({OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_MOVE_LEFT});
+    ASSERT_EQ(ir.size(), 1);
+    EXPECT_EQ(ir[0].op, OP_SHIFT);
+    EXPECT_EQ(ir[0].arg, 2);
+
+    ir = fold({OP_MOVE_LEFT, OP_MOVE_LEFT});
+    ASSERT_EQ(ir.size(), 1);
+    EXPECT_EQ(ir[0].arg, -2);
+}
+
+TEST(FoldTest, LeftEdgeSplitsRun) {
+    // mOo moO на нулевой ячейке дает указатель 1, а не 0,
+    // поэтому такая серия не должна схлопнуться в ноль
+    std::vector<Instr> ir = fold({OP_MOVE_LEFT, OP_MOVE_RIGHT});
+    ASSERT_EQ(ir.size(), 2);
+    EXPECT_EQ(ir[0].arg, -1);
+    EXPECT_EQ(ir[1].arg, 1);
+
+    IORedirect io("");
+    execute({OP_MOVE_LEFT, OP_MOVE_RIGHT, OP_INC, OP_MOVE_LEFT, OP_PRINT_INT});
+    EXPECT_EQ(io.getOutput(), "0");
+}
+
+TEST(FoldTest, ExecCellIsBarrier) {
+    std::vector<Instr> ir = fold({OP_INC, OP_EXEC_CELL, OP_INC});
+    ASSERT_EQ(ir.size(), 3);
+    EXPECT_EQ(ir[1].op, OP_EXEC_CELL);
+
+    // mOO должен увидеть промежуточное значение ячейки: 6 (MoO) -> 7
+    std::vector<int> prog(6, OP_INC);
+    prog.push_back(OP_EXEC_CELL);
+    prog.push_back(OP_PRINT_INT);
+    IORedirect io("");
+    execute(prog);
+    EXPECT_EQ(io.getOutput(), "7");
+}
+
+TEST(FoldTest, ShiftGrowsMemory) {
+    VMState state;
+    exec_shift(25000, state);
+    EXPECT_EQ(state.mem_ptr, 25000);
+    EXPECT_GT(state.memory.size(), 25000);
+
+    exec_shift(-30000, state);
+    EXPECT_EQ(state.mem_ptr, 0);
+}
+
+TEST(IdiomTest, ClearLoop) {
+    std::vector<Instr> ir = compile({OP_LOOP_START, OP_DEC, OP_LOOP_END}, {});
+    ASSERT_EQ(ir.size(), 1);
+    EXPECT_EQ(ir[0].op, OP_SET);
+    EXPECT_EQ(ir[0].arg, 0);
+
+    // С выключенным флагом цикл остается циклом
+    RunOptions options;
+    options.idioms = false;
+    ir = compile({OP_LOOP_START, OP_DEC, OP_LOOP_END}, options);
+    EXPECT_EQ(ir.size(), 3);
+}
+
+TEST(IdiomTest, MoveAndMultiplyLoop) {
+    // MOO MOo moO MoO MoO MoO moO MoO mOo mOo moo: [- > +++ > + < <]
+    std::vector<int> prog = {
+        OP_LOOP_START, OP_DEC,
+        OP_MOVE_RIGHT, OP_INC, OP_INC, OP_INC,
+        OP_MOVE_RIGHT, OP_INC,
+        OP_MOVE_LEFT, OP_MOVE_LEFT,
+        OP_LOOP_END
+    };
+    std::vector<Instr> ir = compile(prog, {});
+    ASSERT_EQ(ir.size(), 3);
+    EXPECT_EQ(ir[0].op, OP_ADD_MUL);
+    EXPECT_EQ(ir[0].arg, 1);
+    EXPECT_EQ(ir[0].arg2, 3);
+    EXPECT_EQ(ir[1].op, OP_ADD_MUL);
+    EXPECT_EQ(ir[1].arg, 2);
+    EXPECT_EQ(ir[1].arg2, 1);
+    EXPECT_EQ(ir[2].op, OP_SET);
+
+    VMState state;
+    state.memory[0] = 5;
+    state.memory[1] = 1;
+    run(ir, state);
+    EXPECT_EQ(state.memory[0], 0);
+    EXPECT_EQ(state.memory[1], 16);
+    EXPECT_EQ(state.memory[2], 5);
+}
+
+TEST(IdiomTest, ScanLoop) {
+    std::vector<Instr> ir = compile({OP_LOOP_START, OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_LOOP_END}, {});
+    ASSERT_EQ(ir.size(), 1);
+    EXPECT_EQ(ir[0].op, OP_SCAN);
+    EXPECT_EQ(ir[0].arg, 2);
+
+    VMState state;
+    state.memory[0] = 1;
+    state.memory[2] = 1;
+    run(ir, state);
+    EXPECT_EQ(state.mem_ptr, 4);
+}
+
+TEST(IdiomTest, NonIdiomLoopsStay) {
+    // Вывод в теле, ненулевой итоговый сдвиг и вложенный цикл не переписываются
+    std::vector<Instr> ir = compile({OP_LOOP_START, OP_DEC, OP_IO_CHAR, OP_LOOP_END}, {});
+    EXPECT_EQ(ir.front().op, OP_LOOP_START);
+
+    ir = compile({OP_LOOP_START, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_LOOP_END}, {});
+    EXPECT_EQ(ir.front().op, OP_LOOP_START);
+
+    ir = compile({OP_LOOP_START, OP_DEC, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_MOVE_LEFT, OP_LOOP_END}, {});
+    EXPECT_EQ(ir.front().op, OP_LOOP_START);
+
+    ir = compile({OP_LOOP_START, OP_LOOP_START, OP_DEC, OP_LOOP_END, OP_LOOP_END}, {});
+    ASSERT_EQ(ir.size(), 3);
+    EXPECT_EQ(ir[1].op, OP_SET);
+}
+
+TEST(LinkTest, NestedAndUnmatchedBrackets) {
+    // moo MOO [MOO [] ] MOO: первая moo и последний MOO без пары
+    std::vector<Instr> ir = {
+        {OP_LOOP_END, 7, 0}, {OP_LOOP_START, 0, 0}, {OP_LOOP_START, 0, 0}, {OP_INC, 0, 0},
+        {OP_LOOP_END, 0, 0}, {OP_LOOP_END, 0, 0}, {OP_LOOP_START, 0, 0}
+    };
+    link_loops(ir);
+    EXPECT_EQ(ir[0].arg, 0);
+    EXPECT_EQ(ir[1].arg, 4);
+    EXPECT_EQ(ir[5].arg, -4);
+    EXPECT_EQ(ir[2].arg, 2);
+    EXPECT_EQ(ir[4].arg, -2);
+    EXPECT_EQ(ir[6].arg, 0);
+    EXPECT_EQ(jump_target(ir[2], 2), 4u);
+    EXPECT_EQ(jump_target(ir[6], 6), NO_JUMP);
+    EXPECT_EQ(ir[3].arg, 0); // прочие инструкции не трогаются
+}
+
+TEST(LinkTest, VectorScanMatchesScalar) {
+    // Скобки на всех позициях внутри блоков, arg и arg2 со значениями кодов скобок
+    std::vector<Instr> ir;
+    for (int i = 0; i < 203; ++i) {
+        int op = (i % 7 == 0) ? OP_LOOP_START : (i % 5 == 0) ? OP_LOOP_END : OP_ADD;
+        ir.push_back({op, OP_LOOP_START, OP_LOOP_END});
+    }
+    for (std::size_t from = 0; from <= ir.size(); ++from) {
+        std::size_t expected = from;
+        while (expected < ir.size() && ir[expected].op == OP_ADD) ++expected;
+        EXPECT_EQ(next_loop_op(ir, from), expected) << from;
+    }
+}
+
+TEST(MainTest, NoIdiomsFlag) {
+    std::ofstream f("flag.cow");
+    f << "MoO MoO MOO MOo moo OOM";
+    f.close();
+
+    MemoryIO io;
+    char* argv[] = { (char*)"./cow", (char*)"--no-idioms", (char*)"flag.cow" };
+    EXPECT_EQ(cow_main(3, argv, &io), 0);
+    EXPECT_EQ(io.output(), "0");
+
+    IORedirect err("");
+    char* bad_argv[] = { (char*)"./cow", (char*)"--bogus", (char*)"flag.cow" };
+    EXPECT_EQ(cow_main(3, bad_argv), 1);
+
+    remove("flag.cow");
+}
+
+// Запускает программу выбранным движком и возвращает вывод
+std::string run_with_engine(const std::vector<int>& prog, Engine engine, const std::string& input = "") {
+    RunOptions options;
+    options.engine = engine;
+    IORedirect io(input);
+    execute(prog, options);
+    return io.getOutput();
+}
+
+TEST(EngineTest, ThreadedMatchesSwitch) {
+    std::vector<std::vector<int>> programs = {
+        // [- > ++ <] с выводом результата
+        { OP_INC, OP_INC, OP_INC, OP_LOOP_START, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_INC,
+          OP_MOVE_LEFT, OP_LOOP_END, OP_MOVE_RIGHT, OP_PRINT_INT },
+        // Вложенные циклы с выводом в теле
+        { OP_INC, OP_INC, OP_LOOP_START, OP_PRINT_INT, OP_MOVE_RIGHT, OP_INC, OP_INC,
+          OP_LOOP_START, OP_DEC, OP_PRINT_INT, OP_LOOP_END, OP_MOVE_LEFT, OP_DEC, OP_LOOP_END },
+        // Непарные скобки и mOO
+        { OP_LOOP_END, OP_INC, OP_LOOP_END, OP_EXEC_CELL, OP_PRINT_INT, OP_LOOP_START, OP_DEC, OP_PRINT_INT },
+        // Ввод, регистр
+        { OP_READ_INT, OP_REGISTER, OP_MOVE_RIGHT, OP_REGISTER, OP_PRINT_INT, OP_IO_CHAR, OP_IO_CHAR }
+    };
+
+    for (const auto& prog : programs) {
+        EXPECT_EQ(run_with_engine(prog, ENGINE_THREADED, "42\nx"),
+                  run_with_engine(prog, ENGINE_SWITCH, "42\nx"));
+    }
+}
+
+TEST(EngineTest, EmptyProgram) {
+    EXPECT_EQ(run_with_engine({}, ENGINE_THREADED), "");
+    EXPECT_EQ(run_with_engine({}, ENGINE_SWITCH), "");
+}
+
+TEST(MainTest, EngineFlag) {
+    std::ofstream f("engine.cow");
+    f << "MoO MoO MoO OOM";
+    f.close();
+
+    for (const char* flag : {"--engine=switch", "--engine=threaded"}) {
+        MemoryIO io;
+        char* argv[] = { (char*)"./cow", (char*)flag, (char*)"engine.cow" };
+        EXPECT_EQ(cow_main(3, argv, &io), 0);
+        EXPECT_EQ(io.output(), "3");
+    }
+
+    remove("engine.cow");
+}
+
+TEST(IdiomTest, LeftReachingLoopIsGuarded) {
+    // [-<+>] и [-<<+++>>]: ADD_MUL левее входной ячейки за GUARD, за ними - сам цикл
+    std::vector<Instr> ir = compile({OP_LOOP_START, OP_DEC, OP_MOVE_LEFT, OP_INC, OP_MOVE_RIGHT, OP_LOOP_END}, {});
+    ASSERT_EQ(ir.size(), 9);
+    EXPECT_EQ(ir[0].op, OP_GUARD);
+    EXPECT_EQ(ir[0].arg, 1);
+    EXPECT_EQ(ir[0].arg2, 3);
+    EXPECT_EQ(ir[1].op, OP_ADD_MUL);
+    EXPECT_EQ(ir[1].arg, -1);
+    EXPECT_EQ(ir[1].arg2, 1);
+    EXPECT_EQ(ir[2].op, OP_SET);
+    EXPECT_EQ(ir[3].op, OP_LOOP_START);
+    EXPECT_EQ(ir[3].arg, 5);
+
+    // moO moO MoO*5 MOO MOo mOo mOo MoO MoO MoO moO moO moo mOo mOo OOM
+    std::vector<int> prog = {OP_MOVE_RIGHT, OP_MOVE_RIGHT};
+    prog.insert(prog.end(), 5, OP_INC);
+    prog.insert(prog.end(), {OP_LOOP_START, OP_DEC, OP_MOVE_LEFT, OP_MOVE_LEFT, OP_INC, OP_INC, OP_INC,
+                             OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_LOOP_END, OP_MOVE_LEFT, OP_MOVE_LEFT, OP_PRINT_INT});
+    ir = compile(prog, {});
+    EXPECT_EQ(ir[2].op, OP_GUARD);
+    EXPECT_EQ(ir[3].op, OP_ADD_MUL);
+    EXPECT_EQ(ir[3].arg, -2);
+    EXPECT_EQ(ir[3].arg2, 3);
+
+    std::vector<Engine> engines = {ENGINE_SWITCH, ENGINE_THREADED};
+#ifdef COW_HAS_JIT
+    engines.push_back(ENGINE_JIT);
+#endif
+    for (Engine engine : engines) {
+        EXPECT_EQ(run_with_engine(prog, engine), "15") << engine;
+    }
+}
+
+TEST(IdiomTest, LeftEdgeLoopMatchesPlainLoop) {
+    // moO MOo MOo mOo MOo MOO mOo MOo moO MoO moo mOo OOM: тело цикла уходит
+    // левее нулевой ячейки, mOo упирается в край, и цикл делает не то, что ADD_MUL.
+    // GUARD отправляет такой вход в исходный цикл
+    std::vector<int> prog = {
+        OP_MOVE_RIGHT, OP_DEC, OP_DEC, OP_MOVE_LEFT, OP_DEC,
+        OP_LOOP_START, OP_MOVE_LEFT, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_LOOP_END,
+        OP_MOVE_LEFT, OP_PRINT_INT
+    };
+    std::vector<Instr> ir = compile(prog, {});
+    EXPECT_TRUE(std::any_of(ir.begin(), ir.end(), [](const Instr& i) { return i.op == OP_GUARD; }));
+
+    RunOptions plain;
+    plain.idioms = false;
+    IORedirect io("");
+    execute(prog, plain);
+    EXPECT_EQ(io.getOutput(), "-3");
+
+    std::vector<Engine> engines = {ENGINE_SWITCH, ENGINE_THREADED};
+#ifdef COW_HAS_JIT
+    engines.push_back(ENGINE_JIT);
+#endif
+    for (Engine engine : engines) {
+        EXPECT_EQ(run_with_engine(prog, engine), "-3") << engine;
+    }
+
+    // Телу, которое не заходит левее входной ячейки, GUARD не нужен
+    ir = compile({OP_LOOP_START, OP_MOVE_RIGHT, OP_INC, OP_MOVE_LEFT, OP_DEC, OP_LOOP_END}, {});
+    ASSERT_EQ(ir.size(), 2);
+    EXPECT_EQ(ir[0].op, OP_ADD_MUL);
+}
+
+#ifdef COW_HAS_JIT
+TEST(JitTest, MatchesInterpreter) {
+    std::vector<std::vector<int>> programs = {
+        { OP_INC, OP_INC, OP_INC, OP_LOOP_START, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_INC,
+          OP_MOVE_LEFT, OP_LOOP_END, OP_MOVE_RIGHT, OP_PRINT_INT },
+        { OP_INC, OP_INC, OP_LOOP_START, OP_PRINT_INT, OP_MOVE_RIGHT, OP_INC, OP_INC,
+          OP_LOOP_START, OP_DEC, OP_PRINT_INT, OP_LOOP_END, OP_MOVE_LEFT, OP_DEC, OP_LOOP_END },
+        { OP_LOOP_END, OP_INC, OP_LOOP_END, OP_EXEC_CELL, OP_PRINT_INT, OP_LOOP_START, OP_DEC, OP_PRINT_INT },
+        { OP_READ_INT, OP_REGISTER, OP_MOVE_RIGHT, OP_REGISTER, OP_PRINT_INT, OP_IO_CHAR, OP_IO_CHAR },
+        // Уход влево за край ленты упирается в нулевую ячейку
+        { OP_MOVE_LEFT, OP_MOVE_LEFT, OP_INC, OP_MOVE_RIGHT, OP_MOVE_LEFT, OP_PRINT_INT },
+        // То же внутри цикла переноса: GUARD отправляет его в исходный цикл
+        { OP_MOVE_RIGHT, OP_DEC, OP_DEC, OP_MOVE_LEFT, OP_DEC, OP_LOOP_START, OP_MOVE_LEFT, OP_DEC,
+          OP_MOVE_RIGHT, OP_INC, OP_LOOP_END, OP_MOVE_LEFT, OP_PRINT_INT }
+    };
+
+    for (const auto& prog : programs) {
+        EXPECT_EQ(run_with_engine(prog, ENGINE_JIT, "42\nx"),
+                  run_with_engine(prog, ENGINE_SWITCH, "42\nx"));
+    }
+}
+
+TEST(JitTest, GrowsTapeFromNativeCode) {
+    // Сдвиг и ADD_MUL за пределы исходных 10000 ячеек
+    std::vector<Instr> ir = {
+        {OP_SHIFT, 9999, 0}, {OP_ADD, 3, 0},
+        {OP_ADD_MUL, 5000, 2}, {OP_SHIFT, 5000, 0}
+    };
+    VMState state;
+    ASSERT_TRUE(run_jit(ir, state));
+    EXPECT_EQ(state.mem_ptr, 14999);
+    EXPECT_GE(state.memory.size(), 15000);
+    EXPECT_EQ(state.memory[14999], 6);
+}
+
+TEST(JitTest, ExecCellSeesNativeChanges) {
+    // mOO через помощника видит ячейку, измененную машинным кодом, и наоборот
+    // Ячейка 0 = 2 (moO), mOO сдвигает указатель вправо
+    std::vector<int> prog = {
+        OP_INC, OP_INC, OP_EXEC_CELL, OP_INC, OP_MOVE_LEFT, OP_PRINT_INT, OP_MOVE_RIGHT, OP_PRINT_INT
+    };
+    EXPECT_EQ(run_with_engine(prog, ENGINE_JIT), run_with_engine(prog, ENGINE_SWITCH));
+}
+#endif
+
+TEST(Cow2cTest, EmitsStructuredC) {
+    std::string c = emit_c(compile({
+        OP_INC, OP_INC, OP_LOOP_START, OP_MOVE_RIGHT, OP_INC, OP_IO_CHAR, OP_MOVE_LEFT, OP_DEC, OP_LOOP_END,
+        OP_LOOP_START, OP_DEC, OP_LOOP_END
+    }, {}));
+
+    EXPECT_THAT(c, ::testing::HasSubstr("int main(void)"));
+    EXPECT_THAT(c, ::testing::HasSubstr("tape[p] += 2;"));
+    EXPECT_THAT(c, ::testing::HasSubstr("while (tape[p]) {"));
+    EXPECT_THAT(c, ::testing::HasSubstr("exec_op(4);"));
+    EXPECT_THAT(c, ::testing::HasSubstr("p = p >= 1 ? p - 1 : 0;"));
+    // [MOo] превратился в SET 0
+    EXPECT_THAT(c, ::testing::HasSubstr("tape[p] = 0;"));
+}
+
+TEST(Cow2cTest, UnmatchedBracketsAreSkipped) {
+    std::string c = emit_c(compile({OP_LOOP_END, OP_INC, OP_LOOP_START, OP_PRINT_INT}, {}));
+    EXPECT_EQ(c.find("while (tape[p]) {", c.find("int main")), std::string::npos);
+}
+
+TEST(Cow2cTest, BuildRequiresOutput) {
+    IORedirect io("");
+    char* argv[] = { (char*)"./cow2c", (char*)"--build", (char*)"x.cow" };
+    EXPECT_EQ(cow2c_main(3, argv), 1);
+    EXPECT_THAT(io.getError(), ::testing::HasSubstr("Usage:"));
+}
+
+TEST(BufferedIOTest, OutputIsBatched) {
+    MemoryIO io;
+    RunOptions options;
+    options.io = &io;
+
+    std::vector<int> prog(65, OP_INC);
+    for (int i = 0; i < 1000; ++i) prog.push_back(OP_IO_CHAR);
+    prog.push_back(OP_PRINT_INT);
+    execute(prog, options);
+
+    EXPECT_EQ(io.output(), std::string(1000, 'A') + "65");
+    // Вся тысяча символов ушла одним сбросом
+    EXPECT_EQ(io.flush_count(), 1);
+}
+
+TEST(BufferedIOTest, FlushesBeforeInput) {
+    // Приглашение должно уйти в приемник до того, как программа ждет ввод
+    MemoryIO io("5\n");
+    RunOptions options;
+    options.io = &io;
+
+    execute({OP_INC, OP_PRINT_INT, OP_READ_INT, OP_PRINT_INT}, options);
+    // "1" ушла перед чтением, "5" пока лежит в буфере
+    EXPECT_EQ(io.flush_count(), 1);
+    EXPECT_EQ(io.output(), "15");
+}
+
+TEST(BufferedIOTest, ReadIntMatchesStream) {
+    // Те же входы, что и у std::cin >> int + peek/ignore
+    for (const char* input : {"987\nA", "  -12 x", "abc\nB", "+7\nC", "99999999999\nD", "", "-\nE"}) {
+        VMState a;
+        MemoryIO mem(input);
+        a.io = &mem;
+        exec_single_op(OP_READ_INT, a);
+        a.mem_ptr = 1;
+        exec_single_op(OP_IO_CHAR, a);
+
+        VMState b;
+        IORedirect io(input);
+        exec_single_op(OP_READ_INT, b);
+        b.mem_ptr = 1;
+        exec_single_op(OP_IO_CHAR, b);
+
+        EXPECT_EQ(a.memory[0], b.memory[0]) << input;
+        EXPECT_EQ(a.memory[1], b.memory[1]) << input;
+    }
+}
+
+TEST(BufferedIOTest, FdIOWritesToDescriptor) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    {
+        FdIO io(STDIN_FILENO, fds[1]);
+        io.write_int(-42);
+        io.write_char('!');
+    } // деструктор сбрасывает буфер
+    close(fds[1]);
+
+    char buf[16] = {};
+    ssize_t got = read(fds[0], buf, sizeof(buf));
+    close(fds[0]);
+    EXPECT_EQ(std::string(buf, got > 0 ? got : 0), "-42!");
+}
+
+TEST(SourceTest, SkipNonCowFindsNextCommand) {
+    std::string text(100, '.');
+    text[70] = 'O';
+    EXPECT_EQ(skip_non_cow(text.data(), 0, text.size()), 70);
+    EXPECT_EQ(skip_non_cow(text.data(), 71, text.size()), 100);
+    // Хвост короче 32 байт проверяется посимвольно
+    EXPECT_EQ(skip_non_cow(text.data(), 65, 75), 70);
+    EXPECT_EQ(skip_non_cow("xxm", 0, 3), 2);
+}
+
+TEST(SourceTest, CompileSourceMatchesParseAndFold) {
+    std::string source = std::string(200, ' ') + "MoO MoO comment moO mOo mOo moO MMM OOM mmm MOO MOo moo Mo";
+    std::vector<Instr> a = compile_source(source, {});
+    std::vector<Instr> b = compile(parse(source), {});
+    ASSERT_EQ(a.size(), b.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(a[i].op, b[i].op);
+        EXPECT_EQ(a[i].arg, b[i].arg);
+    }
+}
+
+TEST(SourceTest, MappedFileReadsContents) {
+    std::ofstream f("mapped.cow");
+    f << "MoO OOM";
+    f.close();
+
+    {
+        MappedFile file("mapped.cow");
+        ASSERT_TRUE(file.is_open());
+        EXPECT_EQ(file.view(), "MoO OOM");
+    }
+    {
+        MappedFile missing("non_existent_file.cow");
+        EXPECT_FALSE(missing.is_open());
+    }
+
+    remove("mapped.cow");
+}
+
+TEST(BytecodeTest, RoundTrip) {
+    std::string source = "MoO MoO MoO MOO MOo moO MoO mOo moo moO OOM MOO Moo moo";
+    std::vector<Instr> program = compile_source(source, {});
+    std::string data = serialize_bytecode(program, source, BC_IDIOMS);
+
+    ASSERT_TRUE(is_bytecode(data));
+    BytecodeView view;
+    ASSERT_TRUE(view.load(data)) << view.error();
+    EXPECT_EQ(view.header().source_hash, hash_source(source));
+    EXPECT_EQ(view.header().flags, BC_IDIOMS);
+    ASSERT_EQ(view.code().size(), program.size());
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        EXPECT_EQ(view.code()[i].op, program[i].op);
+        EXPECT_EQ(view.code()[i].arg, program[i].arg);
+    }
+    // Связи скобок хранятся в самих инструкциях
+    EXPECT_EQ(jump_target(view.code()[3], 3), jump_target(program[3], 3));
+}
+
+TEST(BytecodeTest, RejectsCorruptFiles) {
+    std::vector<Instr> program = compile_source("MOO OOM moo", {});
+    std::string data = serialize_bytecode(program, "MOO OOM moo", 0);
+    BytecodeView view;
+
+    EXPECT_FALSE(view.load("MoO MoO"));
+    EXPECT_FALSE(view.load(std::string_view(data).substr(0, data.size() - 1)));
+
+    // Неизвестный код операции
+    std::string bad_op = data;
+    int op = 99;
+    std::memcpy(&bad_op[sizeof(BytecodeHeader)], &op, sizeof(op));
+    EXPECT_FALSE(view.load(bad_op));
+
+    // Переход за пределы программы
+    std::string bad_jump = data;
+    int jump = 1000;
+    std::memcpy(&bad_jump[sizeof(BytecodeHeader) + offsetof(Instr, arg)], &jump, sizeof(jump));
+    EXPECT_FALSE(view.load(bad_jump));
+    EXPECT_EQ(view.error(), "corrupt loop links in bytecode");
+
+    // Парная скобка не ссылается обратно
+    std::string one_sided = data;
+    jump = 0;
+    std::memcpy(&one_sided[sizeof(BytecodeHeader) + 2 * sizeof(Instr) + offsetof(Instr, arg)], &jump, sizeof(jump));
+    EXPECT_FALSE(view.load(one_sided));
+    // ADD_MUL левее входной ячейки движки исполняют только за GUARD
+    std::vector<Instr> left = {{OP_ADD_MUL, -1, 1}, {OP_SET, 0, 0}};
+    EXPECT_FALSE(view.load(serialize_bytecode(left, "", 0)));
+    EXPECT_EQ(view.error(), "unguarded ADD_MUL offset in bytecode");
+    std::vector<Instr> guarded = compile({OP_LOOP_START, OP_DEC, OP_MOVE_LEFT, OP_MOVE_LEFT, OP_INC,
+                                          OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_LOOP_END}, {});
+    ASSERT_EQ(guarded[0].op, OP_GUARD);
+    std::string guarded_data = serialize_bytecode(guarded, "", 0);
+    EXPECT_TRUE(view.load(guarded_data));
+    // GUARD проверяет меньше ячеек, чем нужно ADD_MUL
+    guarded[0].arg = 1;
+    EXPECT_FALSE(view.load(serialize_bytecode(guarded, "", 0)));
+    EXPECT_EQ(view.error(), "unguarded ADD_MUL offset in bytecode");
+    // GUARD прыгает не на MOO
+    guarded[0].arg = 2;
+    guarded[0].arg2 = 1;
+    EXPECT_FALSE(view.load(serialize_bytecode(guarded, "", 0)));
+    EXPECT_EQ(view.error(), "invalid GUARD in bytecode");
+}
+
+TEST(MainTest, CompileAndRunBytecode) {
+    std::ofstream f("bc.cow");
+    f << "MoO MoO MoO MOO MOo moO MoO MoO mOo moo moO OOM";
+    f.close();
+
+    char* compile_argv[] = { (char*)"./cow", (char*)"--compile", (char*)"-o", (char*)"bc.cowb", (char*)"bc.cow" };
+    EXPECT_EQ(cow_main(5, compile_argv), 0);
+
+    for (const char* flag : {"--engine=switch", "--engine=threaded", "--engine=jit"}) {
+        MemoryIO io;
+        char* argv[] = { (char*)"./cow", (char*)flag, (char*)"bc.cowb" };
+        EXPECT_EQ(cow_main(3, argv, &io), 0);
+        EXPECT_EQ(io.output(), "6");
+    }
+
+    remove("bc.cow");
+    remove("bc.cowb");
+}
+
+TEST(MainTest, CacheHitSkipsCompilation) {
+    std::filesystem::remove_all("cow_cache_test");
+    std::ofstream f("cached.cow");
+    f << "MoO MoO OOM";
+    f.close();
+
+    char* argv[] = { (char*)"./cow", (char*)"--cache-dir=cow_cache_test", (char*)"cached.cow" };
+    {
+        MemoryIO io;
+        EXPECT_EQ(cow_main(3, argv, &io), 0);
+        EXPECT_EQ(io.output(), "2");
+    }
+
+    std::string path = cache_path("cow_cache_test", "MoO MoO OOM", BC_IDIOMS);
+    ASSERT_TRUE(std::filesystem::exists(path));
+
+    // Подменяем закэшированную программу: если второй запуск читает кэш, он выведет 5
+    std::vector<Instr> fake = {{OP_ADD, 5, 0}, {OP_PRINT_INT, 0, 0}};
+    ASSERT_TRUE(write_bytecode_file(path, serialize_bytecode(fake, "MoO MoO OOM", BC_IDIOMS)));
+    {
+        MemoryIO io;
+        EXPECT_EQ(cow_main(3, argv, &io), 0);
+        EXPECT_EQ(io.output(), "5");
+    }
+
+    std::filesystem::remove_all("cow_cache_test");
+    remove("cached.cow");
+}
+
+std::string run_with_cell(const std::vector<int>& prog, CellType cell, TapeKind tape, const std::string& input = "") {
+    MemoryIO io(input);
+    RunOptions options;
+    options.cell = cell;
+    options.tape = tape;
+    options.io = &io;
+    execute(prog, options);
+    return io.output();
+}
+
+TEST(CellTest, ByteCellsWrap) {
+    // 0 - 1 = 255, 255 + 1 = 0
+    EXPECT_EQ(run_with_cell({ OP_DEC, OP_PRINT_INT, OP_INC, OP_PRINT_INT }, CELL_U8, TAPE_DENSE), "2550");
+    // Число читается как int и заворачивается по модулю 256
+    EXPECT_EQ(run_with_cell({ OP_READ_INT, OP_PRINT_INT }, CELL_U8, TAPE_DENSE, "300\n"), "44");
+    // [-] на 255 завершается за 255 итераций, а не уходит в минус
+    EXPECT_EQ(run_with_cell({ OP_DEC, OP_LOOP_START, OP_DEC, OP_LOOP_END, OP_PRINT_INT }, CELL_U8, TAPE_DENSE), "0");
+}
+
+TEST(CellTest, WideCellsHoldInt64) {
+    EXPECT_EQ(run_with_cell({ OP_READ_INT, OP_INC, OP_PRINT_INT }, CELL_I64, TAPE_DENSE, "9999999999\n"), "10000000000");
+    EXPECT_EQ(run_with_cell({ OP_READ_INT, OP_PRINT_INT }, CELL_I64, TAPE_DENSE, "-9223372036854775808\n"),
+              "-9223372036854775808");
+    // Для int32 то же число не влезает и читается как 0
+    EXPECT_EQ(run_with_cell({ OP_READ_INT, OP_PRINT_INT }, CELL_I32, TAPE_DENSE, "9999999999\n"), "0");
+
+    // Большое значение не считается кодом команды для mOO
+    BasicVMState<int64_t> state;
+    MemoryIO io;
+    state.io = &io;
+    state.memory[0] = (int64_t(1) << 32) + OP_PRINT_INT;
+    exec_single_op(OP_EXEC_CELL, state);
+    EXPECT_EQ(io.output(), "");
+}
+
+TEST(CellTest, SegmentedTapeAllocatesOnDemand) {
+    SegmentedTape<int, 64> tape(INITIAL_TAPE_SIZE);
+    EXPECT_EQ(tape.pages_allocated(), 0u);
+    tape[0] = 1;
+    tape[63] = 2;
+    EXPECT_EQ(tape.pages_allocated(), 1u);
+    tape[64 * 100] = 3;
+    EXPECT_EQ(tape.pages_allocated(), 2u);
+    EXPECT_EQ(tape.size(), 64u * 101);
+    EXPECT_EQ(tape[0] + tape[63] + tape[64 * 100], 6);
+    EXPECT_EQ(tape[64 * 50], 0);
+}
+
+TEST(CellTest, PagedTapeMatchesDense) {
+    std::vector<int> prog = {
+        OP_INC, OP_INC, OP_INC, OP_LOOP_START, OP_DEC, OP_MOVE_RIGHT, OP_INC, OP_INC,
+        OP_MOVE_LEFT, OP_LOOP_END, OP_MOVE_RIGHT, OP_PRINT_INT, OP_READ_INT
+    };
+    // Уходим далеко за начальный размер ленты и возвращаемся
+    prog.insert(prog.end(), 30000, OP_MOVE_RIGHT);
+    prog.insert(prog.end(), { OP_IO_CHAR, OP_PRINT_INT });
+    prog.insert(prog.end(), 30000, OP_MOVE_LEFT);
+    prog.push_back(OP_PRINT_INT);
+    for (CellType cell : { CELL_U8, CELL_I32, CELL_I64 }) {
+        EXPECT_EQ(run_with_cell(prog, cell, TAPE_PAGED, "20000\nz"), run_with_cell(prog, cell, TAPE_DENSE, "20000\nz"));
+    }
+    EXPECT_EQ(run_with_cell(prog, CELL_U8, TAPE_PAGED, "20000\nz"), "612232");
+}
+
+TEST(MainTest, CellAndTapeFlags) {
+    std::ofstream f("cell.cow");
+    f << "OOM MoO OOM";
+    f.close();
+
+    char* argv[] = { (char*)"./cow", (char*)"--cell=u8", (char*)"--tape=paged", (char*)"cell.cow" };
+    MemoryIO io;
+    EXPECT_EQ(cow_main(4, argv, &io), 0);
+    EXPECT_EQ(io.output(), "01");
+    remove("cell.cow");
+}
+
+TEST(LibTest, ProgramCopiesShareCode) {
+    CowProgram program("MoO MoO OOM");
+    CowProgram copy = program;
+    EXPECT_EQ(copy.code().data(), program.code().data());
+    EXPECT_EQ(copy.size(), 2u); // ADD 2, OOM
+    EXPECT_EQ(CowProgram().size(), 0u);
+}
+
+TEST(LibTest, VMIsReusedWithoutReallocation) {
+    MemoryIO io;
+    RunOptions options;
+    options.io = &io;
+    CowVM vm(options);
+    vm.load(CowProgram("MoO MoO moO MoO OOM mOo OOM"));
+
+    EXPECT_EQ(vm.run(), RUN_FINISHED);
+    EXPECT_TRUE(vm.finished());
+    const int* tape = vm.state().memory.data();
+
+    vm.reset();
+    EXPECT_EQ(vm.state().memory[0], 0);
+    EXPECT_EQ(vm.run(), RUN_FINISHED);
+    EXPECT_EQ(vm.state().memory.data(), tape);
+    EXPECT_EQ(io.output(), "1212");
+}
+
+TEST(LibTest, InstructionBudgetPreemptsAndResumes) {
+    // MoO MOO moo - бесконечный цикл
+    CowVM vm;
+    vm.load(CowProgram("MoO MOO moo"));
+    EXPECT_EQ(vm.run({ .max_instructions = 1000 }), RUN_OUT_OF_BUDGET);
+    EXPECT_EQ(vm.instructions_executed(), 1000u);
+    EXPECT_EQ(vm.run({ .max_instructions = 500 }), RUN_OUT_OF_BUDGET);
+    EXPECT_EQ(vm.instructions_executed(), 1500u);
+    EXPECT_FALSE(vm.finished());
+
+    RunBudget time_only;
+    time_only.time_limit = std::chrono::milliseconds(5);
+    EXPECT_EQ(vm.run(time_only), RUN_OUT_OF_TIME);
+}
+
+TEST(LibTest, BudgetStopsScanStuckAtLeftEdge) {
+    // [mOo] на нулевой ячейке != 0 сворачивается в SCAN, который никогда не кончается
+    CowProgram program("MoO MOO mOo moo");
+    ASSERT_EQ(program.size(), 2u);
+    EXPECT_EQ(program.code()[1].op, OP_SCAN);
+
+    CowVM vm;
+    vm.load(program);
+    EXPECT_EQ(vm.run({ .max_instructions = 1000 }), RUN_OUT_OF_BUDGET);
+    EXPECT_EQ(vm.instructions_executed(), 1000u);
+    EXPECT_FALSE(vm.finished());
+
+    RunBudget time_only;
+    time_only.time_limit = std::chrono::milliseconds(5);
+    EXPECT_EQ(vm.run(time_only), RUN_OUT_OF_TIME);
+}
+
+TEST(LibTest, SlicedRunMatchesFullRun) {
+    // Вложенные циклы с выводом
+    CowProgram program(std::vector<Instr>{
+        {OP_ADD, 3, 0}, {OP_LOOP_START, 0, 0}, {OP_PRINT_INT, 0, 0}, {OP_SHIFT, 1, 0}, {OP_ADD, 2, 0},
+        {OP_LOOP_START, 0, 0}, {OP_ADD, -1, 0}, {OP_PRINT_INT, 0, 0}, {OP_LOOP_END, 0, 0},
+        {OP_SHIFT, -1, 0}, {OP_ADD, -1, 0}, {OP_LOOP_END, 0, 0}
+    });
+
+    MemoryIO full_io;
+    CowVM full({ .io = &full_io });
+    full.load(program);
+    EXPECT_EQ(full.run(), RUN_FINISHED);
+
+    MemoryIO sliced_io;
+    CowVM sliced({ .io = &sliced_io });
+    sliced.load(program);
+    int calls = 0;
+    while (sliced.run({ .max_instructions = 1 }) == RUN_OUT_OF_BUDGET) ++calls;
+    EXPECT_GT(calls, 10);
+    EXPECT_EQ(sliced_io.output(), full_io.output());
+}
+
+TEST(LibTest, ProgramIsSharedAcrossThreads) {
+    // Обратный отсчет от 200 с выводом
+    std::string source;
+    for (int i = 0; i < 200; ++i) source += "MoO ";
+    source += "MOO OOM MOo moo";
+    CowProgram program(source);
+
+    std::vector<std::string> outputs(4);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+        threads.emplace_back([&, i] {
+            MemoryIO io;
+            CowVM vm({ .io = &io });
+            vm.load(program);
+            vm.run();
+            outputs[i] = io.output();
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    EXPECT_FALSE(outputs[0].empty());
+    for (const std::string& out : outputs) EXPECT_EQ(out, outputs[0]);
+}
+
+TEST(BatchTest, ParsesManifest) {
+    std::vector<BatchJob> jobs;
+    std::string error;
+    ASSERT_TRUE(parse_manifest("# комментарий\na.cow in.txt out.txt\n\n/abs/b.cow - -\n", "dir", jobs, error));
+    ASSERT_EQ(jobs.size(), 2u);
+    EXPECT_EQ(jobs[0].program, (std::filesystem::path("dir") / "a.cow").string());
+    EXPECT_EQ(jobs[0].input, (std::filesystem::path("dir") / "in.txt").string());
+    EXPECT_EQ(jobs[1].program, "/abs/b.cow");
+    EXPECT_EQ(jobs[1].input, "");
+    EXPECT_EQ(jobs[1].output, "");
+
+    EXPECT_FALSE(parse_manifest("a.cow in.txt\n", "", jobs, error));
+    EXPECT_EQ(error, "line 1: expected <program> <input> <output>");
+}
+
+TEST(BatchTest, PoolRunsEveryJobOnce) {
+    WorkStealingPool pool(4);
+    std::vector<std::atomic<int>> runs(1000);
+    pool.run(runs.size(), [&](std::size_t worker, std::size_t job) {
+        EXPECT_LT(worker, 4u);
+        // Неравная нагрузка, чтобы потоки успевали перехватывать работу
+        if (job % 97 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        runs[job]++;
+    });
+    for (const std::atomic<int>& count : runs) EXPECT_EQ(count.load(), 1);
+}
+
+TEST(BatchTest, RunsJobsWithTimeout) {
+    std::filesystem::create_directories("batch_test");
+    std::ofstream("batch_test/add.cow") << "oom moO oom MOO MOo mOo MoO moO moo mOo OOM";
+    std::ofstream("batch_test/loop.cow") << "MoO MOO moo";
+    std::ofstream("batch_test/in1.txt") << "2\n3\n";
+    std::ofstream("batch_test/in2.txt") << "40\n2\n";
+
+    std::vector<BatchJob> jobs = {
+        {"batch_test/add.cow", "batch_test/in1.txt", "batch_test/out1.txt"},
+        {"batch_test/add.cow", "batch_test/in2.txt", "batch_test/out2.txt"},
+        {"batch_test/loop.cow", "", ""},
+        {"batch_test/missing.cow", "", ""},
+    };
+    BatchRunner runner(2, std::chrono::milliseconds(20));
+    BatchReport report = runner.run(jobs);
+
+    EXPECT_EQ(report.ok, 2u);
+    EXPECT_EQ(report.timeouts, 1u);
+    EXPECT_EQ(report.failed, 1u);
+    EXPECT_GT(report.instructions, 0u);
+    EXPECT_EQ(report.results[2].status, JOB_TIMEOUT);
+    EXPECT_EQ(report.results[3].error, "could not open batch_test/missing.cow");
+
+    auto slurp = [](const char* path) {
+        std::ifstream in(path);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(slurp("batch_test/out1.txt"), "5");
+    EXPECT_EQ(slurp("batch_test/out2.txt"), "42");
+
+    std::filesystem::remove_all("batch_test");
+}
+
+TEST(BatchTest, AsyncJobReadsFifoAsItFills) {
+    std::filesystem::create_directories("batch_async");
+    std::ofstream("batch_async/add.cow") << "oom moO oom MOO MOo mOo MoO moO moo mOo OOM";
+    std::ofstream("batch_async/in.txt") << "40\n2\n";
+    ASSERT_EQ(::mkfifo("batch_async/in.fifo", 0600), 0);
+
+    std::vector<BatchJob> jobs = {
+        {"batch_async/add.cow", "batch_async/in.fifo", "batch_async/out1.txt"},
+        {"batch_async/add.cow", "batch_async/in.txt", "batch_async/out2.txt"},
+    };
+    // Писатель открывает FIFO, когда его уже открыл run_async, и подает
+    // числа порциями с паузой: задание ждет ввода в epoll, а не в read()
+    std::thread writer([] {
+        int fd = ::open("batch_async/in.fifo", O_WRONLY);
+        ASSERT_GE(fd, 0);
+        EXPECT_EQ(::write(fd, "2", 1), 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_EQ(::write(fd, "\n3\n", 3), 3);
+        ::close(fd);
+    });
+    BatchRunner runner(1, std::chrono::milliseconds(0));
+    BatchReport report = runner.run_async(jobs);
+    writer.join();
+
+    EXPECT_EQ(report.ok, 2u);
+    auto slurp = [](const char* path) {
+        std::ifstream in(path);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(slurp("batch_async/out1.txt"), "5");
+    EXPECT_EQ(slurp("batch_async/out2.txt"), "42");
+
+    std::filesystem::remove_all("batch_async");
+}
+
+TEST(AsyncTest, VmSuspendsUntilInputArrives) {
+    int out[2];
+    ASSERT_EQ(::pipe(out), 0);
+    AsyncIO io(out[1]);
+    CowVM vm({ .io = &io });
+    // Читает два числа и печатает сумму
+    vm.load(CowProgram("oom moO oom MOO MOo mOo MoO moO moo mOo OOM"));
+
+    RunBudget budget;
+    budget.suspend_on_input = true;
+    EXPECT_EQ(vm.run(budget), RUN_WAITING_INPUT);
+    EXPECT_EQ(vm.instructions_executed(), 0u);
+    EXPECT_FALSE(io.can_read_int());
+
+    // Число без перевода строки еще не готово
+    io.feed("4");
+    EXPECT_TRUE(io.can_read_char());
+    EXPECT_FALSE(io.can_read_int());
+    EXPECT_EQ(vm.run(budget), RUN_WAITING_INPUT);
+    io.feed("0\n 2");
+    EXPECT_EQ(vm.run(budget), RUN_WAITING_INPUT);
+    EXPECT_GT(vm.instructions_executed(), 0u);
+    io.feed("\n");
+    EXPECT_EQ(vm.run(budget), RUN_FINISHED);
+
+    io.flush();
+    char text[16] = {};
+    EXPECT_EQ(::read(out[0], text, sizeof(text)), 2);
+    EXPECT_STREQ(text, "42");
+    ::close(out[0]);
+    ::close(out[1]);
+}
+
+TEST(AsyncTest, PoolMultiplexesSessionsOnOneWorker) {
+    CowProgram add("oom moO oom MOO MOo mOo MoO moO moo mOo OOM");
+    std::vector<std::array<int, 2>> in(3), out(3);
+    SessionPool pool(1, std::chrono::milliseconds(100));
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        ASSERT_EQ(::pipe(in[i].data()), 0);
+        ASSERT_EQ(::pipe(out[i].data()), 0);
+        EXPECT_EQ(pool.add(add, in[i][0], out[i][1]), i);
+    }
+    // Бесконечный цикл без ввода делит единственный поток с остальными
+    // и снимается по лимиту времени
+    std::size_t spinner = pool.add(CowProgram("MoO MOO moo"), -1, -1);
+
+    std::thread runner([&] { EXPECT_TRUE(pool.run()); });
+    // Ввод приходит в обратном порядке и порциями
+    for (std::size_t k = in.size(); k-- > 0;) {
+        std::string first = std::to_string(k) + "\n";
+        EXPECT_EQ(::write(in[k][1], first.data(), first.size()), static_cast<ssize_t>(first.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        EXPECT_EQ(::write(in[k][1], "10\n", 3), 3);
+        ::close(in[k][1]);
+    }
+    runner.join();
+
+    EXPECT_EQ(pool.result(spinner).status, RUN_OUT_OF_TIME);
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        EXPECT_EQ(pool.result(i).status, RUN_FINISHED);
+        char text[16] = {};
+        EXPECT_GT(::read(out[i][0], text, sizeof(text)), 0);
+        EXPECT_EQ(std::string(text), std::to_string(i + 10));
+        ::close(in[i][0]);
+        ::close(out[i][0]);
+        ::close(out[i][1]);
+    }
+}
+
+TEST(BenchTest, SyntheticProgramsTerminate) {
+    // 2 + 4 + 8 проходов по уровням вложенности
+    CowProgram nesting(deep_nesting_program(3));
+    EXPECT_GT(count_instructions(nesting, ""), 14u);
+
+    for (const std::string& source : { inc_runs_program(10), exec_cell_program(10) }) {
+        CowVM vm;
+        vm.load(CowProgram(source));
+        EXPECT_EQ(vm.run({ .max_instructions = 100000 }), RUN_FINISHED);
+    }
+}
+
+TEST(BenchTest, MeasuresInChildProcess) {
+    CowProgram program("MoO MoO MoO MOO OOM MOo moo");
+    for (Engine engine : available_engines()) {
+        std::uint64_t wall_ns = 0;
+        long rss = 0;
+        ASSERT_TRUE(measure(program, "", engine, wall_ns, rss)) << engine_name(engine);
+        EXPECT_GT(wall_ns, 0u);
+        EXPECT_GT(rss, 0);
+    }
+
+    BenchResult result{"a\"b", ENGINE_SWITCH, 10, 20, 30, true};
+    std::ostringstream json;
+    print_json(json, {result});
+    EXPECT_THAT(json.str(), ::testing::HasSubstr(
+        "{\"program\": \"a\\\"b\", \"engine\": \"switch\", \"ok\": true, \"instructions\": 10, \"wall_ns\": 20, "
+        "\"instr_per_sec\": 5e+08, \"ns_per_instr\": 2, \"peak_rss_kb\": 30}"));
+}
+
+TEST(ProfileTest, SourceMapFollowsFoldingAndIdioms) {
+    //                     0   4   8   12  16  20  24  28
+    std::string_view src = "MoO MoO MOO MOo moo moO xx OOM";
+    std::vector<std::size_t> offsets;
+    std::vector<Instr> program = compile_source(src, RunOptions{}, &offsets);
+    // ADD 2 (с 0), SET 0 на месте цикла (с 8), SHIFT 1 (с 20), OOM (с 27)
+    ASSERT_EQ(program.size(), 4u);
+    EXPECT_EQ(program[1].op, OP_SET);
+    EXPECT_EQ(offsets, (std::vector<std::size_t>{0, 8, 20, 27}));
+
+    // Для вектора команд смещения - номера команд
+    std::vector<std::size_t> indices;
+    compile({ OP_INC, OP_INC, OP_PRINT_INT, OP_MOVE_RIGHT }, RunOptions{}, &indices);
+    EXPECT_EQ(indices, (std::vector<std::size_t>{0, 2, 3}));
+}
+
+TEST(ProfileTest, CountsInstructionsLoopsAndExecCell) {
+    // 3 итерации цикла, в теле mOO на ячейке с кодом MoO
+    std::vector<Instr> program = {
+        {OP_ADD, 3, 0}, {OP_SHIFT, 1, 0}, {OP_ADD, 6, 0}, {OP_SHIFT, -1, 0},
+        {OP_LOOP_START, 0, 0}, {OP_SHIFT, 1, 0}, {OP_EXEC_CELL, 0, 0}, {OP_ADD, -1, 0},
+        {OP_SHIFT, -1, 0}, {OP_ADD, -1, 0}, {OP_LOOP_END, 0, 0}
+    };
+    link_loops(program);
+    VMState state;
+    Profiler profiler(program.size());
+    std::size_t ip = 0;
+    run_slice(std::span<const Instr>(program), state, ip, 1000, profiler);
+
+    EXPECT_EQ(profiler.counts()[0], 1u);
+    EXPECT_EQ(profiler.counts()[4], 3u); // вход + 2 возврата
+    EXPECT_EQ(profiler.counts()[6], 3u);
+    EXPECT_EQ(profiler.back_edges()[10], 2u);
+    EXPECT_EQ(profiler.exec_targets()[OP_INC + 1], 3u);
+
+    std::ostringstream report;
+    print_profile(report, profiler, program, nullptr);
+    EXPECT_THAT(report.str(), ::testing::HasSubstr("=== profile: 25 IR instructions executed ==="));
+    EXPECT_THAT(report.str(), ::testing::HasSubstr("  #4 -> #10"));
+    EXPECT_THAT(report.str(), ::testing::HasSubstr("  -> MoO: 3"));
+}
+
+TEST(MainTest, ProfileFlagReportsToStderr) {
+    std::ofstream f("profile.cow");
+    f << "MoO MoO\nMOO OOM MOo moo";
+    f.close();
+
+    std::stringstream err;
+    std::streambuf* old = std::cerr.rdbuf(err.rdbuf());
+    char* argv[] = { (char*)"./cow", (char*)"--profile", (char*)"profile.cow" };
+    MemoryIO io;
+    int rc = cow_main(3, argv, &io);
+    std::cerr.rdbuf(old);
+
+    EXPECT_EQ(rc, 0);
+    EXPECT_EQ(io.output(), "21");
+    // OOM во второй строке, 5-й столбец; исполнен дважды из 9 инструкций
+    EXPECT_THAT(err.str(), ::testing::HasSubstr("2  22.22  OOM         2:5 @12"));
+    EXPECT_THAT(err.str(), ::testing::HasSubstr("1              1  2:1 @8 -> 2:13 @20"));
+    remove("profile.cow");
+}
+
+TEST(ExecCellTest, TableMatchesDirectCommands) {
+    // mOO на ячейке со значением v делает то же, что команда v (кроме скобок и mOO)
+    for (int v = -2; v <= OP_GUARD + 1; ++v) {
+        VMState direct, indirect;
+        MemoryIO direct_io("x7\n"), indirect_io("x7\n");
+        direct.io = &direct_io;
+        indirect.io = &indirect_io;
+        direct.mem_ptr = indirect.mem_ptr = 5;
+        direct.memory[5] = indirect.memory[5] = v;
+
+        exec_cell(indirect);
+        if (v >= 0 && v <= OP_READ_INT && v != OP_EXEC_CELL) exec_single_op(v, direct);
+
+        EXPECT_EQ(indirect.mem_ptr, direct.mem_ptr) << v;
+        EXPECT_EQ(indirect.memory[indirect.mem_ptr], direct.memory[direct.mem_ptr]) << v;
+        EXPECT_EQ(indirect.reg_val, direct.reg_val) << v;
+        EXPECT_EQ(indirect_io.output(), direct_io.output()) << v;
+    }
+}
+
+TEST(ExecCellTest, EnginesAgreeOnEveryCellValue) {
+    // Для каждого кода: записать его в ячейку, исполнить mOO, напечатать ячейку и соседей
+    for (int v = 0; v <= OP_GUARD; ++v) {
+        std::vector<int> prog = { OP_MOVE_RIGHT, OP_MOVE_RIGHT };
+        prog.insert(prog.end(), v, OP_INC);
+        prog.insert(prog.end(), { OP_EXEC_CELL, OP_EXEC_CELL, OP_PRINT_INT, OP_MOVE_LEFT, OP_PRINT_INT,
+                                  OP_MOVE_RIGHT, OP_MOVE_RIGHT, OP_PRINT_INT });
+        std::string expected = run_with_engine(prog, ENGINE_SWITCH, "5\nq");
+        EXPECT_EQ(run_with_engine(prog, ENGINE_THREADED, "5\nq"), expected) << v;
+#ifdef COW_HAS_JIT
+        EXPECT_EQ(run_with_engine(prog, ENGINE_JIT, "5\nq"), expected) << v;
+#endif
+    }
+}
+
+TEST(SuperoptTest, CountsWeightedNgramsWithoutBrackets) {
+    std::vector<Instr> program = {
+        {OP_ADD, 1, 0}, {OP_SHIFT, 1, 0}, {OP_LOOP_START, 0, 0}, {OP_SHIFT, 1, 0}, {OP_PRINT_INT, 0, 0},
+        {OP_ADD, 1, 0}, {OP_LOOP_END, 0, 0}
+    };
+    std::vector<std::uint64_t> counts = { 1, 1, 5, 5, 5, 5, 5 };
+    std::map<Ngram, std::uint64_t> ngrams;
+    count_ngrams(program, counts, 3, ngrams);
+
+    EXPECT_EQ((ngrams[{OP_ADD, OP_SHIFT}]), 1u);
+    EXPECT_EQ((ngrams[{OP_SHIFT, OP_PRINT_INT, OP_ADD}]), 5u);
+    EXPECT_EQ((ngrams[{OP_PRINT_INT, OP_ADD}]), 5u);
+    // Скобки в серию не входят
+    EXPECT_EQ(ngrams.count({OP_SHIFT, OP_LOOP_START}), 0u);
+
+    std::vector<NgramScore> best = select_superinstructions(ngrams, 2);
+    ASSERT_EQ(best.size(), 2u);
+    EXPECT_EQ(best[0].ops, (Ngram{OP_SHIFT, OP_PRINT_INT, OP_ADD})); // 10 переходов
+    EXPECT_EQ(best[1].ops.size(), 2u);
+
+    std::string header = emit_superinstructions(best, 42);
+    EXPECT_THAT(header, ::testing::HasSubstr("{3, {OP_SHIFT, OP_PRINT_INT, OP_ADD}}"));
+    EXPECT_THAT(header, ::testing::HasSubstr("    exec_shift(ip[0].arg, state);\n    op_print_int(state);\n"
+                                             "    exec_add(ip[2].arg, state);\n    ip += 3;\n"));
+}
+
+TEST(SuperoptTest, GeneratedHandlersMatchSwitch) {
+    // Каждый сгенерированный шаблон - отдельной программой на обоих движках
+    for (const SuperPattern& pattern : SUPER_PATTERNS) {
+        std::vector<Instr> program = { {OP_ADD, 4, 0}, {OP_SHIFT, 2, 0}, {OP_ADD, 3, 0} };
+        for (std::size_t k = 0; k < pattern.length; ++k) program.push_back({pattern.ops[k], 1 + static_cast<int>(k), 1});
+        program.insert(program.end(), { {OP_PRINT_INT, 0, 0}, {OP_SHIFT, -1, 0}, {OP_PRINT_INT, 0, 0},
+                                        {OP_SHIFT, 2, 0}, {OP_PRINT_INT, 0, 0} });
+
+        VMState a, b;
+        MemoryIO io_a("12\nz"), io_b("12\nz");
+        a.io = &io_a;
+        b.io = &io_b;
+        run_switch(std::span<const Instr>(program), a);
+#ifdef COW_HAS_COMPUTED_GOTO
+        run_threaded(std::span<const Instr>(program), b);
+#else
+        run_switch(std::span<const Instr>(program), b);
+#endif
+        EXPECT_EQ(io_a.output(), io_b.output());
+        EXPECT_EQ(a.mem_ptr, b.mem_ptr);
+    }
+}
+
+TEST(TapeBoundsTest, BalancedLoopsGiveStaticExtent) {
+    RunOptions options;
+    options.idioms = false;
+    // MoO MoO MOO [moO moO MoO mOo mOo MOo] moo: тело возвращается на место
+    std::vector<Instr> program = compile_source("MoO MoO MOO moO moO MoO mOo mOo MOo moo moO", options);
+    TapeBounds bounds = analyze_tape(program);
+    ASSERT_TRUE(bounds.bounded);
+    EXPECT_EQ(bounds.max_cell, 2u);
+    EXPECT_TRUE(bounds.loops[1].balanced);
+    EXPECT_EQ(bounds.loops[1].min_offset, 0);
+    EXPECT_EQ(bounds.loops[1].max_offset, 2);
+
+    // ADD_MUL вправо тоже расширяет ленту
+    TapeBounds add_mul = analyze_tape(std::vector<Instr>{ {OP_SHIFT, 3, 0}, {OP_ADD_MUL, 5, 2} });
+    ASSERT_TRUE(add_mul.bounded);
+    EXPECT_EQ(add_mul.max_cell, 8u);
+}
+
+TEST(TapeBoundsTest, UnbalancedLoopsAreUnbounded) {
+    RunOptions options;
+    options.idioms = false;
+    // Каждый проход сдвигает указатель вправо
+    TapeBounds drifting = analyze_tape(compile_source("MoO MOO moO MoO moo", options));
+    EXPECT_FALSE(drifting.bounded);
+    EXPECT_FALSE(drifting.loops[1].balanced);
+    // mOO внутри цикла может исполнить moO
+    EXPECT_FALSE(analyze_tape(compile_source("MoO MOO mOO moo", options)).bounded);
+    // В нулевой ячейке mOo упирается в ноль, и moO уводит указатель вправо
+    TapeBounds clamped = analyze_tape(compile_source("MoO MOO mOo moO moo", options));
+    EXPECT_TRUE(clamped.loops[1].balanced);
+    EXPECT_FALSE(clamped.bounded);
+    // Поиск нуля вправо
+    EXPECT_FALSE(analyze_tape(std::vector<Instr>{ {OP_SCAN, 1, 0} }).bounded);
+}
+
+TEST(TapeBoundsTest, PreallocatedTapeMatchesGrowingTape) {
+    // Сбалансированный цикл уходит за INITIAL_TAPE_SIZE и возвращается
+    std::string source = "MoO MoO MoO MOO " + repeat("moO", 25000) + "MoO MoO OOM " +
+                         repeat("mOo", 25000) + "MOo moo " + repeat("moO", 25000) + "OOM";
+    std::vector<Instr> program = compile_source(source, RunOptions{});
+    TapeBounds bounds = analyze_tape(program);
+    ASSERT_TRUE(bounds.bounded);
+    EXPECT_EQ(bounds.max_cell, 25000u);
+
+    MemoryIO growing_io;
+    VMState growing;
+    growing.io = &growing_io;
+    run_switch(program, growing);
+    EXPECT_EQ(growing_io.output(), "2466");
+
+    for (Engine engine : available_engines()) {
+        std::vector<int> commands = parse(source);
+        EXPECT_EQ(run_with_engine(commands, engine), "2466") << engine_name(engine);
+    }
+
+    MemoryIO io;
+    CowVM vm({ .io = &io });
+    vm.load(CowProgram(source));
+    while (vm.run({ .max_instructions = 7 }) == RUN_OUT_OF_BUDGET) {}
+    EXPECT_EQ(io.output(), "2466");
+    EXPECT_GE(vm.state().memory.size(), bounds.tape_size());
+    EXPECT_EQ(vm.state().mem_ptr, 25000u);
+}
+
+TEST(SnapshotTest, TapeIsStoredSparsely) {
+    VMState state;
+    state.memory.resize(1 << 20);
+    state.memory[3] = 7;
+    state.memory[5] = -1; // промежуток короче SNAPSHOT_MAX_GAP остается в серии
+    state.memory[500000] = 42;
+    state.mem_ptr = 500000;
+    state.reg_val = 9;
+
+    std::vector<Instr> program = { {OP_ADD, 1, 0} };
+    std::string data = serialize_snapshot(program, state, { 1, 1, 0, 0 });
+    EXPECT_EQ(data.size(), sizeof(SnapshotHeader) + 2 * 16 + 4 * sizeof(int));
+
+    SnapshotView snapshot;
+    ASSERT_TRUE(snapshot.load(data)) << snapshot.error();
+    EXPECT_EQ(snapshot.header().run_count, 2u);
+    EXPECT_TRUE(snapshot.matches(program));
+
+    VMState restored;
+    snapshot.restore(restored);
+    EXPECT_EQ(restored.memory[3], 7);
+    EXPECT_EQ(restored.memory[4], 0);
+    EXPECT_EQ(restored.memory[5], -1);
+    EXPECT_EQ(restored.memory[500000], 42);
+    EXPECT_EQ(restored.mem_ptr, 500000u);
+    EXPECT_EQ(restored.reg_val, 9);
+
+    // Обрезанный или чужой снимок не принимается
+    EXPECT_FALSE(SnapshotView().load(data.substr(0, data.size() - 1)));
+    EXPECT_FALSE(snapshot.matches(std::vector<Instr>{ {OP_ADD, 2, 0} }));
+}
+
+TEST(SnapshotTest, ResumedRunContinuesInputAndOutput) {
+    // Эхо: читает символ и печатает его, пока ввод не кончится
+    CowProgram program("MoO MOO OOO Moo Moo moo");
+    const std::string input = "hello, snapshot";
+
+    MemoryIO first_io(input);
+    CowVM first({ .io = &first_io });
+    first.load(program);
+    EXPECT_EQ(first.run({ .max_instructions = 23 }), RUN_OUT_OF_BUDGET);
+    std::string data = first.snapshot();
+    std::string before = first_io.output();
+    EXPECT_FALSE(before.empty());
+
+    SnapshotView snapshot;
+    ASSERT_TRUE(snapshot.load(data));
+    EXPECT_EQ(snapshot.header().output_offset, before.size());
+
+    MemoryIO second_io(input);
+    CowVM second({ .io = &second_io });
+    second.load(program);
+    std::string error;
+    ASSERT_TRUE(second.restore(snapshot, error)) << error;
+    EXPECT_EQ(second.instructions_executed(), 23u);
+    EXPECT_EQ(second.run(), RUN_FINISHED);
+    EXPECT_EQ(before + second_io.output(), input);
+
+    // Снимок второй машины считает вывод с начала прогона
+    SnapshotView final_snapshot;
+    ASSERT_TRUE(final_snapshot.load(second.snapshot()));
+    EXPECT_EQ(final_snapshot.header().output_offset, input.size());
+
+    CowVM other;
+    other.load(CowProgram("MoO OOM"));
+    EXPECT_FALSE(other.restore(snapshot, error));
+}
+
+TEST(MainTest, CheckpointFlags) {
+    std::ofstream f("echo.cow");
+    f << "MoO MOO OOO Moo Moo moo";
+    f.close();
+
+    // Снимок на середине прогона, как если бы процесс упал после него
+    CowProgram program("MoO MOO OOO Moo Moo moo");
+    MemoryIO crashed_io("abcdef");
+    CowVM crashed({ .io = &crashed_io });
+    crashed.load(program);
+    crashed.run({ .max_instructions = 13 });
+    ASSERT_TRUE(write_snapshot_file("echo.snap", crashed.snapshot()));
+    std::string before = crashed_io.output();
+
+    MemoryIO io("abcdef");
+    char* argv[] = { (char*)"./cow", (char*)"--checkpoint=echo.snap", (char*)"--checkpoint-every=5",
+                     (char*)"--resume", (char*)"echo.cow" };
+    EXPECT_EQ(cow_main(5, argv, &io), 0);
+    EXPECT_EQ(before + io.output(), "abcdef");
+    // Завершенный прогон удаляет снимок
+    EXPECT_FALSE(std::filesystem::exists("echo.snap"));
+
+    IORedirect err("");
+    char* bad_argv[] = { (char*)"./cow", (char*)"--resume", (char*)"echo.cow" };
+    EXPECT_EQ(cow_main(3, bad_argv), 1);
+    char* paged_argv[] = { (char*)"./cow", (char*)"--checkpoint=echo.snap", (char*)"--tape=paged", (char*)"echo.cow" };
+    EXPECT_EQ(cow_main(4, paged_argv), 1);
+
+    remove("echo.cow");
+}
+
+TEST(TraceTest, RingKeepsOrderAcrossThreads) {
+    // Кольцо меньше потока записей: писатель обгоняет читателя и ждет его
+    SpscRing<int> ring(8);
+    constexpr int total = 100000;
+    std::thread producer([&] {
+        for (int i = 0; i < total; ++i) ring.push(i);
+    });
+    int expected = 0;
+    bool ordered = true;
+    while (expected < total) {
+        if (ring.drain([&](int value) { ordered &= (value == expected++); }) == 0) std::this_thread::yield();
+    }
+    producer.join();
+    EXPECT_TRUE(ordered);
+}
+
+TEST(TraceTest, SwitchAndThreadedTracesMatch) {
+    std::ofstream f("trace.cow");
+    // Цикл, ввод, mOO (ячейка 6 - MoO) и сдвиг влево от нуля
+    f << "oom MOO MOo moO MoO MoO mOo moo moO mOO OOM mOo mOo OOM";
+    f.close();
+
+    for (const char* engine : {"--engine=switch", "--engine=threaded"}) {
+        MemoryIO io("3\n");
+        std::string trace = std::string("--trace=") + (engine[9] == 's' ? "switch" : "threaded") + ".cowt";
+        char* argv[] = { (char*)"./cow", (char*)engine, trace.data(), (char*)"trace.cow" };
+        EXPECT_EQ(cow_main(4, argv, &io), 0);
+        EXPECT_EQ(io.output(), "70");
+    }
+
+    MappedFile file("switch.cowt");
+    TraceReader reader;
+    ASSERT_TRUE(reader.load(file.view())) << reader.error();
+    TraceRecord first;
+    ASSERT_TRUE(reader.next(first));
+    EXPECT_EQ(first.ip, 0u);
+    EXPECT_EQ(first.op, OP_READ_INT);
+    EXPECT_NE(reader.header().count, TRACE_COUNT_UNKNOWN);
+
+    IORedirect out("");
+    char* diff_argv[] = { (char*)"./cow_trace", (char*)"diff", (char*)"switch.cowt", (char*)"threaded.cowt" };
+    EXPECT_EQ(cow_trace_main(4, diff_argv), 0);
+
+    remove("trace.cow");
+    remove("switch.cowt");
+    remove("threaded.cowt");
+}
+
+TEST(TraceTest, DiffReportsFirstDivergence) {
+    std::ofstream f("wrap.cow");
+    f << "MOo moO MoO mOo OOM";
+    f.close();
+
+    // В u8 уменьшение нуля дает 255, в i32 - -1
+    for (const char* cell : {"--cell=i32", "--cell=u8"}) {
+        MemoryIO io;
+        std::string trace = std::string("--trace=") + (cell[7] == 'u' ? "u8" : "i32") + ".cowt";
+        char* argv[] = { (char*)"./cow", (char*)"--engine=switch", (char*)cell, trace.data(), (char*)"wrap.cow" };
+        EXPECT_EQ(cow_main(5, argv, &io), 0);
+    }
+
+    MappedFile file_a("i32.cowt"), file_b("u8.cowt");
+    TraceReader a, b;
+    ASSERT_TRUE(a.load(file_a.view()));
+    ASSERT_TRUE(b.load(file_b.view()));
+    TraceDiff diff = diff_traces(a, b);
+    EXPECT_FALSE(diff.same);
+    EXPECT_EQ(diff.index, 1u); // SHIFT после MOo уже видит разную ячейку
+    ASSERT_EQ(diff.context.size(), 1u);
+    ASSERT_TRUE(diff.a && diff.b);
+    EXPECT_EQ(diff.a->cell, -1);
+    EXPECT_EQ(diff.b->cell, 255);
+
+    IORedirect out("");
+    char* diff_argv[] = { (char*)"./cow_trace", (char*)"diff", (char*)"i32.cowt", (char*)"u8.cowt" };
+    EXPECT_EQ(cow_trace_main(4, diff_argv), 1);
+    EXPECT_THAT(out.getOutput(), ::testing::HasSubstr("traces diverge at record 1"));
+
+    remove("wrap.cow");
+    remove("i32.cowt");
+    remove("u8.cowt");
+}
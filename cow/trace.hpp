@@ -0,0 +1,368 @@
+#pragma once
+
+// Трасса исполнения (--trace=<file>) для поиска расхождений между движками.
+//
+// Tracer подставляется в run_slice или run_threaded вместо NoHooks и перед
+// каждой инструкцией кладет запись (ip, op, mem_ptr, ячейка) в кольцевой
+// буфер без блокировок. Исполняющий поток только пишет в кольцо, отдельный
+// поток забирает записи, сжимает и пишет в файл; исполнитель ждет, только
+// если писатель отстал на все кольцо.
+//
+//   TraceHeader                 32 байта
+//   записи[count]               op (1 байт) и три zigzag-varint'а:
+//                               ip - (предыдущий ip + 1), сдвиг mem_ptr, ячейка
+//
+// Обычно запись занимает 4 байта вместо 24. Скобки не пишутся: движки
+// проходят их по-разному (шитый код прыгает сразу за парную скобку), а
+// решение цикла видно по ip следующей записи. Поэтому трассы switch и
+// threaded одной программы совпадают, и cow_trace diff находит первую
+// запись, где движки разошлись.
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vm.hpp"
+#include "bytecode.hpp"
+
+constexpr char TRACE_MAGIC[8] = {'\x7F', 'C', 'O', 'W', 'T', 'R', '\r', '\n'};
+constexpr uint32_t TRACE_VERSION = 1;
+// Трасса не закрыта (процесс упал): читаем записи до конца файла
+constexpr uint64_t TRACE_COUNT_UNKNOWN = ~uint64_t{0};
+constexpr std::size_t TRACE_RING_CAPACITY = std::size_t{1} << 16;
+// Столько сжатых байт писатель копит перед write()
+constexpr std::size_t TRACE_FLUSH_SIZE = std::size_t{1} << 16;
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t program_hash;
+    uint64_t count;
+};
+
+static_assert(sizeof(TraceHeader) == 32, "TraceHeader layout is part of the file format");
+
+// Состояние машины перед исполнением инструкции ip
+struct TraceRecord {
+    uint64_t mem_ptr = 0;
+    int64_t cell = 0;
+    uint32_t ip = 0;
+    int32_t op = 0;
+
+    bool operator==(const TraceRecord&) const = default;
+};
+
+// Кольцо для одного писателя и одного читателя. Индексы только растут, ячейка
+// буфера - индекс по модулю емкости. Каждый индекс меняет только его владелец,
+// так что хватает пары acquire/release на пачку записей.
+template <typename T>
+class SpscRing {
+public:
+    // Емкость округляется вверх до степени двойки
+    explicit SpscRing(std::size_t capacity)
+        : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1), buffer_(new T[mask_ + 1]) {}
+
+    // Только писатель. Ждет, пока читатель освободит место
+    void push(const T& item) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_) {
+            while (head - (tail_cache_ = tail_.load(std::memory_order_acquire)) > mask_) std::this_thread::yield();
+        }
+        buffer_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Только читатель. Отдает consume все готовые записи; возвращает их число
+    template <typename Consume>
+    std::size_t drain(Consume&& consume) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load(std::memory_order_acquire);
+        for (std::size_t i = tail; i != head; ++i) consume(buffer_[i & mask_]);
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+private:
+    const std::size_t mask_;
+    std::unique_ptr<T[]> buffer_;
+    // Индексы на разных строках кэша, чтобы потоки не толкались за одну строку
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0; // последний увиденный писателем tail_
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+namespace trace_format {
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool get_varint(std::string_view data, std::size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+        auto byte = static_cast<unsigned char>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+} // namespace trace_format
+
+class Tracer {
+public:
+    explicit Tracer(std::size_t ring_capacity = TRACE_RING_CAPACITY) : ring_(ring_capacity) {}
+    ~Tracer() { close(); }
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // false - файл не создать
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) return false;
+        TraceHeader header = make_header(TRACE_COUNT_UNKNOWN);
+        buffer_.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+        return true;
+    }
+
+    // Запускает писателя; program - IR, который будет исполняться
+    void start(std::span<const Instr> program) {
+        program_ = program;
+        program_hash_ = hash_program(program);
+        if (fd_ < 0 || writer_.joinable()) return;
+        // Заголовок еще в буфере: хэш попадет в файл, даже если close() не дойдет
+        TraceHeader header = make_header(TRACE_COUNT_UNKNOWN);
+        std::memcpy(buffer_.data(), &header, sizeof(header));
+        writer_ = std::thread([this] { write_loop(); });
+    }
+
+    template <typename State>
+    void on_instr(std::size_t ip, State& state) {
+        int op = program_[ip].op;
+        if (op == OP_LOOP_START || op == OP_LOOP_END) return;
+        ring_.push({static_cast<uint64_t>(state.mem_ptr), static_cast<int64_t>(state.memory[state.mem_ptr]),
+                    static_cast<uint32_t>(ip), op});
+    }
+    void on_back_edge(std::size_t) {}
+    template <typename State>
+    void on_exec_cell(State&) {}
+
+    // Дожидается писателя и дописывает заголовок; false - трасса записана не полностью
+    bool close() {
+        if (fd_ < 0) return ok_;
+        if (writer_.joinable()) {
+            done_.store(true, std::memory_order_release);
+            writer_.join();
+        }
+        flush();
+        TraceHeader header = make_header(count_);
+        ok_ = ok_ && ::pwrite(fd_, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        ok_ = (::close(fd_) == 0) && ok_;
+        fd_ = -1;
+        return ok_;
+    }
+
+    // Записей в файле; читать после close()
+    uint64_t count() const { return count_; }
+
+private:
+    SpscRing<TraceRecord> ring_;
+    std::span<const Instr> program_;
+    uint64_t program_hash_ = 0;
+    int fd_ = -1;
+    bool ok_ = true;
+    std::thread writer_;
+    std::atomic<bool> done_{false};
+
+    // Дальше - только поток-писатель (и close после join)
+    std::string buffer_;
+    uint64_t count_ = 0;
+    uint32_t next_ip_ = 0;
+    uint64_t mem_ptr_ = 0;
+
+    TraceHeader make_header(uint64_t count) const {
+        TraceHeader header{};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.program_hash = program_hash_;
+        header.count = count;
+        return header;
+    }
+
+    void write_loop() {
+        for (;;) {
+            // done_ читается до drain: после него в кольце уже все записи
+            bool done = done_.load(std::memory_order_acquire);
+            std::size_t taken = ring_.drain([this](const TraceRecord& record) { encode(record); });
+            if (buffer_.size() >= TRACE_FLUSH_SIZE) flush();
+            if (taken == 0) {
+                if (done) return;
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    void encode(const TraceRecord& record) {
+        using namespace trace_format;
+        buffer_.push_back(static_cast<char>(record.op));
+        put_varint(buffer_, zigzag(static_cast<int64_t>(record.ip) - static_cast<int64_t>(next_ip_)));
+        put_varint(buffer_, zigzag(static_cast<int64_t>(record.mem_ptr - mem_ptr_)));
+        put_varint(buffer_, zigzag(record.cell));
+        next_ip_ = record.ip + 1;
+        mem_ptr_ = record.mem_ptr;
+        ++count_;
+    }
+
+    void flush() {
+        const char* p = buffer_.data();
+        std::size_t left = buffer_.size();
+        while (ok_ && left > 0) {
+            ssize_t put = ::write(fd_, p, left);
+            if (put < 0 && errno == EINTR) continue;
+            ok_ = put > 0;
+            if (ok_) {
+                p += put;
+                left -= static_cast<std::size_t>(put);
+            }
+        }
+        buffer_.clear();
+    }
+};
+
+// Последовательное чтение трассы; данные принадлежат вызывающему
+class TraceReader {
+public:
+    // false - не трасса или другая версия; причина в error()
+    bool load(std::string_view data) {
+        if (data.size() < sizeof(TraceHeader) || std::memcmp(data.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+            return fail("not a COW trace");
+        }
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (header_.version != TRACE_VERSION) return fail("unsupported trace version");
+        data_ = data;
+        pos_ = sizeof(TraceHeader);
+        return true;
+    }
+
+    // false - записи кончились или трасса повреждена (тогда error() не пуст)
+    bool next(TraceRecord& record) {
+        using namespace trace_format;
+        bool closed = header_.count != TRACE_COUNT_UNKNOWN;
+        if (closed && read_ == header_.count) {
+            if (pos_ != data_.size()) fail("trailing data in trace");
+            return false;
+        }
+        if (pos_ == data_.size()) {
+            if (closed) fail("truncated trace");
+            return false;
+        }
+
+        auto op = static_cast<unsigned char>(data_[pos_++]);
+        uint64_t ip, mem_ptr, cell;
+        if (op > OP_GUARD) return fail("invalid opcode in trace");
+        if (!get_varint(data_, pos_, ip) || !get_varint(data_, pos_, mem_ptr) || !get_varint(data_, pos_, cell)) {
+            return fail("truncated trace");
+        }
+        record.op = op;
+        record.ip = static_cast<uint32_t>(next_ip_ + unzigzag(ip));
+        record.mem_ptr = mem_ptr_ + static_cast<uint64_t>(unzigzag(mem_ptr));
+        record.cell = unzigzag(cell);
+        next_ip_ = static_cast<int64_t>(record.ip) + 1;
+        mem_ptr_ = record.mem_ptr;
+        ++read_;
+        return true;
+    }
+
+    const TraceHeader& header() const { return header_; }
+    // Сколько записей уже прочитано
+    uint64_t position() const { return read_; }
+    const std::string& error() const { return error_; }
+
+private:
+    TraceHeader header_{};
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    uint64_t read_ = 0;
+    int64_t next_ip_ = 0;
+    uint64_t mem_ptr_ = 0;
+    std::string error_;
+
+    bool fail(const char* reason) {
+        error_ = reason;
+        return false;
+    }
+};
+
+struct TraceDiff {
+    bool same = true;
+    // Номер первой несовпавшей записи
+    uint64_t index = 0;
+    // nullopt - трасса кончилась раньше другой
+    std::optional<TraceRecord> a;
+    std::optional<TraceRecord> b;
+    // Последние совпавшие записи перед расхождением
+    std::vector<TraceRecord> context;
+    std::string error;
+};
+
+// Сравнивает трассы по записям до первого расхождения
+inline TraceDiff diff_traces(TraceReader& a, TraceReader& b, std::size_t context_size = 4) {
+    TraceDiff diff;
+    if (a.header().program_hash != b.header().program_hash) {
+        diff.same = false;
+        diff.error = "traces are from different programs (compare runs with the same --no-idioms setting)";
+        return diff;
+    }
+
+    std::deque<TraceRecord> context;
+    for (;;) {
+        TraceRecord ra, rb;
+        bool has_a = a.next(ra);
+        bool has_b = b.next(rb);
+        if (!a.error().empty() || !b.error().empty()) {
+            diff.same = false;
+            diff.error = !a.error().empty() ? a.error() : b.error();
+            return diff;
+        }
+        if (!has_a && !has_b) return diff;
+        if (has_a != has_b || !(ra == rb)) {
+            diff.same = false;
+            diff.index = has_a ? a.position() - 1 : b.position() - 1;
+            if (has_a) diff.a = ra;
+            if (has_b) diff.b = rb;
+            diff.context.assign(context.begin(), context.end());
+            return diff;
+        }
+        context.push_back(ra);
+        if (context.size() > context_size) context.pop_front();
+    }
+}
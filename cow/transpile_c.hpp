@@ -0,0 +1,212 @@
+#pragma once
+
+// Трансляция IR в самостоятельную единицу трансляции на C (режим cow2c).
+// Циклы становятся while, свёрнутые серии - +=, остальные команды идут через
+// exec_op, который повторяет exec_single_op (включая mOO и лимит рекурсии).
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "vm.hpp"
+
+// Общая часть каждого сгенерированного файла: лента, регистр и exec_op
+constexpr const char* C_RUNTIME = R"(#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int* tape;
+static size_t tape_size = 10000;
+static size_t p = 0;
+static int reg_val = 0;
+static int has_reg = 0;
+
+static void ensure_cell(size_t index) {
+    if (index < tape_size) return;
+    size_t new_size = tape_size * 2 > index + 1 ? tape_size * 2 : index + 1;
+    int* grown = (int*)realloc(tape, new_size * sizeof(int));
+    if (grown == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = tape_size; i < new_size; ++i) grown[i] = 0;
+    tape = grown;
+    tape_size = new_size;
+}
+
+/* Как BufferedIO::read_int: без цифр или вне диапазона int - 0, и остаток
+   строки пропускается; за числом съедается перевод строки */
+static int read_int(void) {
+    char digits[16];
+    size_t len = 0;
+    int any_digit = 0;
+    int overflow = 0;
+    int c = getchar();
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') c = getchar();
+    if (c == '+' || c == '-') {
+        digits[len++] = (char)c;
+        c = getchar();
+    }
+    size_t start = len;
+    for (; c >= '0' && c <= '9'; c = getchar()) {
+        any_digit = 1;
+        if (c == '0' && len == start) continue; /* ведущие нули */
+        if (len + 1 < sizeof(digits)) digits[len++] = (char)c;
+        else overflow = 1;
+    }
+    digits[len] = '\0';
+
+    long value = 0;
+    if (any_digit && !overflow && len > start) {
+        errno = 0;
+        value = strtol(digits, NULL, 10);
+        overflow = (errno == ERANGE);
+    }
+    if (!any_digit || overflow || value < INT_MIN || value > INT_MAX) {
+        while (c != '\n' && c != EOF) c = getchar();
+        return 0;
+    }
+    if (c != '\n' && c != EOF) ungetc(c, stdin);
+    return (int)value;
+}
+
+static void exec_op(int op) {
+    for (int depth = 0; op == 3; ++depth) {
+        if (depth > %MAX_DEPTH%) {
+            fprintf(stderr, "Error: Maximum recursion depth exceeded via mOO.\n");
+            return;
+        }
+        op = tape[p];
+        if (op == 7 || op == 0) return;
+    }
+    switch (op) {
+        case 1: if (p > 0) p--; break;
+        case 2: p++; ensure_cell(p); break;
+        case 4:
+            if (tape[p] == 0) {
+                int c = getchar();
+                tape[p] = (c == EOF) ? 0 : (unsigned char)c;
+            } else {
+                putchar((char)tape[p]);
+            }
+            break;
+        case 5: tape[p]--; break;
+        case 6: tape[p]++; break;
+        case 8: tape[p] = 0; break;
+        case 9:
+            if (!has_reg) { reg_val = tape[p]; has_reg = 1; }
+            else { tape[p] = reg_val; has_reg = 0; }
+            break;
+        case 10: printf("%d", tape[p]); break;
+        case 11: tape[p] = read_int(); break;
+        default: break;
+    }
+}
+
+int main(void) {
+    tape = (int*)calloc(tape_size, sizeof(int));
+    if (tape == NULL) return 1;
+)";
+
+class CEmitter {
+public:
+    std::string emit(const std::vector<Instr>& instructions) {
+        std::string runtime = C_RUNTIME;
+        std::string depth_marker = "%MAX_DEPTH%";
+        runtime.replace(runtime.find(depth_marker), depth_marker.size(), std::to_string(MAX_RECURSION_DEPTH));
+        out << "/* Generated by cow2c */\n" << runtime;
+
+        // MOO, перед которым закрывается блок if (p >= ...) от GUARD
+        std::vector<bool> guard_end(instructions.size(), false);
+
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            const Instr& instr = instructions[i];
+            switch (instr.op) {
+                case OP_ADD:
+                    line() << "tape[p] += " << instr.arg << ";\n";
+                    break;
+                case OP_SET:
+                    line() << "tape[p] = " << instr.arg << ";\n";
+                    break;
+                case OP_SHIFT:
+                    emit_shift(instr.arg);
+                    break;
+                case OP_ADD_MUL:
+                    emit_add_mul(instr.arg, instr.arg2);
+                    break;
+                case OP_SCAN:
+                    line() << "while (tape[p]) {\n";
+                    ++indent;
+                    emit_shift(instr.arg);
+                    --indent;
+                    line() << "}\n";
+                    break;
+                case OP_GUARD:
+                    line() << "if (p >= " << instr.arg << ") {\n";
+                    ++indent;
+                    guard_end[i + static_cast<std::size_t>(instr.arg2)] = true;
+                    break;
+                case OP_LOOP_START:
+                    if (guard_end[i]) {
+                        --indent;
+                        line() << "}\n";
+                    }
+                    if (instr.arg == 0) break; // непарная скобка ничего не делает
+                    line() << "while (tape[p]) {\n";
+                    ++indent;
+                    break;
+                case OP_LOOP_END:
+                    if (instr.arg == 0) break;
+                    --indent;
+                    line() << "}\n";
+                    break;
+                default:
+                    line() << "exec_op(" << instr.op << ");\n";
+                    break;
+            }
+        }
+
+        line() << "fflush(stdout);\n";
+        line() << "free(tape);\n";
+        line() << "return 0;\n";
+        out << "}\n";
+        return out.str();
+    }
+
+private:
+    std::ostringstream out;
+    int indent = 1;
+
+    std::ostream& line() {
+        for (int i = 0; i < indent; ++i) out << "    ";
+        return out;
+    }
+
+    void emit_shift(int shift) {
+        if (shift < 0) {
+            line() << "p = p >= " << -shift << " ? p - " << -shift << " : 0;\n";
+        } else {
+            line() << "p += " << shift << ";\n";
+            line() << "ensure_cell(p);\n";
+        }
+    }
+
+    // offset < 0 бывает только за GUARD, который уже проверил левый край
+    void emit_add_mul(int offset, int factor) {
+        std::string target;
+        line() << "if (tape[p]) {\n";
+        if (offset < 0) {
+            target = "p - " + std::to_string(-offset);
+        } else {
+            target = "p + " + std::to_string(offset);
+            line() << "    ensure_cell(" << target << ");\n";
+        }
+        line() << "    tape[" << target << "] += tape[p] * " << factor << ";\n";
+        line() << "}\n";
+    }
+};
+
+inline std::string emit_c(const std::vector<Instr>& instructions) {
+    return CEmitter().emit(instructions);
+}
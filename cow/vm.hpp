@@ -0,0 +1,1033 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <string_view>
+#include <span>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "cow_io.hpp"
+
+constexpr int MAX_RECURSION_DEPTH = 100;
+
+// Шитый код через computed goto - расширение GCC/Clang
+#if defined(__GNUC__) || defined(__clang__)
+#define COW_HAS_COMPUTED_GOTO 1
+#endif
+
+// Суперинструкции шитого кода генерирует cow_superopt по профилю корпуса
+// (superinstructions.hpp в каталоге сборки). Без этого файла и в самом
+// cow_superopt (COW_NO_SUPERINSTRUCTIONS) движок работает без них.
+#if defined(COW_HAS_COMPUTED_GOTO) && !defined(COW_NO_SUPERINSTRUCTIONS) && __has_include("superinstructions.hpp")
+#define COW_HAS_SUPERINSTRUCTIONS 1
+#endif
+
+enum OpCode {
+    OP_LOOP_END   = 0,  // moo (arg - смещение до парного MOO, см. link_loops)
+    OP_MOVE_LEFT  = 1,  // mOo
+    OP_MOVE_RIGHT = 2,  // moO
+    OP_EXEC_CELL  = 3,  // mOO
+    OP_IO_CHAR    = 4,  // Moo
+    OP_DEC        = 5,  // MOo
+    OP_INC        = 6,  // MoO
+    OP_LOOP_START = 7,  // MOO (arg - смещение до парного moo)
+    OP_ZERO       = 8,  // OOO
+    OP_REGISTER   = 9,  // MMM
+    OP_PRINT_INT  = 10, // OOM
+    OP_READ_INT   = 11, // oom
+
+    // Коды промежуточного представления (IR), в исходнике их нет.
+    // exec_single_op их не обрабатывает, поэтому mOO с такими значениями в ячейке
+    // по-прежнему ничего не делает.
+    OP_ADD        = 12, // ячейка += arg (свёрнутая серия MoO/MOo)
+    OP_SHIFT      = 13, // указатель += arg (свёрнутая серия moO/mOo)
+    OP_SET        = 14, // ячейка = arg (цикл обнуления MOO MOo moo)
+    OP_ADD_MUL    = 15, // ячейка[+arg] += ячейка * arg2 (тело цикла переноса/умножения); arg < 0 - только за OP_GUARD
+    OP_SCAN       = 16, // пока ячейка != 0: указатель += arg (цикл поиска нуля)
+    OP_GUARD      = 17, // указатель < arg: прыжок на arg2 вперед, к исходному циклу (см. rewrite_loop)
+    OP_INVALID    = -1
+};
+
+// Инструкция IR: код операции + операнды.
+// arg2 нужен только OP_ADD_MUL (множитель) и OP_GUARD (смещение прыжка), у остальных он 0.
+// У скобок циклов arg - относительное смещение парной скобки (0 - непарная).
+struct Instr {
+    int op;
+    int arg;
+    int arg2;
+};
+
+// Разрядность ячейки ленты
+enum CellType {
+    CELL_I32, // int, как в исходной реализации
+    CELL_U8,  // байт с переполнением по модулю 256
+    CELL_I64
+};
+
+// Устройство ленты
+enum TapeKind {
+    TAPE_DENSE, // один std::vector, растет удвоением
+    TAPE_PAGED  // страницы фиксированного размера по требованию
+};
+
+// Движок исполнения IR
+enum Engine {
+    ENGINE_SWITCH,   // цикл с ветвлением по коду операции (эталон)
+    ENGINE_THREADED, // шитый код на computed goto
+    ENGINE_JIT       // машинный код x86-64 (jit_x86_64.hpp)
+};
+
+// Настройки запуска программы
+class Tracer;
+
+struct RunOptions {
+    bool idioms = true; // заменять известные циклы суперинструкциями
+    CowIO* io = nullptr; // nullptr - std::cin/std::cout
+    CellType cell = CELL_I32;
+    TapeKind tape = TAPE_DENSE;
+    bool profile = false; // считать исполнения и печатать отчет в stderr (profile.hpp)
+    Tracer* tracer = nullptr; // писать трассу исполнения (trace.hpp)
+#ifdef COW_HAS_COMPUTED_GOTO
+    Engine engine = ENGINE_THREADED;
+#else
+    Engine engine = ENGINE_SWITCH;
+#endif
+};
+
+// ИСПОЛЬЗУЕМ MAX() КАК МАРКЕР "НЕТ ПЕРЕХОДА"
+constexpr std::size_t NO_JUMP = std::numeric_limits<std::size_t>::max();
+
+constexpr std::size_t INITIAL_TAPE_SIZE = 10000;
+
+// Лента из страниц по PageSize ячеек. Страница выделяется при первом обращении,
+// поэтому память растет по числу реально задетых ячеек, а рост ленты копирует
+// только указатели на страницы, но не сами ячейки.
+template <typename Cell, std::size_t PageSize = 4096>
+class SegmentedTape {
+public:
+    static_assert((PageSize & (PageSize - 1)) == 0, "PageSize must be a power of two");
+
+    explicit SegmentedTape(std::size_t initial_size = 0) {
+        pages_.reserve((initial_size + PageSize - 1) / PageSize);
+    }
+
+    Cell& operator[](std::size_t index) {
+        std::size_t page = index / PageSize;
+        if (page >= pages_.size()) pages_.resize(page + 1);
+        if (!pages_[page]) {
+            pages_[page] = std::make_unique<Cell[]>(PageSize);
+            ++allocated_;
+        }
+        return pages_[page][index % PageSize];
+    }
+
+    // Логический размер: все ячейки до конца последней страницы
+    std::size_t size() const { return pages_.size() * PageSize; }
+    std::size_t pages_allocated() const { return allocated_; }
+
+private:
+    std::vector<std::unique_ptr<Cell[]>> pages_;
+    std::size_t allocated_ = 0;
+};
+
+// Гарантирует, что ячейка index существует
+template <typename Cell>
+inline void tape_ensure(std::vector<Cell>& tape, std::size_t index) {
+    if (index >= tape.size()) {
+        // Увеличиваем память, если вышли за границы
+        tape.resize(std::max(tape.size() * 2, index + 1), 0);
+    }
+}
+
+template <typename Cell, std::size_t PageSize>
+inline void tape_ensure(SegmentedTape<Cell, PageSize>&, std::size_t) {
+    // Страницы выделяются при обращении
+}
+
+// Плотная лента, размер которой заранее доказан анализом (analyze_tape):
+// программа не выходит за ее конец, так что проверки при сдвигах вправо
+// исчезают после подстановки шаблонов
+template <typename Cell>
+class FixedTape : public std::vector<Cell> {
+public:
+    using std::vector<Cell>::vector;
+};
+
+template <typename Cell>
+inline void tape_ensure(FixedTape<Cell>&, std::size_t) {
+    // Размер ленты достаточен с самого начала
+}
+
+template <typename CellT, typename TapeT = std::vector<CellT>>
+struct BasicVMState {
+    using Cell = CellT;
+    using Tape = TapeT;
+
+    Tape memory;
+    std::size_t mem_ptr;
+    std::optional<Cell> reg_val;
+    CowIO* io;
+
+    BasicVMState() : BasicVMState(Tape(INITIAL_TAPE_SIZE)) {}
+    explicit BasicVMState(Tape tape) : memory(std::move(tape)), mem_ptr(0), reg_val(std::nullopt), io(&stream_io()) {}
+};
+
+using VMState = BasicVMState<int>;
+
+// Тип, которым читается число в ячейку (oom): байтовые ячейки читают int и
+// заворачиваются по модулю, 64-битные читают long long
+template <typename Cell>
+using CellInput = std::conditional_t<(sizeof(Cell) > sizeof(int)), long long, int>;
+
+inline bool is_cow_char(char c) {
+    return c == 'm' || c == 'M' || c == 'o' || c == 'O';
+}
+
+// Индекс первого символа из mMoO начиная с pos (или size, если таких нет).
+// Комментарии в COW-программах пропускаются блоками по 32 байта.
+inline std::size_t skip_non_cow(const char* data, std::size_t pos, std::size_t size) {
+#if defined(__AVX2__)
+    const __m256i m = _mm256_set1_epi8('m'), M = _mm256_set1_epi8('M');
+    const __m256i o = _mm256_set1_epi8('o'), O = _mm256_set1_epi8('O');
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, m), _mm256_cmpeq_epi8(chunk, M)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, o), _mm256_cmpeq_epi8(chunk, O)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask != 0) return pos + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+#elif defined(__SSE2__)
+    const __m128i m = _mm_set1_epi8('m'), M = _mm_set1_epi8('M');
+    const __m128i o = _mm_set1_epi8('o'), O = _mm_set1_epi8('O');
+    auto hits = [&](std::size_t at) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + at));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, m), _mm_cmpeq_epi8(chunk, M)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, o), _mm_cmpeq_epi8(chunk, O)));
+        return static_cast<uint32_t>(_mm_movemask_epi8(hit));
+    };
+    for (; pos + 32 <= size; pos += 32) {
+        uint32_t mask = hits(pos) | (hits(pos + 16) << 16);
+        if (mask != 0) return pos + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+#endif
+    while (pos < size && !is_cow_char(data[pos])) ++pos;
+    return pos;
+}
+
+inline int get_command_code(char c1, char c2, char c3) {
+    uint32_t packed =
+        (static_cast<uint32_t>(static_cast<uint8_t>(c1)) << 16) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(c2)) << 8) |
+        static_cast<uint32_t>(static_cast<uint8_t>(c3));
+
+    switch (packed) {
+        case 0x6D6F6F: return OP_LOOP_END;
+        case 0x6D4F6F: return OP_MOVE_LEFT;
+        case 0x6D6F4F: return OP_MOVE_RIGHT;
+        case 0x6D4F4F: return OP_EXEC_CELL;
+        case 0x4D6F6F: return OP_IO_CHAR;
+        case 0x4D4F6F: return OP_DEC;
+        case 0x4D6F4F: return OP_INC;
+        case 0x4D4F4F: return OP_LOOP_START;
+        case 0x4F4F4F: return OP_ZERO;
+        case 0x4D4D4D: return OP_REGISTER;
+        case 0x4F4F4D: return OP_PRINT_INT;
+        case 0x6F6F6D: return OP_READ_INT;
+        default: return OP_INVALID;
+    }
+}
+
+// Вызывает emit(код, смещение в байтах) для каждой команды исходника, не копируя его
+template <typename Emit>
+void scan_commands(std::string_view source, Emit&& emit) {
+    const char* data = source.data();
+    std::size_t size = source.size();
+
+    for (std::size_t i = skip_non_cow(data, 0, size); i + 2 < size; i = skip_non_cow(data, i, size)) {
+        int cmd = get_command_code(data[i], data[i+1], data[i+2]);
+        if (cmd != OP_INVALID) {
+            emit(cmd, i);
+            i += 3;
+        } else {
+            ++i;
+        }
+    }
+}
+
+inline std::vector<int> parse(std::string_view source) {
+    std::vector<int> instructions;
+    instructions.reserve(source.length() / 3);
+    scan_commands(source, [&](int cmd, std::size_t) { instructions.push_back(cmd); });
+    return instructions;
+}
+
+// Сворачивает подряд идущие MoO/MOo в один OP_ADD, а moO/mOo - в один OP_SHIFT.
+// Серии с нулевым итогом выбрасываются целиком. Команды подаются по одной,
+// поэтому IR можно строить прямо во время разбора исходника.
+//
+// offset - положение команды в исходнике; для каждой инструкции IR запоминается
+// смещение её первой команды (карта для отчета профилировщика).
+class IrBuilder {
+public:
+    void push(int cmd, std::size_t offset = 0) {
+        if (cmd == OP_INC || cmd == OP_DEC) {
+            if (run_ != RUN_ADD) {
+                flush();
+                run_offset_ = offset;
+            }
+            run_ = RUN_ADD;
+            delta_ += (cmd == OP_INC) ? 1 : -1;
+        } else if (cmd == OP_MOVE_RIGHT || cmd == OP_MOVE_LEFT) {
+            if (run_ != RUN_SHIFT) {
+                flush();
+                run_offset_ = offset;
+            }
+            run_ = RUN_SHIFT;
+            // mOo упирается в нулевую ячейку, поэтому серию можно заменить одним
+            // сдвигом, только если минимум пройденного пути лежит в её начале или
+            // конце. Иначе (например mOo moO на нуле) начинаем новую серию.
+            int next = shift_ + ((cmd == OP_MOVE_RIGHT) ? 1 : -1);
+            int next_lowest = std::min(lowest_, next);
+            if (next_lowest != std::min(0, next)) {
+                flush();
+                run_ = RUN_SHIFT;
+                run_offset_ = offset;
+                next = (cmd == OP_MOVE_RIGHT) ? 1 : -1;
+                next_lowest = std::min(0, next);
+            }
+            shift_ = next;
+            lowest_ = next_lowest;
+        } else {
+            flush();
+            program_.push_back({cmd, 0, 0});
+            offsets_.push_back(offset);
+        }
+    }
+
+    std::vector<Instr> finish() {
+        flush();
+        return std::move(program_);
+    }
+
+    // Смещения инструкций; забирать после finish()
+    std::vector<std::size_t> take_offsets() { return std::move(offsets_); }
+
+    void reserve(std::size_t n) {
+        program_.reserve(n);
+        offsets_.reserve(n);
+    }
+
+private:
+    enum Run { RUN_NONE, RUN_ADD, RUN_SHIFT };
+
+    std::vector<Instr> program_;
+    std::vector<std::size_t> offsets_;
+    std::size_t run_offset_ = 0;
+    Run run_ = RUN_NONE;
+    int delta_ = 0;
+    int shift_ = 0;
+    int lowest_ = 0;
+
+    void flush() {
+        if ((run_ == RUN_ADD && delta_ != 0) || (run_ == RUN_SHIFT && shift_ != 0)) {
+            program_.push_back({(run_ == RUN_ADD) ? OP_ADD : OP_SHIFT, (run_ == RUN_ADD) ? delta_ : shift_, 0});
+            offsets_.push_back(run_offset_);
+        }
+        run_ = RUN_NONE;
+        delta_ = shift_ = lowest_ = 0;
+    }
+};
+
+// offsets (если задан) получает для каждой инструкции IR номер её первой команды
+inline std::vector<Instr> fold(const std::vector<int>& instructions, std::vector<std::size_t>* offsets = nullptr) {
+    IrBuilder builder;
+    builder.reserve(instructions.size());
+    for (std::size_t i = 0; i < instructions.size(); ++i) builder.push(instructions[i], i);
+    std::vector<Instr> program = builder.finish();
+    if (offsets != nullptr) *offsets = builder.take_offsets();
+    return program;
+}
+
+// Пытается распознать внутренний цикл program[start..end] (без вложенных циклов)
+// и дописать в out его замену. Возвращает false, если цикл не подходит под шаблон.
+//
+// Если тело цикла переноса заходит левее входной ячейки, у края ленты mOo
+// исходного цикла упирается в нулевую ячейку и меняет итоговый сдвиг итерации -
+// умножением это не выразить. Тогда замену открывает GUARD: при указателе левее
+// самой дальней ячейки тела он прыгает на сам цикл, который вызывающий
+// оставляет сразу за заменой (keep_loop). Если замена исполнилась, ячейка уже
+// обнулена, и исходный цикл пропускается одной проверкой.
+inline bool rewrite_loop(const std::vector<Instr>& program, std::size_t start, std::size_t end,
+                         std::vector<Instr>& out, bool& keep_loop) {
+    keep_loop = false;
+    // [MoO] / [MOo] -> SET 0
+    if (end - start == 2) {
+        const Instr& body = program[start + 1];
+        if (body.op == OP_ADD && (body.arg == 1 || body.arg == -1)) {
+            out.push_back({OP_SET, 0, 0});
+            return true;
+        }
+        // [moO...] / [mOo...] -> SCAN
+        if (body.op == OP_SHIFT) {
+            out.push_back({OP_SCAN, body.arg, 0});
+            return true;
+        }
+    }
+
+    // Тело только из ADD/SHIFT с нулевым итоговым сдвигом -> серия ADD_MUL + SET 0
+    std::vector<std::pair<int, int>> deltas; // смещение -> суммарное изменение
+    int offset = 0;
+    int lowest = 0;
+    for (std::size_t i = start + 1; i < end; ++i) {
+        const Instr& instr = program[i];
+        if (instr.op == OP_SHIFT) {
+            offset += instr.arg;
+            lowest = std::min(lowest, offset);
+        } else if (instr.op == OP_ADD) {
+            auto it = std::find_if(deltas.begin(), deltas.end(),
+                                   [offset](const auto& d) { return d.first == offset; });
+            if (it == deltas.end()) {
+                deltas.emplace_back(offset, instr.arg);
+            } else {
+                it->second += instr.arg;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (offset != 0) return false;
+
+    auto self = std::find_if(deltas.begin(), deltas.end(),
+                             [](const auto& d) { return d.first == 0; });
+    // Счетчик цикла должен меняться ровно на 1 за итерацию, иначе число итераций
+    // не выражается через значение ячейки одним умножением
+    if (self == deltas.end() || (self->second != 1 && self->second != -1)) return false;
+    int step = self->second;
+
+    std::size_t guard = out.size();
+    keep_loop = (lowest < 0);
+    if (keep_loop) out.push_back({OP_GUARD, -lowest, 0});
+    for (const auto& [off, delta] : deltas) {
+        if (off == 0 || delta == 0) continue;
+        // Итераций ровно cell * (-step), поэтому множитель берем с обратным знаком шага
+        out.push_back({OP_ADD_MUL, off, -delta * step});
+    }
+    out.push_back({OP_SET, 0, 0});
+    if (keep_loop) out[guard].arg2 = static_cast<int>(out.size() - guard);
+    return true;
+}
+
+// Проход распознавания идиом: заменяет внутренние циклы обнуления, переноса,
+// умножения и поиска нуля суперинструкциями SET / ADD_MUL / SCAN.
+// offsets (если задан) - карта смещений, переписывается вместе с программой:
+// замена цикла получает смещение его MOO.
+inline std::vector<Instr> recognize_idioms(const std::vector<Instr>& program,
+                                           std::vector<std::size_t>* offsets = nullptr) {
+    std::vector<Instr> out;
+    std::vector<std::size_t> out_offsets;
+    out.reserve(program.size());
+    auto map_offsets = [&](std::size_t from) {
+        if (offsets != nullptr) out_offsets.resize(out.size(), (*offsets)[from]);
+    };
+
+    std::size_t n = program.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        if (program[i].op == OP_LOOP_START) {
+            // Ищем ближайший moo; если до него встретился MOO - цикл не внутренний
+            std::size_t j = i + 1;
+            while (j < n && program[j].op != OP_LOOP_END && program[j].op != OP_LOOP_START) ++j;
+            bool keep_loop = false;
+            if (j < n && program[j].op == OP_LOOP_END && rewrite_loop(program, i, j, out, keep_loop)) {
+                map_offsets(i);
+                if (!keep_loop) {
+                    i = j;
+                    continue;
+                }
+            }
+        }
+        out.push_back(program[i]);
+        map_offsets(i);
+    }
+    if (offsets != nullptr) *offsets = std::move(out_offsets);
+    return out;
+}
+
+inline std::vector<Instr> optimize(std::vector<Instr> program, const RunOptions& options,
+                                   std::vector<std::size_t>* offsets = nullptr) {
+    if (options.idioms) {
+        program = recognize_idioms(program, offsets);
+    }
+    return program;
+}
+
+// Индекс первой скобки цикла начиная с i (или size, если скобок больше нет).
+// Инструкция занимает 12 байт, так что 4 (8 для AVX2) инструкции - это 3
+// вектора, и коды операций лежат в каждом третьем 32-битном слове.
+inline std::size_t next_loop_op(std::span<const Instr> program, std::size_t i) {
+    static_assert(sizeof(Instr) == 3 * sizeof(int), "Instr must be three packed ints");
+#if defined(__AVX2__)
+    const __m256i loop_end = _mm256_set1_epi32(OP_LOOP_END), loop_start = _mm256_set1_epi32(OP_LOOP_START);
+    for (; i + 8 <= program.size(); i += 8) {
+        const __m256i* block = reinterpret_cast<const __m256i*>(program.data() + i);
+        uint32_t mask = 0;
+        for (int k = 0; k < 3; ++k) {
+            __m256i words = _mm256_loadu_si256(block + k);
+            __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi32(words, loop_end), _mm256_cmpeq_epi32(words, loop_start));
+            mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(hit))) << (8 * k);
+        }
+        mask &= 0x249249; // слова 0, 3, ..., 21 - поля op
+        if (mask != 0) return i + static_cast<std::size_t>(__builtin_ctz(mask)) / 3;
+    }
+#elif defined(__SSE2__)
+    const __m128i loop_end = _mm_set1_epi32(OP_LOOP_END), loop_start = _mm_set1_epi32(OP_LOOP_START);
+    for (; i + 4 <= program.size(); i += 4) {
+        const __m128i* block = reinterpret_cast<const __m128i*>(program.data() + i);
+        uint32_t mask = 0;
+        for (int k = 0; k < 3; ++k) {
+            __m128i words = _mm_loadu_si128(block + k);
+            __m128i hit = _mm_or_si128(_mm_cmpeq_epi32(words, loop_end), _mm_cmpeq_epi32(words, loop_start));
+            mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(hit))) << (4 * k);
+        }
+        mask &= 0x249; // слова 0, 3, 6, 9 - поля op
+        if (mask != 0) return i + static_cast<std::size_t>(__builtin_ctz(mask)) / 3;
+    }
+#endif
+    while (i < program.size() && program[i].op != OP_LOOP_END && program[i].op != OP_LOOP_START) ++i;
+    return i;
+}
+
+// Связывает скобки: в arg каждой парной скобки записывается смещение до
+// парной (MOO -> +, moo -> -), у непарной arg = 0. Отдельная таблица
+// переходов не нужна - движок берет цель из инструкции, которую и так
+// прочитал. Скобки находит векторный проход, стек - только по скобкам.
+// Последний шаг компиляции: после него IR уже не переписывается.
+inline void link_loops(std::span<Instr> program) {
+    std::vector<std::size_t> open;
+    for (std::size_t i = next_loop_op(program, 0); i < program.size(); i = next_loop_op(program, i + 1)) {
+        Instr& instr = program[i];
+        instr.arg = 0;
+        if (instr.op == OP_LOOP_START) {
+            open.push_back(i);
+        } else if (!open.empty()) {
+            std::size_t start = open.back();
+            open.pop_back();
+            int offset = static_cast<int>(i - start);
+            program[start].arg = offset;
+            instr.arg = -offset;
+        }
+    }
+}
+
+// Индекс парной скобки для связанной скобки program[i], иначе NO_JUMP
+inline std::size_t jump_target(const Instr& instr, std::size_t i) {
+    return (instr.arg == 0) ? NO_JUMP : static_cast<std::size_t>(static_cast<long long>(i) + instr.arg);
+}
+
+inline std::vector<Instr> compile(const std::vector<int>& instructions, const RunOptions& options,
+                                  std::vector<std::size_t>* offsets = nullptr) {
+    std::vector<Instr> program = optimize(fold(instructions, offsets), options, offsets);
+    link_loops(program);
+    return program;
+}
+
+// Разбор прямо в IR: промежуточный вектор команд не строится.
+// offsets (если задан) получает смещение в исходнике для каждой инструкции IR.
+inline std::vector<Instr> compile_source(std::string_view source, const RunOptions& options,
+                                         std::vector<std::size_t>* offsets = nullptr) {
+    IrBuilder builder;
+    scan_commands(source, [&](int cmd, std::size_t offset) { builder.push(cmd, offset); });
+    std::vector<Instr> program = builder.finish();
+    if (offsets != nullptr) *offsets = builder.take_offsets();
+    program = optimize(std::move(program), options, offsets);
+    link_loops(program);
+    return program;
+}
+
+// Обработчики отдельных команд. Их вызывают и exec_single_op, и таблица mOO.
+template <typename State>
+void op_nop(State&) {}
+
+template <typename State>
+void op_move_left(State& state) {
+    if (state.mem_ptr > 0) state.mem_ptr--;
+}
+
+template <typename State>
+void op_move_right(State& state) {
+    state.mem_ptr++;
+    tape_ensure(state.memory, state.mem_ptr);
+}
+
+template <typename State>
+void op_io_char(State& state) {
+    using Cell = typename State::Cell;
+    if (state.memory[state.mem_ptr] == 0) {
+        // Чтение символа
+        char input_char;
+        if (state.io->read_char(input_char)) {
+            state.memory[state.mem_ptr] = static_cast<Cell>(static_cast<unsigned char>(input_char));
+        } else {
+            state.memory[state.mem_ptr] = 0;
+        }
+    } else {
+        // Вывод символа
+        state.io->write_char(static_cast<char>(state.memory[state.mem_ptr]));
+    }
+}
+
+template <typename State>
+void op_dec(State& state) {
+    state.memory[state.mem_ptr]--;
+}
+
+template <typename State>
+void op_inc(State& state) {
+    state.memory[state.mem_ptr]++;
+}
+
+template <typename State>
+void op_zero(State& state) {
+    state.memory[state.mem_ptr] = 0;
+}
+
+template <typename State>
+void op_register(State& state) {
+    if (!state.reg_val.has_value()) {
+        state.reg_val = state.memory[state.mem_ptr];
+    } else {
+        state.memory[state.mem_ptr] = state.reg_val.value();
+        state.reg_val = std::nullopt;
+    }
+}
+
+template <typename State>
+void op_print_int(State& state) {
+    state.io->write_int(static_cast<long long>(state.memory[state.mem_ptr]));
+}
+
+template <typename State>
+void op_read_int(State& state) {
+    using Cell = typename State::Cell;
+    using Limits = std::numeric_limits<CellInput<Cell>>;
+    long long val;
+    state.memory[state.mem_ptr] = state.io->read_int(val, Limits::min(), Limits::max())
+        ? static_cast<Cell>(val) : Cell(0);
+}
+
+// mOO на ячейке со значением mOO: ячейка не меняется, поэтому прежняя цепочка
+// перечитывала одно и то же значение, пока не упиралась в MAX_RECURSION_DEPTH.
+// Итог известен заранее - сразу сообщаем о нем.
+template <typename State>
+void op_exec_cell_cycle(State&) {
+    std::cerr << "Error: Maximum recursion depth exceeded via mOO." << std::endl;
+}
+
+// Таблица mOO: индекс - значение ячейки, элемент - обработчик команды с этим
+// кодом. Скобки циклов через mOO не исполняются (MOO/moo -> op_nop).
+template <typename State>
+inline constexpr void (*EXEC_CELL_TABLE[OP_READ_INT + 1])(State&) = {
+    op_nop<State>,             // moo
+    op_move_left<State>,       // mOo
+    op_move_right<State>,      // moO
+    op_exec_cell_cycle<State>, // mOO
+    op_io_char<State>,         // Moo
+    op_dec<State>,             // MOo
+    op_inc<State>,             // MoO
+    op_nop<State>,             // MOO
+    op_zero<State>,            // OOO
+    op_register<State>,        // MMM
+    op_print_int<State>,       // OOM
+    op_read_int<State>         // oom
+};
+
+// Номер обработчика mOO для значения ячейки или -1, если это не код команды.
+// Одно беззнаковое сравнение отсекает и отрицательные, и слишком большие значения.
+template <typename Cell>
+inline int exec_cell_target(Cell cell) {
+    using Unsigned = std::make_unsigned_t<Cell>;
+    return (static_cast<Unsigned>(cell) <= static_cast<Unsigned>(OP_READ_INT)) ? static_cast<int>(cell) : -1;
+}
+
+template <typename State>
+void exec_cell(State& state) {
+    int target = exec_cell_target(state.memory[state.mem_ptr]);
+    if (target >= 0) EXEC_CELL_TABLE<State>[target](state);
+}
+
+template <typename State>
+void exec_single_op(int command, State& state) {
+    switch (command) {
+        case OP_MOVE_LEFT:  op_move_left(state); break;
+        case OP_MOVE_RIGHT: op_move_right(state); break;
+        case OP_EXEC_CELL:  exec_cell(state); break;
+        case OP_IO_CHAR:    op_io_char(state); break;
+        case OP_DEC:        op_dec(state); break;
+        case OP_INC:        op_inc(state); break;
+        case OP_ZERO:       op_zero(state); break;
+        case OP_REGISTER:   op_register(state); break;
+        case OP_PRINT_INT:  op_print_int(state); break;
+        case OP_READ_INT:   op_read_int(state); break;
+        default:            break; // скобки и коды IR
+    }
+}
+
+// Исполнение свёрнутых операций IR
+template <typename State>
+void exec_add(int delta, State& state) {
+    state.memory[state.mem_ptr] += delta;
+}
+
+template <typename State>
+void ensure_cell(std::size_t index, State& state) {
+    tape_ensure(state.memory, index);
+}
+
+template <typename State>
+void exec_shift(int shift, State& state) {
+    if (shift < 0) {
+        // Как и у серии mOo: не уходим левее нулевой ячейки
+        std::size_t back = static_cast<std::size_t>(-static_cast<long long>(shift));
+        state.mem_ptr = (state.mem_ptr > back) ? state.mem_ptr - back : 0;
+        return;
+    }
+    state.mem_ptr += static_cast<std::size_t>(shift);
+    ensure_cell(state.mem_ptr, state);
+}
+
+template <typename State>
+void exec_set(int value, State& state) {
+    state.memory[state.mem_ptr] = static_cast<typename State::Cell>(value);
+}
+
+template <typename State>
+void exec_add_mul(int offset, int factor, State& state) {
+    typename State::Cell value = state.memory[state.mem_ptr];
+    if (value == 0) return;
+
+    // offset < 0 бывает только за GUARD, который уже проверил левый край
+    std::size_t target = state.mem_ptr + offset;
+    ensure_cell(target, state);
+    state.memory[target] += value * static_cast<typename State::Cell>(factor);
+}
+
+// false - сдвиг влево уперся в нулевую ячейку, а она != 0: цикл бесконечен.
+// Инструкция тогда остается текущей, и каждый повтор считается шагом, чтобы
+// бюджет останавливал такой цикл так же, как несвёрнутый [mOo]
+template <typename State>
+bool exec_scan(int shift, State& state) {
+    while (state.memory[state.mem_ptr] != 0) {
+        if (shift < 0 && state.mem_ptr == 0) return false;
+        exec_shift(shift, state);
+    }
+    return true;
+}
+
+// Обработчики событий исполнения по умолчанию - пустые, и после подстановки
+// шаблона от них не остается ни одной инструкции. Профилировщик и трассировщик
+// передают свои. on_instr вызывается перед исполнением инструкции.
+struct NoHooks {
+    template <typename State>
+    void on_instr(std::size_t, State&) {}
+    void on_back_edge(std::size_t) {}
+    template <typename State>
+    void on_exec_cell(State&) {}
+};
+
+// Хуки асинхронного ввода: run_slice останавливается перед инструкцией,
+// которой не хватит уже полученного ввода, и instr_ptr остается на ней -
+// когда ввод подвезут, исполнение продолжится с этой же инструкции
+struct InputGate : NoHooks {
+    bool starved = false;
+
+    template <typename State>
+    bool input_ready(int op, State& state) {
+        if (op != OP_IO_CHAR && op != OP_READ_INT && op != OP_EXEC_CELL) return true;
+        auto cell = state.memory[state.mem_ptr];
+        if (op == OP_IO_CHAR) {
+            starved = (cell == 0) && !state.io->can_read_char();
+        } else if (op == OP_READ_INT || cell == OP_READ_INT) {
+            starved = !state.io->can_read_int();
+        }
+        return !starved;
+    }
+};
+
+// Исполняет не более max_steps инструкций, начиная с instr_ptr, и оставляет в нем
+// место остановки, чтобы следующий вызов продолжил с того же места.
+// Возвращает число исполненных инструкций; программа закончилась, когда
+// instr_ptr == instructions.size(). Здесь и во всех движках IR должен быть
+// связан (link_loops); compile/compile_source и CowProgram это делают.
+template <typename State, typename Hooks>
+std::uint64_t run_slice(std::span<const Instr> instructions, State& state, std::size_t& instr_ptr,
+                        std::uint64_t max_steps, Hooks& hooks) {
+    std::size_t n_instr = instructions.size();
+    std::uint64_t steps = 0;
+
+    while (instr_ptr < n_instr && steps < max_steps) {
+        const Instr& instr = instructions[instr_ptr];
+        int command = instr.op;
+        if constexpr (requires { hooks.input_ready(command, state); }) {
+            if (!hooks.input_ready(command, state)) break;
+        }
+        ++steps;
+        hooks.on_instr(instr_ptr, state);
+
+        if (command == OP_ADD) {
+            exec_add(instr.arg, state);
+        } else if (command == OP_SHIFT) {
+            exec_shift(instr.arg, state);
+        } else if (command == OP_SET) {
+            exec_set(instr.arg, state);
+        } else if (command == OP_ADD_MUL) {
+            exec_add_mul(instr.arg, instr.arg2, state);
+        } else if (command == OP_SCAN) {
+            if (!exec_scan(instr.arg, state)) continue;
+        } else if (command == OP_GUARD) {
+            if (state.mem_ptr < static_cast<std::size_t>(instr.arg)) {
+                instr_ptr += instr.arg2;
+                continue;
+            }
+        } else if (command == OP_LOOP_START) { // MOO
+            // У непарной скобки arg == 0 - просто идем дальше
+            if (state.memory[state.mem_ptr] == 0) instr_ptr += instr.arg;
+        } else if (command == OP_LOOP_END) { // moo
+            if (state.memory[state.mem_ptr] != 0 && instr.arg != 0) {
+                hooks.on_back_edge(instr_ptr);
+                instr_ptr += instr.arg;
+                continue; // Прыжок назад, пропускаем инкремент в конце цикла
+            }
+        } else {
+            if (command == OP_EXEC_CELL) hooks.on_exec_cell(state);
+            exec_single_op(command, state);
+        }
+        instr_ptr++;
+    }
+    return steps;
+}
+
+template <typename State>
+std::uint64_t run_slice(std::span<const Instr> instructions, State& state, std::size_t& instr_ptr,
+                        std::uint64_t max_steps) {
+    NoHooks hooks;
+    return run_slice(instructions, state, instr_ptr, max_steps, hooks);
+}
+
+template <typename State>
+void run_switch(std::span<const Instr> instructions, State& state) {
+    std::size_t instr_ptr = 0;
+    run_slice(instructions, state, instr_ptr, std::numeric_limits<std::uint64_t>::max());
+}
+
+#ifdef COW_HAS_COMPUTED_GOTO
+// Последовательность кодов IR, которую шитый код исполняет одним обработчиком
+struct SuperPattern {
+    static constexpr std::size_t MAX_LENGTH = 4;
+
+    std::size_t length;
+    int ops[MAX_LENGTH];
+};
+
+#ifdef COW_HAS_SUPERINSTRUCTIONS
+#define COW_SUPER_PATTERNS
+#include "superinstructions.hpp"
+#undef COW_SUPER_PATTERNS
+#else
+inline constexpr std::span<const SuperPattern> SUPER_PATTERNS{};
+#endif
+
+// Индекс суперинструкции, начинающейся с instructions[i], или -1. Шаблоны в
+// таблице идут от длинных к коротким, так что берется самый длинный.
+inline int match_superinstruction(std::span<const Instr> instructions, std::size_t i) {
+    for (std::size_t p = 0; p < SUPER_PATTERNS.size(); ++p) {
+        const SuperPattern& pattern = SUPER_PATTERNS[p];
+        if (i + pattern.length > instructions.size()) continue;
+        bool match = true;
+        for (std::size_t k = 0; k < pattern.length && match; ++k) {
+            match = instructions[i + k].op == pattern.ops[k];
+        }
+        if (match) return static_cast<int>(p);
+    }
+    return -1;
+}
+
+// Каждая инструкция заранее превращается в адрес метки обработчика, и обработчик
+// сам прыгает на следующий: одно косвенное ветвление на инструкцию вместо двух.
+// Суперинструкция занимает место первой инструкции серии и исполняет всю серию
+// за одно ветвление; скобок внутри серии нет, поэтому и прыжков в ее середину нет.
+// С хуками суперинструкции не собираются: хук видит каждую инструкцию.
+template <typename State, typename Hooks>
+void run_threaded(std::span<const Instr> instructions, State& state, Hooks& hooks) {
+    constexpr bool hooked = !std::is_same_v<Hooks, NoHooks>;
+
+    struct Threaded {
+        const void* label;
+        int op;
+        int arg;
+        int arg2;
+        std::size_t target; // для скобок и GUARD: индекс, с которого продолжать после прыжка
+    };
+
+    // Индекс - код операции (OP_LOOP_END .. OP_GUARD)
+    static const void* const labels[] = {
+        &&do_loop_end,  &&do_single, &&do_single, &&do_exec_cell,
+        &&do_single,    &&do_single, &&do_single, &&do_loop_start,
+        &&do_single,    &&do_single, &&do_single, &&do_single,
+        &&do_add,       &&do_shift,  &&do_set,    &&do_add_mul,
+        &&do_scan,      &&do_guard
+    };
+
+    // mOO: индекс - значение ячейки. Частые команды, не трогающие ввод/вывод,
+    // исполняются прямо здесь, остальные - через EXEC_CELL_TABLE
+    static const void* const cell_labels[] = {
+        &&do_next,      &&cell_left, &&cell_right, &&cell_table,
+        &&cell_table,   &&cell_dec,  &&cell_inc,   &&do_next,
+        &&cell_zero,    &&cell_table, &&cell_table, &&cell_table
+    };
+    int cell_target = 0;
+
+#ifdef COW_HAS_SUPERINSTRUCTIONS
+    static const void* const super_labels[] = {
+#define COW_SUPER_LABELS
+#include "superinstructions.hpp"
+#undef COW_SUPER_LABELS
+    };
+#endif
+
+    std::size_t n_instr = instructions.size();
+    std::vector<Threaded> code(n_instr + 1);
+
+    for (std::size_t i = 0; i < n_instr; ++i) {
+        const Instr& instr = instructions[i];
+        Threaded& t = code[i];
+        t.label = labels[instr.op];
+#ifdef COW_HAS_SUPERINSTRUCTIONS
+        int super = hooked ? -1 : match_superinstruction(instructions, i);
+        if (super >= 0) t.label = super_labels[super];
+#endif
+        t.op = instr.op;
+        t.arg = instr.arg;
+        t.arg2 = instr.arg2;
+        if (instr.op == OP_LOOP_START || instr.op == OP_LOOP_END) {
+            if (instr.arg == 0) {
+                // Если парной скобки нет - просто идем дальше
+                t.label = &&do_next;
+            } else {
+                // Оба прыжка ведут на инструкцию после парной скобки: после moo
+                // ячейка != 0, так что повторная проверка в MOO ничего не меняет
+                t.target = jump_target(instr, i) + 1;
+            }
+        } else if (instr.op == OP_GUARD) {
+            t.target = i + static_cast<std::size_t>(instr.arg2);
+        }
+    }
+    code[n_instr].label = &&do_halt;
+
+    const Threaded* base = code.data();
+    const Threaded* ip = base;
+    const Threaded* halt = base + n_instr;
+    (void)halt;
+
+#define COW_DISPATCH()                                                                     \
+    do {                                                                                   \
+        if constexpr (hooked) {                                                            \
+            if (ip != halt) hooks.on_instr(static_cast<std::size_t>(ip - base), state);    \
+        }                                                                                  \
+        goto *ip->label;                                                                   \
+    } while (0)
+#define COW_NEXT() do { ++ip; COW_DISPATCH(); } while (0)
+
+    COW_DISPATCH();
+
+do_add:
+    exec_add(ip->arg, state);
+    COW_NEXT();
+do_shift:
+    exec_shift(ip->arg, state);
+    COW_NEXT();
+do_set:
+    exec_set(ip->arg, state);
+    COW_NEXT();
+do_add_mul:
+    exec_add_mul(ip->arg, ip->arg2, state);
+    COW_NEXT();
+do_scan:
+    if (!exec_scan(ip->arg, state)) COW_DISPATCH();
+    COW_NEXT();
+do_guard:
+    if (state.mem_ptr < static_cast<std::size_t>(ip->arg)) {
+        ip = base + ip->target;
+        COW_DISPATCH();
+    }
+    COW_NEXT();
+do_loop_start:
+    if (state.memory[state.mem_ptr] == 0) {
+        ip = base + ip->target;
+        COW_DISPATCH();
+    }
+    COW_NEXT();
+do_loop_end:
+    if (state.memory[state.mem_ptr] != 0) {
+        hooks.on_back_edge(static_cast<std::size_t>(ip - base));
+        ip = base + ip->target;
+        COW_DISPATCH();
+    }
+    COW_NEXT();
+do_single:
+    exec_single_op(ip->op, state);
+    COW_NEXT();
+do_exec_cell:
+    hooks.on_exec_cell(state);
+    cell_target = exec_cell_target(state.memory[state.mem_ptr]);
+    if (cell_target < 0) COW_NEXT();
+    goto *cell_labels[cell_target];
+cell_left:
+    op_move_left(state);
+    COW_NEXT();
+cell_right:
+    op_move_right(state);
+    COW_NEXT();
+cell_dec:
+    op_dec(state);
+    COW_NEXT();
+cell_inc:
+    op_inc(state);
+    COW_NEXT();
+cell_zero:
+    op_zero(state);
+    COW_NEXT();
+cell_table:
+    EXEC_CELL_TABLE<State>[cell_target](state);
+    COW_NEXT();
+do_next:
+    COW_NEXT();
+#ifdef COW_HAS_SUPERINSTRUCTIONS
+#define COW_SUPER_HANDLERS
+#include "superinstructions.hpp"
+#undef COW_SUPER_HANDLERS
+#endif
+do_halt:
+    return;
+
+#undef COW_NEXT
+#undef COW_DISPATCH
+}
+
+template <typename State>
+void run_threaded(std::span<const Instr> instructions, State& state) {
+    NoHooks hooks;
+    run_threaded(instructions, state, hooks);
+}
+
+#endif
@@ -1,145 +1,143 @@
 #ifndef AST_H
 #define AST_H
 
+#include "StringPool.h"
 #include "Token.h"
-#include <memory>
-#include <string>
+#include "Types.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
 #include <vector>
 
-struct NodeVisitor;
-
-struct AST {
-  virtual ~AST() = default;
-  virtual void accept(NodeVisitor &visitor) = 0;
-};
-
-struct BinOp : AST {
-  std::unique_ptr<AST> left;
-  Token op;
-  std::unique_ptr<AST> right;
-  BinOp(std::unique_ptr<AST> l, Token o, std::unique_ptr<AST> r)
-      : left(std::move(l)), op(std::move(o)), right(std::move(r)) {}
-  void accept(NodeVisitor &visitor) override;
+// Узел - индекс в столбцах AST
+using NodeId = uint32_t;
+inline constexpr NodeId NO_NODE = UINT32_MAX;
+
+// Что лежит в полях op, a, b, c и type узла каждого вида. Имена и тексты -
+// номера символов в AST::strings, списки - ссылки в AST::lists.
+// type у выражений вычисляет SemanticAnalyzer
+enum class NodeKind : uint8_t {
+  BIN_OP,         // op; a - левый операнд, b - правый; type
+  UNARY_OP,       // op; a - операнд; type
+  NUM,            // a - индекс значения в numbers
+  VAR,            // a - имя; b - slot, c - depth; type
+  ASSIGN,         // a - переменная (VAR), b - выражение
+  COMPOUND,       // a - список операторов
+  NO_OP,          //
+  TYPE,           // op - INTEGER_TYPE, REAL_TYPE, STRING_TYPE или BOOLEAN_TYPE
+  VAR_DECL,       // a - переменная (VAR), b - тип (TYPE)
+  BLOCK,          // a - список объявлений, b - COMPOUND, c - frame_size
+  PROGRAM,        // a - имя, b - BLOCK
+  STRING_LITERAL, // a - текст
+  BOOLEAN_LITERAL // a - 0 или 1
 };
 
-struct UnaryOp : AST {
-  Token op;
-  std::unique_ptr<AST> expr;
-  UnaryOp(Token o, std::unique_ptr<AST> e)
-      : op(std::move(o)), expr(std::move(e)) {}
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct Num : AST {
-  Token token;
-  double value;
-  explicit Num(Token t) : token(std::move(t)) {
-    value = std::stod(token.value);
+// Дерево программы, разложенное по столбцам (struct of arrays): узел - это
+// индекс, дети - 32-битные индексы, тексты интернированы. Parser добавляет
+// узлы в конец столбцов, поэтому разбор не выделяет память на каждый узел,
+// а освобождение дерева - это несколько вызовов delete.
+class AST {
+public:
+  // Адрес переменной, который назначает SemanticAnalyzer: slot - индекс в
+  // кадре области, depth - сколько областей видимости подняться от текущей
+  static constexpr uint32_t UNRESOLVED = UINT32_MAX;
+
+  std::vector<NodeKind> kind;
+  std::vector<TokenType> op;
+  std::vector<ValueType> type;
+  std::vector<uint32_t> a;
+  std::vector<uint32_t> b;
+  std::vector<uint32_t> c;
+
+  // Списки детей подряд: длина, затем элементы
+  std::vector<NodeId> lists;
+  std::vector<double> numbers;
+  StringPool strings;
+
+  NodeId root = NO_NODE;
+  // SemanticAnalyzer уже проверил дерево и разрешил переменные
+  bool analyzed = false;
+
+  NodeId add(NodeKind node_kind, uint32_t na = 0, uint32_t nb = 0,
+             uint32_t nc = 0, TokenType node_op = TokenType::EOF_TOKEN) {
+    kind.push_back(node_kind);
+    op.push_back(node_op);
+    type.push_back(ValueType::NONE);
+    a.push_back(na);
+    b.push_back(nb);
+    c.push_back(nc);
+    return static_cast<NodeId>(kind.size() - 1);
   }
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct Var : AST {
-  Token token;
-  std::string name;
-  explicit Var(Token t) : token(std::move(t)), name(token.value) {}
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct Assign : AST {
-  std::unique_ptr<Var> left;
-  Token op;
-  std::unique_ptr<AST> right;
-  Assign(std::unique_ptr<Var> l, Token o, std::unique_ptr<AST> r)
-      : left(std::move(l)), op(std::move(o)), right(std::move(r)) {}
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct Compound : AST {
-  std::vector<std::unique_ptr<AST>> children;
-  void accept(NodeVisitor &visitor) override;
-};
 
-struct NoOp : AST {
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct Type : AST {
-  Token token;
-  explicit Type(Token t) : token(std::move(t)) {}
-  void accept(NodeVisitor &visitor) override;
-};
-
-struct VarDecl : AST {
-  std::unique_ptr<Var> var_node;
-  std::unique_ptr<AST> type_node;
-  VarDecl(std::unique_ptr<Var> var, std::unique_ptr<AST> type)
-      : var_node(std::move(var)), type_node(std::move(type)) {}
-  void accept(NodeVisitor &visitor) override;
-};
+  uint32_t add_list(std::span<const NodeId> items) {
+    auto ref = static_cast<uint32_t>(lists.size());
+    lists.push_back(static_cast<NodeId>(items.size()));
+    lists.insert(lists.end(), items.begin(), items.end());
+    return ref;
+  }
 
-struct Block : AST {
-  std::vector<std::unique_ptr<AST>> declarations;
-  std::unique_ptr<AST> compound_statement;
-  Block(std::vector<std::unique_ptr<AST>> decls, std::unique_ptr<AST> compound)
-      : declarations(std::move(decls)),
-        compound_statement(std::move(compound)) {}
-  void accept(NodeVisitor &visitor) override;
-};
+  std::span<const NodeId> list(uint32_t ref) const {
+    return {lists.data() + ref + 1, lists[ref]};
+  }
 
-struct Program : AST {
-  std::string name;
-  std::unique_ptr<AST> block;
-  Program(std::string n, std::unique_ptr<AST> b)
-      : name(std::move(n)), block(std::move(b)) {}
-  void accept(NodeVisitor &visitor) override;
-};
+  // Имя или текст узла VAR, PROGRAM или STRING_LITERAL
+  std::string_view text(NodeId node) const { return strings.view(a[node]); }
 
-struct StringLiteral : AST {
-  Token token;
-  std::string value;
-  explicit StringLiteral(Token t) : token(std::move(t)), value(token.value) {}
-  void accept(NodeVisitor &visitor) override;
+  size_t size() const { return kind.size(); }
 };
 
-struct BooleanLiteral : AST {
-  Token token;
-  bool value;
-  explicit BooleanLiteral(Token t) : token(std::move(t)) {
-    value = (token.value == "TRUE");
+// Обход дерева: Derived реализует visit_<вид узла>(NodeId) для каждого вида,
+// visit() выбирает метод по kind без виртуальных вызовов
+template <typename Derived> class NodeVisitor {
+public:
+  void visit(NodeId node) {
+    auto &self = static_cast<Derived &>(*this);
+    switch (tree_->kind[node]) {
+    case NodeKind::BIN_OP:
+      self.visit_bin_op(node);
+      break;
+    case NodeKind::UNARY_OP:
+      self.visit_unary_op(node);
+      break;
+    case NodeKind::NUM:
+      self.visit_num(node);
+      break;
+    case NodeKind::VAR:
+      self.visit_var(node);
+      break;
+    case NodeKind::ASSIGN:
+      self.visit_assign(node);
+      break;
+    case NodeKind::COMPOUND:
+      self.visit_compound(node);
+      break;
+    case NodeKind::NO_OP:
+      self.visit_no_op(node);
+      break;
+    case NodeKind::TYPE:
+      self.visit_type(node);
+      break;
+    case NodeKind::VAR_DECL:
+      self.visit_var_decl(node);
+      break;
+    case NodeKind::BLOCK:
+      self.visit_block(node);
+      break;
+    case NodeKind::PROGRAM:
+      self.visit_program(node);
+      break;
+    case NodeKind::STRING_LITERAL:
+      self.visit_string_literal(node);
+      break;
+    case NodeKind::BOOLEAN_LITERAL:
+      self.visit_boolean_literal(node);
+      break;
+    }
   }
-  void accept(NodeVisitor &visitor) override;
-};
 
-struct NodeVisitor {
-  virtual void visit(BinOp &node) = 0;
-  virtual void visit(UnaryOp &node) = 0;
-  virtual void visit(Num &node) = 0;
-  virtual void visit(Var &node) = 0;
-  virtual void visit(Assign &node) = 0;
-  virtual void visit(Compound &node) = 0;
-  virtual void visit(NoOp &node) = 0;
-  virtual void visit(Program &node) = 0;
-  virtual void visit(Block &node) = 0;
-  virtual void visit(VarDecl &node) = 0;
-  virtual void visit(Type &node) = 0;
-  virtual void visit(StringLiteral &node) = 0;
-  virtual void visit(BooleanLiteral &node) = 0;
-  virtual ~NodeVisitor() = default;
+protected:
+  // Дерево текущего обхода
+  AST *tree_ = nullptr;
 };
 
-inline void BinOp::accept(NodeVisitor &v) { v.visit(*this); }
-inline void UnaryOp::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Num::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Var::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Assign::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Compound::accept(NodeVisitor &v) { v.visit(*this); }
-inline void NoOp::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Program::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Block::accept(NodeVisitor &v) { v.visit(*this); }
-inline void VarDecl::accept(NodeVisitor &v) { v.visit(*this); }
-inline void Type::accept(NodeVisitor &v) { v.visit(*this); }
-inline void StringLiteral::accept(NodeVisitor &v) { v.visit(*this); }
-inline void BooleanLiteral::accept(NodeVisitor &v) { v.visit(*this); }
-
 #endif // AST_H
@@ -10,6 +10,7 @@ struct Config {
   std::string input_file;
   bool variables_to_json = false;
   bool beauty_output = false;
+  bool ast_interpreter = false;
   std::string json_output_file;
 };
 
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump-аллокатор: раздает память подряд из крупных блоков и освобождает все
+// разом в деструкторе. Блоки не перемещаются, поэтому выданные указатели
+// остаются действительными, в том числе после перемещения самой Arena.
+// Выравнивание - не больше __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+class Arena {
+public:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    size_t offset = (used_ + align - 1) & ~(align - 1);
+    if (blocks_.empty() || offset + size > capacity_) {
+      capacity_ = std::max(BLOCK_SIZE, size);
+      blocks_.push_back(std::make_unique_for_overwrite<char[]>(capacity_));
+      offset = 0;
+    }
+    used_ = offset + size;
+    return blocks_.back().get() + offset;
+  }
+
+  // Копия текста, которая живет столько же, сколько Arena
+  std::string_view copy(std::string_view text) {
+    if (text.empty())
+      return {};
+    auto data = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return {data, text.size()};
+  }
+
+private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t used_ = 0;
+  size_t capacity_ = 0;
+};
+
+#endif // ARENA_H
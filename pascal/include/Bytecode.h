@@ -0,0 +1,57 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "Types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Байткод регистровой машины (VM).
+//
+// Типы всех выражений известны после SemanticAnalyzer, поэтому регистры
+// разложены по банкам без упаковки в Value: INTEGER, REAL, BOOLEAN и STRING.
+// Операнд - номер регистра в банке, который определяется кодом операции.
+// В каждом банке сначала идут переменные, затем литералы, затем временные
+// значения выражений; переменная или литерал читаются прямо из своей ячейки.
+enum class OpCode : uint8_t {
+  ADD_REAL,      // reals[a] := reals[b] + reals[c]
+  SUB_REAL,      // reals[a] := reals[b] - reals[c]
+  MUL_REAL,      // reals[a] := reals[b] * reals[c]
+  DIV_REAL,      // reals[a] := reals[b] / reals[c], ошибка при делении на 0
+  NEG_REAL,      // reals[a] := -reals[b]
+  CONCAT,        // strings[a] := strings[b] + strings[c]
+  INT_TO_REAL,   // reals[a] := ints[b]
+  REAL_TO_INT,   // ints[a] := int(reals[b]), с отбрасыванием дробной части
+  MOVE_INT,      // ints[a] := ints[b]
+  MOVE_REAL,     // reals[a] := reals[b]
+  MOVE_BOOL,     // bools[a] := bools[b]
+  MOVE_STRING,   // strings[a] := strings[b]
+  FAIL           // ошибка исполнения: messages[a]
+};
+
+struct Instruction {
+  OpCode op;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t c = 0;
+};
+
+struct Chunk {
+  std::vector<Instruction> code;
+  // Начальное содержимое банков, включая временные регистры
+  std::vector<int64_t> ints;
+  std::vector<double> reals;
+  std::vector<uint8_t> bools;
+  std::vector<std::string> strings;
+
+  // Переменные программы: где лежит значение и как вернуть его в Value
+  struct Variable {
+    std::string name;
+    ValueType type;
+    uint32_t reg;
+  };
+  std::vector<Variable> variables;
+  std::vector<std::string> messages;
+};
+
+#endif // BYTECODE_H
@@ -0,0 +1,68 @@
+#ifndef BYTECODE_COMPILER_H
+#define BYTECODE_COMPILER_H
+
+#include "AST.h"
+#include "Bytecode.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Переводит AST в байткод регистровой машины, выбирая операции по типам,
+// которые вычислил SemanticAnalyzer. Переменная занимает регистр в банке
+// своего типа; в языке одна область видимости, так что depth всегда 0.
+// Ошибки типов, о которых Interpreter сообщает при исполнении, становятся
+// FAIL на том же месте программы.
+class BytecodeCompiler : public NodeVisitor<BytecodeCompiler> {
+public:
+  Chunk compile(AST *tree);
+
+  void visit_program(NodeId node);
+  void visit_block(NodeId node);
+  void visit_var_decl(NodeId node);
+  void visit_type(NodeId node);
+  void visit_string_literal(NodeId node);
+  void visit_boolean_literal(NodeId node);
+  void visit_compound(NodeId node);
+  void visit_no_op(NodeId node);
+  void visit_assign(NodeId node);
+  void visit_var(NodeId node);
+  void visit_num(NodeId node);
+  void visit_unary_op(NodeId node);
+  void visit_bin_op(NodeId node);
+
+private:
+  // Временные регистры нумеруются с TEMP_FLAG (у строк еще и с STRING_FLAG),
+  // пока не известно число литералов; compile() переносит их в конец банка
+  static constexpr uint32_t TEMP_FLAG = 0x80000000u;
+  static constexpr uint32_t STRING_FLAG = 0x40000000u;
+
+  // Значение выражения: тип и регистр в банке этого типа
+  struct Operand {
+    ValueType type = ValueType::NONE;
+    uint32_t reg = 0;
+  };
+
+  Chunk chunk_;
+  std::map<double, uint32_t> real_constants_;
+  // Ключ - символ текста в AST::strings
+  std::map<uint32_t, uint32_t> string_constants_;
+  std::map<bool, uint32_t> bool_constants_;
+  // Регистры переменных по слотам SemanticAnalyzer
+  std::vector<uint32_t> var_regs_;
+  // Временные регистры бывают только у REAL и STRING
+  uint32_t next_real_temp_ = 0;
+  uint32_t next_string_temp_ = 0;
+  uint32_t real_temps_ = 0;
+  uint32_t string_temps_ = 0;
+  Operand result_;
+
+  uint32_t new_temp(ValueType type);
+  // Освобождает временные регистры выше результата выражения
+  void release_above(const Operand &result);
+  Operand to_real(Operand value);
+  void emit(OpCode op, uint32_t a, uint32_t b = 0, uint32_t c = 0);
+  void fail(const std::string &message);
+  static bool is_temp(uint32_t reg) { return (reg & TEMP_FLAG) != 0; }
+};
+
+#endif // BYTECODE_COMPILER_H
@@ -2,35 +2,39 @@
 #define INTERPRETER_H
 
 #include "AST.h"
-#include "ScopedSymbolTable.h"
 #include "Types.h"
 #include <map>
-#include <memory>
 #include <string>
+#include <vector>
 
-class Interpreter : public NodeVisitor {
+// Эталонный обход AST. Переменные адресуются слотами, которые назначает
+// SemanticAnalyzer (interpret() сам запускает анализ, если его не было):
+// у каждого блока свой плоский кадр std::vector<Value>.
+class Interpreter : public NodeVisitor<Interpreter> {
 private:
   Value current_result;
-  std::shared_ptr<ScopedSymbolTable> current_scope;
+  // Кадры вложенных блоков, последний - текущий
+  std::vector<std::vector<Value>> frames_;
+  std::map<std::string, Value> globals_;
 
-public:
-  std::shared_ptr<ScopedSymbolTable> global_scope;
+  Value &slot(NodeId var);
 
+public:
   std::map<std::string, Value> interpret(AST *tree);
 
-  void visit(Program &node) override;
-  void visit(Block &node) override;
-  void visit(VarDecl &node) override;
-  void visit(Type &node) override;
-  void visit(StringLiteral &node) override;
-  void visit(BooleanLiteral &node) override;
-  void visit(Compound &node) override;
-  void visit(NoOp &node) override;
-  void visit(Assign &node) override;
-  void visit(Var &node) override;
-  void visit(Num &node) override;
-  void visit(UnaryOp &node) override;
-  void visit(BinOp &node) override;
+  void visit_program(NodeId node);
+  void visit_block(NodeId node);
+  void visit_var_decl(NodeId node);
+  void visit_type(NodeId node);
+  void visit_string_literal(NodeId node);
+  void visit_boolean_literal(NodeId node);
+  void visit_compound(NodeId node);
+  void visit_no_op(NodeId node);
+  void visit_assign(NodeId node);
+  void visit_var(NodeId node);
+  void visit_num(NodeId node);
+  void visit_unary_op(NodeId node);
+  void visit_bin_op(NodeId node);
 };
 
 #endif // INTERPRETER_H
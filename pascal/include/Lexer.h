@@ -1,6 +1,7 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "StringPool.h"
 #include "Token.h"
 #include <string>
 
@@ -10,11 +11,17 @@ public:
 
   Token get_next_token();
 
+  // Символы из Token::symbol: имена ID и тексты STRING_LITERAL
+  const StringPool &symbols() const { return symbols_; }
+  // Отдает таблицу символов, например в AST, когда разбор закончен
+  StringPool take_symbols() { return std::move(symbols_); }
+
 private:
   std::string text_;
   size_t pos_;
   int line_;
   int column_;
+  StringPool symbols_;
 
   void advance();
   char peek() const;
@@ -15,21 +15,27 @@ public:
 private:
   Lexer &lexer_;
   Token current_token_;
+  std::unique_ptr<AST> tree_;
+  // Стек собираемых списков детей: вложенный список кладется поверх
+  // внешнего и снимается, когда переносится в AST::lists
+  std::vector<NodeId> pending_;
 
   void eat(TokenType type);
-  std::unique_ptr<AST> program();
-  std::unique_ptr<AST> block();
-  std::vector<std::unique_ptr<AST>> declarations();
-  std::vector<std::unique_ptr<AST>> variable_declaration();
-  std::unique_ptr<AST> type_spec();
-  std::unique_ptr<AST> compound_statement();
-  std::vector<std::unique_ptr<AST>> statement_list();
-  std::unique_ptr<AST> statement();
-  std::unique_ptr<AST> assignment();
-  std::unique_ptr<Var> variable();
-  std::unique_ptr<AST> expr();
-  std::unique_ptr<AST> term();
-  std::unique_ptr<AST> factor();
+  NodeId program();
+  NodeId block();
+  void declarations();
+  void variable_declaration();
+  NodeId type_spec();
+  NodeId compound_statement();
+  void statement_list();
+  NodeId statement();
+  NodeId assignment();
+  NodeId variable();
+  NodeId expr();
+  NodeId term();
+  NodeId factor();
+  // Переносит pending_ начиная с mark в AST::lists
+  uint32_t take_list(size_t mark);
 };
 
 #endif // PARSER_H
@@ -6,6 +6,8 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 
 class ScopedSymbolTable {
 public:
@@ -15,9 +17,35 @@ public:
       : scope_name_(std::move(scope_name)), scope_level_(scope_level),
         enclosing_scope_(std::move(enclosing_scope)) {}
 
-  void define(const std::string &name, Value value) { symbols_[name] = value; }
+  // Новое имя получает следующий свободный слот кадра этой области;
+  // повторное определение сохраняет прежний слот
+  void define(std::string_view name, Value value) {
+    auto it = symbols_.find(name);
+    if (it != symbols_.end()) {
+      it->second = std::move(value);
+      return;
+    }
+    symbols_.emplace(name, std::move(value));
+    slots_.emplace(name, static_cast<int>(slots_.size()));
+  }
 
-  std::optional<Value> lookup(const std::string &name,
+  // (depth, slot): на сколько областей подняться и индекс в их кадре
+  std::optional<std::pair<int, int>> resolve(std::string_view name) const {
+    auto it = slots_.find(name);
+    if (it != slots_.end()) {
+      return std::make_pair(0, it->second);
+    }
+    if (enclosing_scope_) {
+      if (auto outer = enclosing_scope_->resolve(name)) {
+        return std::make_pair(outer->first + 1, outer->second);
+      }
+    }
+    return std::nullopt;
+  }
+
+  int slot_count() const { return static_cast<int>(slots_.size()); }
+
+  std::optional<Value> lookup(std::string_view name,
                               bool current_scope_only = false) {
     auto it = symbols_.find(name);
     if (it != symbols_.end()) {
@@ -32,26 +60,30 @@ public:
     return std::nullopt;
   }
 
-  void assign(const std::string &name, Value value) {
+  void assign(std::string_view name, Value value) {
     auto it = symbols_.find(name);
     if (it != symbols_.end()) {
-      symbols_[name] = value;
+      it->second = std::move(value);
       return;
     }
     if (enclosing_scope_) {
       enclosing_scope_->assign(name, value);
       return;
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    throw std::runtime_error("Undefined variable: " + std::string(name));
   }
 
-  const std::map<std::string, Value> &get_symbols() const { return symbols_; }
+  const std::map<std::string, Value, std::less<>> &get_symbols() const {
+    return symbols_;
+  }
 
 private:
   std::string scope_name_;
   int scope_level_;
   std::shared_ptr<ScopedSymbolTable> enclosing_scope_;
-  std::map<std::string, Value> symbols_;
+  // std::less<> - поиск по string_view без временной std::string
+  std::map<std::string, Value, std::less<>> symbols_;
+  std::map<std::string, int, std::less<>> slots_;
 };
 
 #endif // SCOPED_SYMBOL_TABLE_H
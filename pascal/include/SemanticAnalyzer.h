@@ -5,27 +5,34 @@
 #include "ScopedSymbolTable.h"
 #include <memory>
 
-class SemanticAnalyzer : public NodeVisitor {
+class SemanticAnalyzer : public NodeVisitor<SemanticAnalyzer> {
 public:
   SemanticAnalyzer();
-  void visit(Block &node) override;
-  void visit(Program &node) override;
-  void visit(Compound &node) override;
-  void visit(NoOp &node) override;
-  void visit(VarDecl &node) override;
-  void visit(Type &node) override;
-  void visit(StringLiteral &node) override;
-  void visit(BooleanLiteral &node) override;
-  void visit(Assign &node) override;
-  void visit(Var &node) override;
-  void visit(BinOp &node) override;
-  void visit(UnaryOp &node) override;
-  void visit(Num &node) override;
+  void visit_block(NodeId node);
+  void visit_program(NodeId node);
+  void visit_compound(NodeId node);
+  void visit_no_op(NodeId node);
+  void visit_var_decl(NodeId node);
+  void visit_type(NodeId node);
+  void visit_string_literal(NodeId node);
+  void visit_boolean_literal(NodeId node);
+  void visit_assign(NodeId node);
+  void visit_var(NodeId node);
+  void visit_bin_op(NodeId node);
+  void visit_unary_op(NodeId node);
+  void visit_num(NodeId node);
 
   void analyze(AST *tree);
+  // Анализирует дерево, если этого еще не сделали: Interpreter и
+  // BytecodeCompiler адресуют переменные по слотам, которые назначает анализ
+  static void ensure_analyzed(AST *tree);
 
 private:
   std::shared_ptr<ScopedSymbolTable> current_scope;
+  // Тип последнего проверенного выражения
+  ValueType current_type = ValueType::NONE;
+
+  void resolve(NodeId var);
 };
 
 #endif // SEMANTIC_ANALYZER_H
@@ -0,0 +1,106 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Таблица интернирования: каждая различная строка хранится один раз (в Arena)
+// и получает номер-символ. Номера плотные, с 0, в порядке добавления, так что
+// по ним можно индексировать массивы. Поиск - открытая адресация.
+//
+// Имена (intern_name) сравниваются без учета регистра и хранятся в верхнем
+// регистре, как принято в Pascal; прочие строки (intern) - как есть. Имя и
+// строка с тем же текстом - разные символы.
+class StringPool {
+public:
+  uint32_t intern(std::string_view text) { return insert(text, false); }
+  uint32_t intern_name(std::string_view name) { return insert(name, true); }
+
+  std::string_view view(uint32_t id) const { return strings_[id]; }
+  size_t size() const { return strings_.size(); }
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  struct Slot {
+    uint32_t id = EMPTY;
+    uint32_t hash = 0;
+  };
+
+  Arena arena_;
+  std::vector<std::string_view> strings_;
+  std::vector<uint8_t> names_; // 1 - символ из intern_name
+  // Размер - степень двойки, заполнена не больше чем наполовину
+  std::vector<Slot> slots_;
+
+  static constexpr char to_upper(char c) {
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+  }
+
+  // FNV-1a без учета регистра букв, общий для имен и строк
+  static uint32_t hash(std::string_view text) {
+    uint32_t h = 2166136261u;
+    for (char c : text) {
+      h = (h ^ static_cast<unsigned char>(to_upper(c))) * 16777619u;
+    }
+    return h;
+  }
+
+  bool matches(uint32_t id, std::string_view text, bool name) const {
+    std::string_view stored = strings_[id];
+    if (names_[id] != name || stored.size() != text.size())
+      return false;
+    if (!name)
+      return stored == text;
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (to_upper(text[i]) != stored[i])
+        return false;
+    }
+    return true;
+  }
+
+  std::string_view copy_upper(std::string_view text) {
+    if (text.empty())
+      return {};
+    auto data = static_cast<char *>(arena_.allocate(text.size(), 1));
+    std::transform(text.begin(), text.end(), data, to_upper);
+    return {data, text.size()};
+  }
+
+  uint32_t insert(std::string_view text, bool name) {
+    if ((strings_.size() + 1) * 2 > slots_.size())
+      grow();
+    uint32_t h = hash(text);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      Slot &slot = slots_[i];
+      if (slot.id == EMPTY) {
+        slot = {static_cast<uint32_t>(strings_.size()), h};
+        strings_.push_back(name ? copy_upper(text) : arena_.copy(text));
+        names_.push_back(name);
+        return slot.id;
+      }
+      if (slot.hash == h && matches(slot.id, text, name))
+        return slot.id;
+    }
+  }
+
+  void grow() {
+    std::vector<Slot> old = std::move(slots_);
+    slots_.assign(std::max<size_t>(16, old.size() * 2), Slot{});
+    size_t mask = slots_.size() - 1;
+    for (const Slot &slot : old) {
+      if (slot.id == EMPTY)
+        continue;
+      size_t i = slot.hash & mask;
+      while (slots_[i].id != EMPTY)
+        i = (i + 1) & mask;
+      slots_[i] = slot;
+    }
+  }
+};
+
+#endif // STRING_POOL_H
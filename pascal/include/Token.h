@@ -1,9 +1,10 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
-#include <string>
+#include <cstdint>
+#include <string_view>
 
-enum class TokenType {
+enum class TokenType : uint8_t {
   INTEGER,
   PLUS,
   MINUS,
@@ -30,11 +31,18 @@ enum class TokenType {
   BOOLEAN_TYPE
 };
 
+// Token::symbol токенов, которым символ не нужен
+inline constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+
 struct Token {
   TokenType type;
-  std::string value;
+  // Текст токена в исходнике Lexer (у ключевых слов - каноническое написание
+  // в верхнем регистре); действителен, пока жив Lexer
+  std::string_view value;
   int line;
   int column;
+  // У ID и STRING_LITERAL - номер в Lexer::symbols(); у ID без учета регистра
+  uint32_t symbol = NO_SYMBOL;
 };
 
 #endif // TOKEN_H
@@ -1,12 +1,54 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <variant>
 
 using Value = std::variant<std::monostate, int, double, bool, std::string>;
 
+// Статический тип выражения; значения совпадают с индексами альтернатив
+// Value. NONE - выражение, вычисление которого всегда заканчивается ошибкой
+enum class ValueType : uint8_t { NONE, INTEGER, REAL, BOOLEAN, STRING };
+
+inline bool is_number(ValueType type) {
+  return type == ValueType::INTEGER || type == ValueType::REAL;
+}
+
+// Имя типа по индексу альтернативы Value (для сообщений об ошибках)
+inline std::string get_type_name(size_t index) {
+  switch (index) {
+  case 0:
+    return "None";
+  case 1:
+    return "Integer";
+  case 2:
+    return "Real";
+  case 3:
+    return "Boolean";
+  case 4:
+    return "String";
+  default:
+    return "Unknown";
+  }
+}
+
+inline std::string get_type_name(ValueType type) {
+  return get_type_name(static_cast<size_t>(type));
+}
+
+// Функция для получения двойного значения из значения
+inline double get_double(const Value &v) {
+  if (std::holds_alternative<double>(v))
+    return std::get<double>(v);
+  if (std::holds_alternative<int>(v))
+    return static_cast<double>(std::get<int>(v));
+  throw std::runtime_error("Runtime error: Expected number, got " +
+                           get_type_name(v.index()));
+}
+
 // Helper для печати Value
 struct ValuePrinter {
   void operator()(std::monostate) const { std::cout << "None"; }
@@ -0,0 +1,26 @@
+#ifndef VM_H
+#define VM_H
+
+#include "Bytecode.h"
+#include "Types.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Регистровая машина для байткода BytecodeCompiler. Семантика (приведение
+// типов при присваивании, тексты ошибок) совпадает с Interpreter, который
+// остается эталонной реализацией (--ast-interpreter). Типы проверил
+// компилятор, поэтому регистры хранят значения без Value; в Value они
+// упаковываются только в результате run().
+class VM {
+public:
+  std::map<std::string, Value> run(const Chunk &chunk);
+
+private:
+  std::vector<int64_t> ints_;
+  std::vector<double> reals_;
+  std::vector<uint8_t> bools_;
+  std::vector<std::string> strings_;
+};
+
+#endif // VM_H
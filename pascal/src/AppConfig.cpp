@@ -11,6 +11,8 @@ Config AppUtils::parse_args(const std::vector<std::string> &args) {
       config.variables_to_json = true;
     } else if (args[i] == "--beauty-variables-output") {
       config.beauty_output = true;
+    } else if (args[i] == "--ast-interpreter") {
+      config.ast_interpreter = true;
     } else if (args[i] == "--json-output-file") {
       if (i + 1 < args.size()) {
         config.json_output_file = args[++i];
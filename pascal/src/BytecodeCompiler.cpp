@@ -0,0 +1,280 @@
+#include "BytecodeCompiler.h"
+#include "SemanticAnalyzer.h"
+#include <algorithm>
+
+Chunk BytecodeCompiler::compile(AST *tree) {
+  chunk_ = Chunk{};
+  real_constants_.clear();
+  string_constants_.clear();
+  bool_constants_.clear();
+  var_regs_.clear();
+  next_real_temp_ = next_string_temp_ = 0;
+  real_temps_ = string_temps_ = 0;
+
+  if (tree) {
+    SemanticAnalyzer::ensure_analyzed(tree);
+    tree_ = tree;
+    visit(tree->root);
+  }
+
+  // Временные регистры - в конец своих банков, после литералов
+  uint32_t real_base = static_cast<uint32_t>(chunk_.reals.size());
+  uint32_t string_base = static_cast<uint32_t>(chunk_.strings.size());
+  auto relocate = [&](uint32_t &reg) {
+    if (!is_temp(reg))
+      return;
+    if (reg & STRING_FLAG)
+      reg = string_base + (reg & ~(TEMP_FLAG | STRING_FLAG));
+    else
+      reg = real_base + (reg & ~TEMP_FLAG);
+  };
+  for (auto &ins : chunk_.code) {
+    if (ins.op == OpCode::FAIL)
+      continue; // a - номер сообщения, а не регистр
+    relocate(ins.a);
+    relocate(ins.b);
+    relocate(ins.c);
+  }
+  chunk_.reals.resize(real_base + real_temps_, 0.0);
+  chunk_.strings.resize(string_base + string_temps_);
+  return std::move(chunk_);
+}
+
+uint32_t BytecodeCompiler::new_temp(ValueType type) {
+  if (type == ValueType::STRING) {
+    uint32_t reg = next_string_temp_++;
+    string_temps_ = std::max(string_temps_, next_string_temp_);
+    return TEMP_FLAG | STRING_FLAG | reg;
+  }
+  uint32_t reg = next_real_temp_++;
+  real_temps_ = std::max(real_temps_, next_real_temp_);
+  return TEMP_FLAG | reg;
+}
+
+void BytecodeCompiler::release_above(const Operand &result) {
+  uint32_t index = result.reg & ~(TEMP_FLAG | STRING_FLAG);
+  if (result.type == ValueType::STRING)
+    next_string_temp_ = index + 1;
+  else
+    next_real_temp_ = index + 1;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::to_real(Operand value) {
+  if (value.type != ValueType::INTEGER)
+    return value;
+  uint32_t target = new_temp(ValueType::REAL);
+  emit(OpCode::INT_TO_REAL, target, value.reg);
+  return {ValueType::REAL, target};
+}
+
+void BytecodeCompiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c) {
+  chunk_.code.push_back({op, a, b, c});
+}
+
+void BytecodeCompiler::fail(const std::string &message) {
+  chunk_.messages.push_back(message);
+  emit(OpCode::FAIL, static_cast<uint32_t>(chunk_.messages.size() - 1));
+}
+
+void BytecodeCompiler::visit_program(NodeId node) { visit(tree_->b[node]); }
+
+void BytecodeCompiler::visit_block(NodeId node) {
+  var_regs_.assign(tree_->c[node], 0);
+  for (NodeId decl : tree_->list(tree_->a[node])) {
+    visit(decl);
+  }
+  visit(tree_->b[node]);
+}
+
+void BytecodeCompiler::visit_var_decl(NodeId node) {
+  // Значения по умолчанию те же, что у Interpreter::visit_var_decl
+  NodeId var = tree_->a[node];
+  ValueType type = tree_->type[var];
+  uint32_t reg;
+  switch (type) {
+  case ValueType::INTEGER:
+    reg = static_cast<uint32_t>(chunk_.ints.size());
+    chunk_.ints.push_back(0);
+    break;
+  case ValueType::BOOLEAN:
+    reg = static_cast<uint32_t>(chunk_.bools.size());
+    chunk_.bools.push_back(0);
+    break;
+  case ValueType::STRING:
+    reg = static_cast<uint32_t>(chunk_.strings.size());
+    chunk_.strings.emplace_back();
+    break;
+  default:
+    reg = static_cast<uint32_t>(chunk_.reals.size());
+    chunk_.reals.push_back(0.0);
+    break;
+  }
+  var_regs_[tree_->b[var]] = reg;
+  chunk_.variables.push_back({std::string(tree_->text(var)), type, reg});
+}
+
+void BytecodeCompiler::visit_type(NodeId node) {
+  // No-op
+}
+
+// Литералы идут в банки после переменных: объявления предшествуют
+// операторам. Одинаковые литералы делят один регистр
+
+void BytecodeCompiler::visit_string_literal(NodeId node) {
+  auto [it, inserted] = string_constants_.try_emplace(
+      tree_->a[node], static_cast<uint32_t>(chunk_.strings.size()));
+  if (inserted)
+    chunk_.strings.emplace_back(tree_->text(node));
+  result_ = {ValueType::STRING, it->second};
+}
+
+void BytecodeCompiler::visit_boolean_literal(NodeId node) {
+  bool value = tree_->a[node] != 0;
+  auto [it, inserted] = bool_constants_.try_emplace(
+      value, static_cast<uint32_t>(chunk_.bools.size()));
+  if (inserted)
+    chunk_.bools.push_back(value);
+  result_ = {ValueType::BOOLEAN, it->second};
+}
+
+void BytecodeCompiler::visit_num(NodeId node) {
+  double value = tree_->numbers[tree_->a[node]];
+  auto [it, inserted] = real_constants_.try_emplace(
+      value, static_cast<uint32_t>(chunk_.reals.size()));
+  if (inserted)
+    chunk_.reals.push_back(value);
+  result_ = {ValueType::REAL, it->second};
+}
+
+void BytecodeCompiler::visit_compound(NodeId node) {
+  for (NodeId child : tree_->list(tree_->a[node])) {
+    visit(child);
+  }
+}
+
+void BytecodeCompiler::visit_no_op(NodeId node) {
+  // Do nothing
+}
+
+void BytecodeCompiler::visit_assign(NodeId node) {
+  visit(tree_->b[node]);
+  Operand value = result_;
+  NodeId var = tree_->a[node];
+  ValueType type = tree_->type[var];
+  uint32_t target = var_regs_[tree_->b[var]];
+
+  // Результат во временном регистре записала последняя инструкция
+  // выражения: пусть она пишет сразу в переменную
+  bool retarget = is_temp(value.reg) && !chunk_.code.empty() &&
+                  chunk_.code.back().op != OpCode::FAIL &&
+                  chunk_.code.back().a == value.reg;
+
+  if (value.type == ValueType::NONE) {
+    // FAIL уже стоит внутри выражения
+  } else if (value.type == type) {
+    switch (type) {
+    case ValueType::INTEGER:
+      emit(OpCode::MOVE_INT, target, value.reg);
+      break;
+    case ValueType::BOOLEAN:
+      emit(OpCode::MOVE_BOOL, target, value.reg);
+      break;
+    case ValueType::STRING:
+      if (retarget)
+        chunk_.code.back().a = target;
+      else
+        emit(OpCode::MOVE_STRING, target, value.reg);
+      break;
+    default:
+      if (retarget)
+        chunk_.code.back().a = target;
+      else
+        emit(OpCode::MOVE_REAL, target, value.reg);
+      break;
+    }
+  } else if (type == ValueType::REAL && value.type == ValueType::INTEGER) {
+    emit(OpCode::INT_TO_REAL, target, value.reg);
+  } else if (type == ValueType::INTEGER && value.type == ValueType::REAL) {
+    emit(OpCode::REAL_TO_INT, target, value.reg);
+  } else {
+    fail("Runtime error: Type mismatch in assignment. Expected " +
+         get_type_name(type) + ", got " + get_type_name(value.type));
+  }
+
+  // Временные значения живут только внутри одного присваивания
+  next_real_temp_ = next_string_temp_ = 0;
+}
+
+void BytecodeCompiler::visit_var(NodeId node) {
+  result_ = {tree_->type[node], var_regs_[tree_->b[node]]};
+}
+
+void BytecodeCompiler::visit_unary_op(NodeId node) {
+  visit(tree_->a[node]);
+  Operand value = result_;
+  if (tree_->type[node] == ValueType::NONE) {
+    if (value.type != ValueType::NONE)
+      fail("Runtime error: Expected number, got " + get_type_name(value.type));
+    result_ = {};
+    return;
+  }
+
+  value = to_real(value);
+  if (tree_->op[node] == TokenType::MINUS) {
+    uint32_t target =
+        is_temp(value.reg) ? value.reg : new_temp(ValueType::REAL);
+    emit(OpCode::NEG_REAL, target, value.reg);
+    value.reg = target;
+  }
+  result_ = value;
+}
+
+void BytecodeCompiler::visit_bin_op(NodeId node) {
+  // INTEGER приводится к REAL сразу после вычисления операнда, чтобы
+  // временные регистры по-прежнему выделялись стеком
+  ValueType type = tree_->type[node];
+  bool real = type == ValueType::REAL;
+  visit(tree_->a[node]);
+  Operand left = real ? to_real(result_) : result_;
+  visit(tree_->b[node]);
+  Operand right = real ? to_real(result_) : result_;
+
+  if (type == ValueType::NONE) {
+    // Interpreter проверяет сначала левый операнд, потом правый
+    if (left.type != ValueType::NONE && right.type != ValueType::NONE)
+      fail("Runtime error: Expected number, got " +
+           get_type_name(is_number(left.type) ? right.type : left.type));
+    result_ = {};
+    return;
+  }
+
+  OpCode op;
+  switch (tree_->op[node]) {
+  case TokenType::PLUS:
+    op = real ? OpCode::ADD_REAL : OpCode::CONCAT;
+    break;
+  case TokenType::MINUS:
+    op = OpCode::SUB_REAL;
+    break;
+  case TokenType::MUL:
+    op = OpCode::MUL_REAL;
+    break;
+  default:
+    op = OpCode::DIV_REAL;
+    break;
+  }
+
+  // Временные регистры выделяются стеком: результат поддерева лежит в самом
+  // нижнем из его регистров, поэтому его можно сразу переиспользовать
+  Operand target{type};
+  if (is_temp(left.reg))
+    target.reg = left.reg;
+  else if (is_temp(right.reg))
+    target.reg = right.reg;
+  else
+    target.reg = new_temp(type);
+  release_above(target);
+
+  emit(op, target.reg, left.reg, right.reg);
+  result_ = target;
+}
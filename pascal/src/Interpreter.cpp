@@ -1,153 +1,137 @@
 #include "Interpreter.h"
+#include "SemanticAnalyzer.h"
 #include <cmath>
 #include <stdexcept>
 #include <variant>
 
-// Helper to get type name
-std::string get_type_name(size_t index) {
-  switch (index) {
-  case 0:
-    return "None";
-  case 1:
-    return "Integer";
-  case 2:
-    return "Real";
-  case 3:
-    return "Boolean";
-  case 4:
-    return "String";
-  default:
-    return "Unknown";
+std::map<std::string, Value> Interpreter::interpret(AST *tree) {
+  frames_.clear();
+  globals_.clear();
+
+  if (tree) {
+    SemanticAnalyzer::ensure_analyzed(tree);
+    tree_ = tree;
+    visit(tree->root);
   }
+  return std::move(globals_);
 }
 
-// Функция для получения двойного значения из значения
-double get_double(const Value &v) {
-  if (std::holds_alternative<double>(v))
-    return std::get<double>(v);
-  if (std::holds_alternative<int>(v))
-    return static_cast<double>(std::get<int>(v));
-  throw std::runtime_error("Runtime error: Expected number, got " +
-                           get_type_name(v.index()));
+Value &Interpreter::slot(NodeId var) {
+  if (tree_->b[var] == AST::UNRESOLVED) {
+    throw std::runtime_error("Undefined variable: " +
+                             std::string(tree_->text(var)));
+  }
+  return frames_[frames_.size() - 1 - tree_->c[var]][tree_->b[var]];
 }
 
-std::map<std::string, Value> Interpreter::interpret(AST *tree) {
-  global_scope = std::make_shared<ScopedSymbolTable>("GLOBAL", 1);
-  current_scope = global_scope;
+void Interpreter::visit_program(NodeId node) { visit(tree_->b[node]); }
 
-  if (tree) {
-    tree->accept(*this);
+void Interpreter::visit_block(NodeId node) {
+  frames_.emplace_back(tree_->c[node]);
+  auto declarations = tree_->list(tree_->a[node]);
+  for (NodeId decl : declarations) {
+    visit(decl);
   }
-  return global_scope->get_symbols();
-}
+  visit(tree_->b[node]);
 
-void Interpreter::visit(Program &node) { node.block->accept(*this); }
-
-void Interpreter::visit(Block &node) {
-  for (const auto &decl : node.declarations) {
-    decl->accept(*this);
+  // Память программы - переменные внешнего блока
+  if (frames_.size() == 1) {
+    for (NodeId decl : declarations) {
+      NodeId var = tree_->a[decl];
+      globals_[std::string(tree_->text(var))] = frames_.back()[tree_->b[var]];
+    }
   }
-  node.compound_statement->accept(*this);
+  frames_.pop_back();
 }
 
-void Interpreter::visit(VarDecl &node) {
+void Interpreter::visit_var_decl(NodeId node) {
   // Определить значение по умолчанию на основе типа, если это возможно, или просто 0,0
-  // Нам нужно привести type_node к Type*, чтобы проверить токен
-  auto type_ptr = dynamic_cast<Type *>(node.type_node.get());
-  if (type_ptr) {
-    if (type_ptr->token.type == TokenType::INTEGER_TYPE) {
-      current_scope->define(node.var_node->name, 0); // int 0
-    } else if (type_ptr->token.type == TokenType::REAL_TYPE) {
-      current_scope->define(node.var_node->name, 0.0); // double 0.0
-    } else if (type_ptr->token.type == TokenType::STRING_TYPE) {
-      current_scope->define(node.var_node->name, std::string(""));
-    } else if (type_ptr->token.type == TokenType::BOOLEAN_TYPE) {
-      current_scope->define(node.var_node->name, false);
-    } else {
-      current_scope->define(node.var_node->name, 0.0);
-    }
+  Value &var = slot(tree_->a[node]);
+  TokenType type = tree_->op[tree_->b[node]];
+  if (type == TokenType::INTEGER_TYPE) {
+    var = 0; // int 0
+  } else if (type == TokenType::REAL_TYPE) {
+    var = 0.0; // double 0.0
+  } else if (type == TokenType::STRING_TYPE) {
+    var = std::string("");
+  } else if (type == TokenType::BOOLEAN_TYPE) {
+    var = false;
   } else {
-    current_scope->define(node.var_node->name, 0.0);
+    var = 0.0;
   }
 }
 
-void Interpreter::visit(Type &node) {
+void Interpreter::visit_type(NodeId node) {
   // No-op
 }
 
-void Interpreter::visit(StringLiteral &node) { current_result = node.value; }
+void Interpreter::visit_string_literal(NodeId node) {
+  current_result = std::string(tree_->text(node));
+}
 
-void Interpreter::visit(BooleanLiteral &node) { current_result = node.value; }
+void Interpreter::visit_boolean_literal(NodeId node) {
+  current_result = tree_->a[node] != 0;
+}
 
-void Interpreter::visit(Compound &node) {
-  for (const auto &child : node.children) {
-    child->accept(*this);
+void Interpreter::visit_compound(NodeId node) {
+  for (NodeId child : tree_->list(tree_->a[node])) {
+    visit(child);
   }
 }
 
-void Interpreter::visit(NoOp &node) {
+void Interpreter::visit_no_op(NodeId node) {
   // Do nothing
 }
 
-void Interpreter::visit(Assign &node) {
-  node.right->accept(*this);
-  auto var_ptr = current_scope->lookup(node.left->name, true);
-  if (var_ptr) {
-    // Разрешить Int -> Real приведение
-    if (std::holds_alternative<double>(*var_ptr) &&
-        std::holds_alternative<int>(current_result)) {
-      current_result = static_cast<double>(std::get<int>(current_result));
-    }
-    // Разрешить преобразование Real -> Int
-    // (поскольку AST хранит все числа как двойные значения)
-    else if (std::holds_alternative<int>(*var_ptr) &&
-             std::holds_alternative<double>(current_result)) {
-      current_result = static_cast<int>(std::get<double>(current_result));
-    } else if (var_ptr->index() != current_result.index()) {
-      throw std::runtime_error(
-          "Runtime error: Type mismatch in assignment. Expected " +
-          get_type_name(var_ptr->index()) + ", got " +
-          get_type_name(current_result.index()));
-    }
-    current_scope->assign(node.left->name, current_result);
-  } else {
-    // Строгий режим: переменная должна быть объявлена
-    throw std::runtime_error("Runtime Error: Undefined variable '" +
-                             node.left->name + "'");
+void Interpreter::visit_assign(NodeId node) {
+  visit(tree_->b[node]);
+  Value &var = slot(tree_->a[node]);
+  // Разрешить Int -> Real приведение
+  if (std::holds_alternative<double>(var) &&
+      std::holds_alternative<int>(current_result)) {
+    current_result = static_cast<double>(std::get<int>(current_result));
   }
-}
-
-void Interpreter::visit(Var &node) {
-  auto val = current_scope->lookup(node.name);
-  if (!val) {
-    throw std::runtime_error("Undefined variable: " + node.name);
+  // Разрешить преобразование Real -> Int
+  // (поскольку AST хранит все числа как двойные значения)
+  else if (std::holds_alternative<int>(var) &&
+           std::holds_alternative<double>(current_result)) {
+    current_result = static_cast<int>(std::get<double>(current_result));
+  } else if (var.index() != current_result.index()) {
+    throw std::runtime_error(
+        "Runtime error: Type mismatch in assignment. Expected " +
+        get_type_name(var.index()) + ", got " +
+        get_type_name(current_result.index()));
   }
-  current_result = *val;
+  var = std::move(current_result);
 }
 
-void Interpreter::visit(Num &node) { current_result = node.value; }
+void Interpreter::visit_var(NodeId node) { current_result = slot(node); }
+
+void Interpreter::visit_num(NodeId node) {
+  current_result = tree_->numbers[tree_->a[node]];
+}
 
-void Interpreter::visit(UnaryOp &node) {
-  node.expr->accept(*this);
+void Interpreter::visit_unary_op(NodeId node) {
+  visit(tree_->a[node]);
   double val = get_double(current_result);
-  if (node.op.type == TokenType::PLUS) {
+  if (tree_->op[node] == TokenType::PLUS) {
     current_result = +val;
-  } else if (node.op.type == TokenType::MINUS) {
+  } else if (tree_->op[node] == TokenType::MINUS) {
     current_result = -val;
   }
 }
 
-void Interpreter::visit(BinOp &node) {
-  node.left->accept(*this);
+void Interpreter::visit_bin_op(NodeId node) {
+  visit(tree_->a[node]);
   Value left_val = current_result;
 
-  node.right->accept(*this);
+  visit(tree_->b[node]);
   Value right_val = current_result;
 
   // Конкатенация строк
   if (std::holds_alternative<std::string>(left_val) &&
       std::holds_alternative<std::string>(right_val) &&
-      node.op.type == TokenType::PLUS) {
+      tree_->op[node] == TokenType::PLUS) {
     current_result =
         std::get<std::string>(left_val) + std::get<std::string>(right_val);
     return;
@@ -157,7 +141,7 @@ void Interpreter::visit(BinOp &node) {
   double l_dbl = get_double(left_val);
   double r_dbl = get_double(right_val);
 
-  switch (node.op.type) {
+  switch (tree_->op[node]) {
   case TokenType::PLUS:
     current_result = l_dbl + r_dbl;
     break;
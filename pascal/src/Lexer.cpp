@@ -1,9 +1,112 @@
 #include "Lexer.h"
-#include <algorithm>
-#include <cctype>
+#include <array>
 #include <format>
 #include <stdexcept>
 
+namespace {
+
+// Классы символов ASCII (как у <cctype> в локали "C"), без обращения к локали
+enum CharClass : uint8_t { SPACE = 1, DIGIT = 2, ALPHA = 4, UNDERSCORE = 8 };
+
+constexpr auto CHAR_CLASSES = [] {
+  std::array<uint8_t, 256> table{};
+  for (int c = 0; c < 256; ++c) {
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+      table[c] = SPACE;
+    else if (c >= '0' && c <= '9')
+      table[c] = DIGIT;
+    else if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))
+      table[c] = ALPHA;
+    else if (c == '_')
+      table[c] = UNDERSCORE;
+  }
+  return table;
+}();
+
+bool is_class(char c, uint8_t classes) {
+  return (CHAR_CLASSES[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+constexpr char to_upper(char c) {
+  return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+struct Keyword {
+  std::string_view text;
+  TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"BEGIN", TokenType::BEGIN},          {"END", TokenType::END},
+    {"PROGRAM", TokenType::PROGRAM},      {"VAR", TokenType::VAR},
+    {"INTEGER", TokenType::INTEGER_TYPE}, {"REAL", TokenType::REAL_TYPE},
+    {"DIV", TokenType::DIV},              {"STRING", TokenType::STRING_TYPE},
+    {"BOOLEAN", TokenType::BOOLEAN_TYPE}, {"TRUE", TokenType::BOOLEAN_CONST},
+    {"FALSE", TokenType::BOOLEAN_CONST},
+};
+
+// Совершенный хеш ключевых слов по длине, первой и последней букве (без
+// учета регистра). Множители подбираются при компиляции так, чтобы у всех
+// ключевых слов были разные ячейки; слово сверяется только с одним кандидатом
+constexpr size_t KEYWORD_SLOTS = 32;
+
+struct KeywordHash {
+  uint32_t length_mul = 0;
+  uint32_t first_mul = 0;
+
+  constexpr size_t operator()(std::string_view word) const {
+    return (word.size() * length_mul +
+            static_cast<unsigned char>(to_upper(word.front())) * first_mul +
+            static_cast<unsigned char>(to_upper(word.back()))) %
+           KEYWORD_SLOTS;
+  }
+};
+
+constexpr KeywordHash KEYWORD_HASH = [] {
+  for (uint32_t length_mul = 1; length_mul < 64; ++length_mul) {
+    for (uint32_t first_mul = 1; first_mul < 64; ++first_mul) {
+      KeywordHash hash{length_mul, first_mul};
+      std::array<bool, KEYWORD_SLOTS> used{};
+      bool perfect = true;
+      for (const Keyword &keyword : KEYWORDS) {
+        size_t slot = hash(keyword.text);
+        perfect = perfect && !used[slot];
+        used[slot] = true;
+      }
+      if (perfect)
+        return hash;
+    }
+  }
+  return KeywordHash{};
+}();
+static_assert(KEYWORD_HASH.length_mul != 0, "no perfect hash for keywords");
+
+// Номер ключевого слова в KEYWORDS по ячейке хеша; -1 - пустая ячейка
+constexpr auto KEYWORD_TABLE = [] {
+  std::array<int8_t, KEYWORD_SLOTS> table{};
+  table.fill(-1);
+  for (size_t i = 0; i < std::size(KEYWORDS); ++i) {
+    table[KEYWORD_HASH(KEYWORDS[i].text)] = static_cast<int8_t>(i);
+  }
+  return table;
+}();
+
+const Keyword *find_keyword(std::string_view word) {
+  int index = KEYWORD_TABLE[KEYWORD_HASH(word)];
+  if (index < 0)
+    return nullptr;
+  const Keyword &keyword = KEYWORDS[index];
+  if (keyword.text.size() != word.size())
+    return nullptr;
+  for (size_t i = 0; i < word.size(); ++i) {
+    if (to_upper(word[i]) != keyword.text[i])
+      return nullptr;
+  }
+  return &keyword;
+}
+
+} // namespace
+
 Lexer::Lexer(std::string text)
     : text_(std::move(text)), pos_(0), line_(1), column_(1) {}
 
@@ -26,7 +129,7 @@ char Lexer::peek() const {
 }
 
 void Lexer::skip_whitespace() {
-  while (pos_ < text_.length() && std::isspace(text_[pos_])) {
+  while (pos_ < text_.length() && is_class(text_[pos_], SPACE)) {
     advance();
   }
 }
@@ -34,25 +137,25 @@ void Lexer::skip_whitespace() {
 Token Lexer::number() {
   int start_col = column_;
   size_t start = pos_;
-  while (pos_ < text_.length() && std::isdigit(text_[pos_])) {
-    advance();
+  while (pos_ < text_.length() && is_class(text_[pos_], DIGIT)) {
+    pos_++;
   }
 
   if (pos_ < text_.length() && text_[pos_] == '.') {
     // Смотрим вперед, чтобы увидеть, действительно ли это число (цифра следует за точкой)
     // Только проверяем, является ли следующий символ цифрой, чтобы разрешить «КОНЕЦ». или диапазоны «1..»
-    if (pos_ + 1 < text_.length() && std::isdigit(text_[pos_ + 1])) {
-      advance();
-      while (pos_ < text_.length() && std::isdigit(text_[pos_])) {
-        advance();
+    if (pos_ + 1 < text_.length() && is_class(text_[pos_ + 1], DIGIT)) {
+      pos_++;
+      while (pos_ < text_.length() && is_class(text_[pos_], DIGIT)) {
+        pos_++;
       }
-      return {TokenType::INTEGER, text_.substr(start, pos_ - start), line_,
-              start_col};
     }
   }
 
-  return {TokenType::INTEGER, text_.substr(start, pos_ - start), line_,
-          start_col};
+  // В числе нет переводов строки
+  column_ += static_cast<int>(pos_ - start);
+  return {TokenType::INTEGER, std::string_view(text_).substr(start, pos_ - start),
+          line_, start_col};
 }
 
 Token Lexer::string_literal() {
@@ -67,49 +170,28 @@ Token Lexer::string_literal() {
     throw std::runtime_error("Unterminated string literal");
   }
 
-  std::string value = text_.substr(start, pos_ - start);
+  auto value = std::string_view(text_).substr(start, pos_ - start);
   advance(); // Пропускаем закрывающую кавычку
-  return {TokenType::STRING_LITERAL, value, line_, start_col};
+  return {TokenType::STRING_LITERAL, value, line_, start_col,
+          symbols_.intern(value)};
 }
 
 Token Lexer::id_or_keyword() {
   int start_col = column_;
   size_t start = pos_;
   while (pos_ < text_.length() &&
-         (std::isalnum(text_[pos_]) || text_[pos_] == '_')) {
-    advance();
+         is_class(text_[pos_], ALPHA | DIGIT | UNDERSCORE)) {
+    pos_++;
   }
-  std::string result = text_.substr(start, pos_ - start);
-
-  // Нормализация к верхнему регистру для внутренней обработки
-  // (Я загуглил, что это стандарт Pascal)
-  // Это фактически делает его нечувствительным к регистру
-  std::string upper_result = result;
-  std::transform(upper_result.begin(), upper_result.end(), upper_result.begin(),
-                 ::toupper);
-
-  if (upper_result == "BEGIN")
-    return {TokenType::BEGIN, upper_result, line_, start_col};
-  if (upper_result == "END")
-    return {TokenType::END, upper_result, line_, start_col};
-  if (upper_result == "PROGRAM")
-    return {TokenType::PROGRAM, upper_result, line_, start_col};
-  if (upper_result == "VAR")
-    return {TokenType::VAR, upper_result, line_, start_col};
-  if (upper_result == "INTEGER")
-    return {TokenType::INTEGER_TYPE, upper_result, line_, start_col};
-  if (upper_result == "REAL")
-    return {TokenType::REAL_TYPE, upper_result, line_, start_col};
-  if (upper_result == "DIV")
-    return {TokenType::DIV, upper_result, line_, start_col};
-  if (upper_result == "STRING")
-    return {TokenType::STRING_TYPE, upper_result, line_, start_col};
-  if (upper_result == "BOOLEAN")
-    return {TokenType::BOOLEAN_TYPE, upper_result, line_, start_col};
-  if (upper_result == "TRUE" || upper_result == "FALSE")
-    return {TokenType::BOOLEAN_CONST, upper_result, line_, start_col};
-
-  return {TokenType::ID, upper_result, line_, start_col};
+  column_ += static_cast<int>(pos_ - start);
+  auto word = std::string_view(text_).substr(start, pos_ - start);
+
+  // Pascal нечувствителен к регистру: ключевые слова сравниваются без учета
+  // регистра, а имя ID - символ, который хранится в верхнем регистре
+  if (const Keyword *keyword = find_keyword(word))
+    return {keyword->type, keyword->text, line_, start_col};
+
+  return {TokenType::ID, word, line_, start_col, symbols_.intern_name(word)};
 }
 
 Token Lexer::get_next_token() {
@@ -122,11 +204,11 @@ Token Lexer::get_next_token() {
   char current = text_[pos_];
   int start_col = column_;
 
-  if (std::isalpha(current)) {
+  if (is_class(current, ALPHA)) {
     return id_or_keyword();
   }
 
-  if (std::isdigit(current)) {
+  if (is_class(current, DIGIT)) {
     return number();
   }
 
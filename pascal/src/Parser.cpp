@@ -1,4 +1,5 @@
 #include "Parser.h"
+#include <charconv>
 #include <format>
 #include <stdexcept>
 
@@ -7,11 +8,15 @@ Parser::Parser(Lexer &lexer) : lexer_(lexer) {
 }
 
 std::unique_ptr<AST> Parser::parse() {
-  auto node = program();
+  tree_ = std::make_unique<AST>();
+  pending_.clear();
+  tree_->root = program();
   if (current_token_.type != TokenType::EOF_TOKEN) {
     throw std::runtime_error("Unexpected token after end of program");
   }
-  return node;
+  // Символы токенов - номера в таблице Lexer, она и становится AST::strings
+  tree_->strings = lexer_.take_symbols();
+  return std::move(tree_);
 }
 
 void Parser::eat(TokenType type) {
@@ -25,29 +30,43 @@ void Parser::eat(TokenType type) {
   }
 }
 
-std::unique_ptr<AST> Parser::factor() {
-  Token token = current_token_;
-  if (token.type == TokenType::PLUS) {
+uint32_t Parser::take_list(size_t mark) {
+  uint32_t ref = tree_->add_list(
+      std::span<const NodeId>(pending_).subspan(mark));
+  pending_.resize(mark);
+  return ref;
+}
+
+NodeId Parser::factor() {
+  TokenType type = current_token_.type;
+  if (type == TokenType::PLUS) {
     eat(TokenType::PLUS);
-    return std::make_unique<UnaryOp>(token, factor());
+    return tree_->add(NodeKind::UNARY_OP, factor(), 0, 0, type);
   }
-  if (token.type == TokenType::MINUS) {
+  if (type == TokenType::MINUS) {
     eat(TokenType::MINUS);
-    return std::make_unique<UnaryOp>(token, factor());
-  }
-  if (token.type == TokenType::INTEGER) {
+    return tree_->add(NodeKind::UNARY_OP, factor(), 0, 0, type);
+  }
+  if (type == TokenType::INTEGER) {
+    std::string_view text = current_token_.value;
+    double value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    auto index = static_cast<uint32_t>(tree_->numbers.size());
+    tree_->numbers.push_back(value);
     eat(TokenType::INTEGER);
-    return std::make_unique<Num>(token);
+    return tree_->add(NodeKind::NUM, index);
   }
-  if (token.type == TokenType::STRING_LITERAL) {
+  if (type == TokenType::STRING_LITERAL) {
+    uint32_t text = current_token_.symbol;
     eat(TokenType::STRING_LITERAL);
-    return std::make_unique<StringLiteral>(token);
+    return tree_->add(NodeKind::STRING_LITERAL, text);
   }
-  if (token.type == TokenType::BOOLEAN_CONST) {
+  if (type == TokenType::BOOLEAN_CONST) {
+    bool value = current_token_.value == "TRUE";
     eat(TokenType::BOOLEAN_CONST);
-    return std::make_unique<BooleanLiteral>(token);
+    return tree_->add(NodeKind::BOOLEAN_LITERAL, value);
   }
-  if (token.type == TokenType::LPAREN) {
+  if (type == TokenType::LPAREN) {
     eat(TokenType::LPAREN);
     auto node = expr();
     eat(TokenType::RPAREN);
@@ -56,65 +75,58 @@ std::unique_ptr<AST> Parser::factor() {
   return variable();
 }
 
-std::unique_ptr<AST> Parser::term() {
+NodeId Parser::term() {
   auto node = factor();
   while (current_token_.type == TokenType::MUL ||
          current_token_.type == TokenType::DIV) {
-    Token token = current_token_;
-    if (token.type == TokenType::MUL)
-      eat(TokenType::MUL);
-    else
-      eat(TokenType::DIV);
-    node = std::make_unique<BinOp>(std::move(node), token, factor());
+    TokenType type = current_token_.type;
+    eat(type);
+    node = tree_->add(NodeKind::BIN_OP, node, factor(), 0, type);
   }
   return node;
 }
 
-std::unique_ptr<AST> Parser::expr() {
+NodeId Parser::expr() {
   auto node = term();
   while (current_token_.type == TokenType::PLUS ||
          current_token_.type == TokenType::MINUS) {
-    Token token = current_token_;
-    if (token.type == TokenType::PLUS)
-      eat(TokenType::PLUS);
-    else
-      eat(TokenType::MINUS);
-    node = std::make_unique<BinOp>(std::move(node), token, term());
+    TokenType type = current_token_.type;
+    eat(type);
+    node = tree_->add(NodeKind::BIN_OP, node, term(), 0, type);
   }
   return node;
 }
 
-std::unique_ptr<Var> Parser::variable() {
-  auto node = std::make_unique<Var>(current_token_);
+NodeId Parser::variable() {
+  uint32_t name = current_token_.symbol;
   eat(TokenType::ID);
-  return node;
+  return tree_->add(NodeKind::VAR, name, AST::UNRESOLVED, AST::UNRESOLVED);
 }
 
-std::unique_ptr<AST> Parser::assignment() {
+NodeId Parser::assignment() {
   auto left = variable();
-  Token token = current_token_;
   eat(TokenType::ASSIGN);
   auto right = expr();
-  return std::make_unique<Assign>(std::move(left), token, std::move(right));
+  return tree_->add(NodeKind::ASSIGN, left, right);
 }
 
-std::unique_ptr<AST> Parser::statement() {
+NodeId Parser::statement() {
   if (current_token_.type == TokenType::BEGIN) {
     return compound_statement();
   }
   if (current_token_.type == TokenType::ID) {
     return assignment();
   }
-  return std::make_unique<NoOp>();
+  return tree_->add(NodeKind::NO_OP);
 }
 
-std::vector<std::unique_ptr<AST>> Parser::statement_list() {
-  std::vector<std::unique_ptr<AST>> results;
-  results.push_back(statement());
+void Parser::statement_list() {
+  pending_.push_back(statement());
 
   while (current_token_.type == TokenType::SEMI) {
     eat(TokenType::SEMI);
-    results.push_back(statement());
+    auto node = statement();
+    pending_.push_back(node);
   }
 
   if (current_token_.type == TokenType::ID ||
@@ -122,94 +134,73 @@ std::vector<std::unique_ptr<AST>> Parser::statement_list() {
     throw std::runtime_error(
         "Error in statement list logic (missing semi-colon?)");
   }
-
-  return results;
 }
 
-std::unique_ptr<AST> Parser::compound_statement() {
+NodeId Parser::compound_statement() {
   eat(TokenType::BEGIN);
-  auto nodes = statement_list();
+  size_t mark = pending_.size();
+  statement_list();
   eat(TokenType::END);
+  return tree_->add(NodeKind::COMPOUND, take_list(mark));
+}
 
-  auto root = std::make_unique<Compound>();
-  root->children = std::move(nodes);
-  return root;
-}
-
-std::unique_ptr<AST> Parser::type_spec() {
-  Token token = current_token_;
-  if (current_token_.type == TokenType::INTEGER_TYPE) {
-    eat(TokenType::INTEGER_TYPE);
-  } else if (current_token_.type == TokenType::REAL_TYPE) {
-    eat(TokenType::REAL_TYPE);
-  } else if (current_token_.type == TokenType::STRING_TYPE) {
-    eat(TokenType::STRING_TYPE);
-  } else if (current_token_.type == TokenType::BOOLEAN_TYPE) {
-    eat(TokenType::BOOLEAN_TYPE);
-  } else {
+NodeId Parser::type_spec() {
+  TokenType type = current_token_.type;
+  if (type != TokenType::INTEGER_TYPE && type != TokenType::REAL_TYPE &&
+      type != TokenType::STRING_TYPE && type != TokenType::BOOLEAN_TYPE) {
     throw std::runtime_error("Unknown type specification");
   }
-  return std::make_unique<Type>(token);
+  eat(type);
+  return tree_->add(NodeKind::TYPE, 0, 0, 0, type);
 }
 
-std::vector<std::unique_ptr<AST>> Parser::variable_declaration() {
-  std::vector<std::unique_ptr<Var>> var_nodes;
-  std::vector<std::unique_ptr<AST>> var_decls;
-
-  var_nodes.push_back(std::make_unique<Var>(current_token_));
-  eat(TokenType::ID);
+void Parser::variable_declaration() {
+  // Переменные кладутся в pending_, затем заменяются на свои VarDecl
+  size_t first = pending_.size();
+  pending_.push_back(variable());
 
   while (current_token_.type == TokenType::COMMA) {
     eat(TokenType::COMMA);
-    var_nodes.push_back(std::make_unique<Var>(current_token_));
-    eat(TokenType::ID);
+    auto node = variable();
+    pending_.push_back(node);
   }
 
   eat(TokenType::COLON);
 
+  // Все VarDecl одного объявления ссылаются на общий узел типа
   auto type_node = type_spec();
-
-  // Создаем VarDesl для каждой переменной с узлом общего типа
-  Token type_token = static_cast<Type *>(type_node.get())->token;
-
-  for (auto &var : var_nodes) {
-    var_decls.push_back(std::make_unique<VarDecl>(
-        std::move(var), std::make_unique<Type>(type_token)));
+  for (size_t i = first; i < pending_.size(); ++i) {
+    pending_[i] = tree_->add(NodeKind::VAR_DECL, pending_[i], type_node);
   }
 
   eat(TokenType::SEMI);
-  return var_decls;
 }
 
-std::vector<std::unique_ptr<AST>> Parser::declarations() {
-  std::vector<std::unique_ptr<AST>> decls;
-
+void Parser::declarations() {
   if (current_token_.type == TokenType::VAR) {
     eat(TokenType::VAR);
     while (current_token_.type == TokenType::ID) {
-      auto var_decl_list = variable_declaration();
-      for (auto &d : var_decl_list) {
-        decls.push_back(std::move(d));
-      }
+      variable_declaration();
     }
   }
-  return decls;
 }
 
-std::unique_ptr<AST> Parser::block() {
-  auto decls = declarations();
+NodeId Parser::block() {
+  size_t mark = pending_.size();
+  declarations();
+  uint32_t decls = take_list(mark);
   auto compound_stmt = compound_statement();
-  return std::make_unique<Block>(std::move(decls), std::move(compound_stmt));
+  return tree_->add(NodeKind::BLOCK, decls, compound_stmt);
 }
 
-std::unique_ptr<AST> Parser::program() {
-  eat(TokenType::PROGRAM);         // PROGRAM keyword
-  Token var_name = current_token_; // Program name
+NodeId Parser::program() {
+  eat(TokenType::PROGRAM); // PROGRAM keyword
+  uint32_t name = current_token_.symbol; // Program name
   eat(TokenType::ID);
   eat(TokenType::SEMI);
 
   auto block_node = block();
 
   eat(TokenType::DOT);
-  return std::make_unique<Program>(var_name.value, std::move(block_node));
+  return tree_->add(NodeKind::PROGRAM, name, block_node);
 }
@@ -6,81 +6,126 @@ SemanticAnalyzer::SemanticAnalyzer() {
   current_scope = std::make_shared<ScopedSymbolTable>("GLOBAL", 1);
 }
 
-void SemanticAnalyzer::analyze(AST *tree) { tree->accept(*this); }
+void SemanticAnalyzer::analyze(AST *tree) {
+  tree_ = tree;
+  visit(tree->root);
+  tree->analyzed = true;
+}
 
-void SemanticAnalyzer::visit(Program &node) { node.block->accept(*this); }
+void SemanticAnalyzer::ensure_analyzed(AST *tree) {
+  if (!tree->analyzed) {
+    SemanticAnalyzer().analyze(tree);
+  }
+}
 
-void SemanticAnalyzer::visit(Block &node) {
-  for (const auto &decl : node.declarations) {
-    decl->accept(*this);
+// Записывает в узел VAR адрес и объявленный тип переменной
+void SemanticAnalyzer::resolve(NodeId var) {
+  std::string_view name = tree_->text(var);
+  auto address = current_scope->resolve(name);
+  if (!address) {
+    throw std::runtime_error("Semantic Error: Undefined variable '" +
+                             std::string(name) + "'");
   }
-  node.compound_statement->accept(*this);
+  tree_->c[var] = address->first;
+  tree_->b[var] = address->second;
+  // Присваивания сохраняют тип переменной, так что он всегда объявленный
+  tree_->type[var] =
+      static_cast<ValueType>(current_scope->lookup(name)->index());
 }
 
-void SemanticAnalyzer::visit(VarDecl &node) {
-  auto type_node = dynamic_cast<Type *>(node.type_node.get());
-  std::string type_name = type_node ? type_node->token.value : "REAL";
+void SemanticAnalyzer::visit_program(NodeId node) { visit(tree_->b[node]); }
 
-  if (current_scope->lookup(node.var_node->name, true)) {
+void SemanticAnalyzer::visit_block(NodeId node) {
+  for (NodeId decl : tree_->list(tree_->a[node])) {
+    visit(decl);
+  }
+  tree_->c[node] = current_scope->slot_count();
+  visit(tree_->b[node]);
+}
+
+void SemanticAnalyzer::visit_var_decl(NodeId node) {
+  NodeId var = tree_->a[node];
+  std::string_view name = tree_->text(var);
+
+  if (current_scope->lookup(name, true)) {
     throw std::runtime_error("Duplicate declaration of identifier: " +
-                             node.var_node->name);
+                             std::string(name));
   }
 
   // Мы определяем значение по умолчанию правильного типа, чтобы отслеживать его существование
-  if (type_name == "INTEGER")
-    current_scope->define(node.var_node->name, 0);
-  else if (type_name == "REAL")
-    current_scope->define(node.var_node->name, 0.0);
-  else if (type_name == "STRING")
-    current_scope->define(node.var_node->name, std::string(""));
-  else if (type_name == "BOOLEAN")
-    current_scope->define(node.var_node->name, false);
+  TokenType type = tree_->op[tree_->b[node]];
+  if (type == TokenType::INTEGER_TYPE)
+    current_scope->define(name, 0);
+  else if (type == TokenType::REAL_TYPE)
+    current_scope->define(name, 0.0);
+  else if (type == TokenType::STRING_TYPE)
+    current_scope->define(name, std::string(""));
+  else if (type == TokenType::BOOLEAN_TYPE)
+    current_scope->define(name, false);
   else
-    current_scope->define(node.var_node->name, 0.0); // Default
+    current_scope->define(name, 0.0); // Default
+
+  resolve(var);
 }
 
-void SemanticAnalyzer::visit(Type &node) {
+void SemanticAnalyzer::visit_type(NodeId node) {
   // No-op
 }
 
-void SemanticAnalyzer::visit(StringLiteral &node) {
-  // No-op
+void SemanticAnalyzer::visit_string_literal(NodeId node) {
+  current_type = ValueType::STRING;
 }
 
-void SemanticAnalyzer::visit(BooleanLiteral &node) {
-  // No-op
+void SemanticAnalyzer::visit_boolean_literal(NodeId node) {
+  current_type = ValueType::BOOLEAN;
 }
 
-void SemanticAnalyzer::visit(Compound &node) {
-  for (const auto &child : node.children) {
-    child->accept(*this);
+void SemanticAnalyzer::visit_compound(NodeId node) {
+  for (NodeId child : tree_->list(tree_->a[node])) {
+    visit(child);
   }
 }
 
-void SemanticAnalyzer::visit(NoOp &node) {
+void SemanticAnalyzer::visit_no_op(NodeId node) {
   // No-op
 }
 
-void SemanticAnalyzer::visit(Assign &node) {
-  node.right->accept(*this);
-  node.left->accept(*this); // Посетите Var, чтобы проверить определение
+void SemanticAnalyzer::visit_assign(NodeId node) {
+  visit(tree_->b[node]);
+  visit(tree_->a[node]); // Посетите Var, чтобы проверить определение
 }
 
-void SemanticAnalyzer::visit(Var &node) {
-  auto val = current_scope->lookup(node.name);
-  if (!val) {
-    throw std::runtime_error("Semantic Error: Undefined variable '" +
-                             node.name + "'");
-  }
+void SemanticAnalyzer::visit_var(NodeId node) {
+  resolve(node);
+  current_type = tree_->type[node];
 }
 
-void SemanticAnalyzer::visit(BinOp &node) {
-  node.left->accept(*this);
-  node.right->accept(*this);
+// Типы выражений повторяют правила Interpreter. Несовпадение типов здесь не
+// ошибка анализа: Interpreter сообщает о нем при исполнении, поэтому
+// выражение получает тип NONE, а BytecodeCompiler ставит на его место FAIL
+void SemanticAnalyzer::visit_bin_op(NodeId node) {
+  visit(tree_->a[node]);
+  ValueType left = current_type;
+  visit(tree_->b[node]);
+  ValueType right = current_type;
+
+  ValueType type;
+  if (left == ValueType::STRING && right == ValueType::STRING &&
+      tree_->op[node] == TokenType::PLUS) {
+    type = ValueType::STRING;
+  } else if (is_number(left) && is_number(right)) {
+    // Арифметика всегда вещественная: литералы - REAL, '/' - деление REAL
+    type = ValueType::REAL;
+  } else {
+    type = ValueType::NONE;
+  }
+  tree_->type[node] = current_type = type;
 }
 
-void SemanticAnalyzer::visit(UnaryOp &node) { node.expr->accept(*this); }
-
-void SemanticAnalyzer::visit(Num &node) {
-  // No-op
+void SemanticAnalyzer::visit_unary_op(NodeId node) {
+  visit(tree_->a[node]);
+  tree_->type[node] = current_type =
+      is_number(current_type) ? ValueType::REAL : ValueType::NONE;
 }
+
+void SemanticAnalyzer::visit_num(NodeId node) { current_type = ValueType::REAL; }
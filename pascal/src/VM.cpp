@@ -0,0 +1,82 @@
+#include "VM.h"
+#include <stdexcept>
+#include <utility>
+
+std::map<std::string, Value> VM::run(const Chunk &chunk) {
+  ints_ = chunk.ints;
+  reals_ = chunk.reals;
+  bools_ = chunk.bools;
+  strings_ = chunk.strings;
+  int64_t *ints = ints_.data();
+  double *reals = reals_.data();
+  uint8_t *bools = bools_.data();
+  std::string *strings = strings_.data();
+
+  for (const Instruction &ins : chunk.code) {
+    switch (ins.op) {
+    case OpCode::ADD_REAL:
+      reals[ins.a] = reals[ins.b] + reals[ins.c];
+      break;
+    case OpCode::SUB_REAL:
+      reals[ins.a] = reals[ins.b] - reals[ins.c];
+      break;
+    case OpCode::MUL_REAL:
+      reals[ins.a] = reals[ins.b] * reals[ins.c];
+      break;
+    case OpCode::DIV_REAL:
+      if (reals[ins.c] == 0)
+        throw std::runtime_error("Division by zero");
+      reals[ins.a] = reals[ins.b] / reals[ins.c];
+      break;
+    case OpCode::NEG_REAL:
+      reals[ins.a] = -reals[ins.b];
+      break;
+    case OpCode::CONCAT:
+      if (ins.a == ins.b)
+        strings[ins.a] += strings[ins.c]; // s := s + ... и цепочки 'a' + 'b'
+      else
+        strings[ins.a] = strings[ins.b] + strings[ins.c];
+      break;
+    case OpCode::INT_TO_REAL:
+      reals[ins.a] = static_cast<double>(ints[ins.b]);
+      break;
+    case OpCode::REAL_TO_INT:
+      ints[ins.a] = static_cast<int>(reals[ins.b]);
+      break;
+    case OpCode::MOVE_INT:
+      ints[ins.a] = ints[ins.b];
+      break;
+    case OpCode::MOVE_REAL:
+      reals[ins.a] = reals[ins.b];
+      break;
+    case OpCode::MOVE_BOOL:
+      bools[ins.a] = bools[ins.b];
+      break;
+    case OpCode::MOVE_STRING:
+      strings[ins.a] = strings[ins.b];
+      break;
+    case OpCode::FAIL:
+      throw std::runtime_error(chunk.messages[ins.a]);
+    }
+  }
+
+  std::map<std::string, Value> memory;
+  for (const auto &var : chunk.variables) {
+    Value &value = memory[var.name];
+    switch (var.type) {
+    case ValueType::INTEGER:
+      value = static_cast<int>(ints[var.reg]);
+      break;
+    case ValueType::BOOLEAN:
+      value = bools[var.reg] != 0;
+      break;
+    case ValueType::STRING:
+      value = std::move(strings[var.reg]);
+      break;
+    default:
+      value = reals[var.reg];
+      break;
+    }
+  }
+  return memory;
+}
@@ -1,8 +1,10 @@
 #include "AppConfig.h"
+#include "BytecodeCompiler.h"
 #include "Interpreter.h"
 #include "Lexer.h"
 #include "Parser.h"
 #include "SemanticAnalyzer.h"
+#include "VM.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -37,9 +39,16 @@ int main(int argc, char *argv[]) {
     SemanticAnalyzer analyzer;
     analyzer.analyze(ast.get());
 
-    // Интерпритация
-    Interpreter interpreter;
-    auto memory = interpreter.interpret(ast.get());
+    // Исполнение: байткод на регистровой машине или эталонный обход AST
+    std::map<std::string, Value> memory;
+    if (config.ast_interpreter) {
+      Interpreter interpreter;
+      memory = interpreter.interpret(ast.get());
+    } else {
+      BytecodeCompiler compiler;
+      VM vm;
+      memory = vm.run(compiler.compile(ast.get()));
+    }
 
     if (config.variables_to_json) {
       std::cout << AppUtils::memory_to_json(memory) << std::endl;
@@ -1,8 +1,10 @@
 #include "AppConfig.h"
+#include "BytecodeCompiler.h"
 #include "Interpreter.h"
 #include "Lexer.h"
 #include "Parser.h"
 #include "SemanticAnalyzer.h"
+#include "VM.h"
 #include <cmath>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -19,7 +21,8 @@ std::string read_file(const std::string &path) {
 }
 
 // Помощник для запуска конвейера и возврата памяти JSON
-std::string run_pipeline(const std::string &filename) {
+// use_vm - исполнять байткод на VM вместо обхода AST
+std::string run_pipeline(const std::string &filename, bool use_vm = false) {
   std::string paths[] = {"examples/" + filename, "../examples/" + filename,
                          "../../examples/" + filename};
   std::string text;
@@ -42,8 +45,13 @@ std::string run_pipeline(const std::string &filename) {
   SemanticAnalyzer analyzer;
   analyzer.analyze(ast.get());
 
-  Interpreter interpreter;
-  auto memory = interpreter.interpret(ast.get());
+  std::map<std::string, Value> memory;
+  if (use_vm) {
+    BytecodeCompiler compiler;
+    memory = VM().run(compiler.compile(ast.get()));
+  } else {
+    memory = Interpreter().interpret(ast.get());
+  }
   return AppUtils::memory_to_json(memory);
 }
 
@@ -114,3 +122,22 @@ TEST_F(IntegrationTest, StringOps) {
 TEST_F(IntegrationTest, BooleanLogic) {
   auto memory_json = run_pipeline("boolean_logic.pas");
 }
+
+// VM должна давать ту же память и те же ошибки, что и эталонный обход AST
+TEST_F(IntegrationTest, VMMatchesAstInterpreter) {
+  const char *examples[] = {"arithmetic.pas",   "bad_addition.pas",
+                            "boolean_logic.pas", "complex_math.pas",
+                            "deep_scope.pas",    "empty.pas",
+                            "feature_showcase.pas", "nested.pas",
+                            "string_ops.pas"};
+  auto outcome = [](const char *name, bool use_vm) {
+    try {
+      return run_pipeline(name, use_vm);
+    } catch (const std::runtime_error &e) {
+      return std::string("error: ") + e.what();
+    }
+  };
+  for (const char *name : examples) {
+    EXPECT_EQ(outcome(name, true), outcome(name, false)) << name;
+  }
+}
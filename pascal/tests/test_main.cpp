@@ -1,7 +1,10 @@
 #include "AppConfig.h"
+#include "BytecodeCompiler.h"
 #include "Interpreter.h"
 #include "Lexer.h"
 #include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "VM.h"
 #include <cmath>
 #include <gtest/gtest.h>
 #include <map>
@@ -25,6 +28,33 @@ TEST(LexerTest, BasicTokens) {
   EXPECT_EQ(t1.line, 1);
 }
 
+TEST(LexerTest, InternsNamesIgnoringCase) {
+  Lexer lexer("abc ABC aBc begin 'abc' 'ABC' 'abc' End");
+  Token a = lexer.get_next_token();
+  Token b = lexer.get_next_token();
+  Token c = lexer.get_next_token();
+  EXPECT_EQ(a.type, TokenType::ID);
+  EXPECT_EQ(a.value, "abc"); // текст из исходника
+  EXPECT_EQ(a.symbol, b.symbol);
+  EXPECT_EQ(a.symbol, c.symbol);
+  EXPECT_EQ(lexer.symbols().view(a.symbol), "ABC");
+
+  Token keyword = lexer.get_next_token();
+  EXPECT_EQ(keyword.type, TokenType::BEGIN);
+  EXPECT_EQ(keyword.value, "BEGIN");
+  EXPECT_EQ(keyword.symbol, NO_SYMBOL);
+
+  // Строки сравниваются с учетом регистра и не совпадают с именами
+  Token s1 = lexer.get_next_token();
+  Token s2 = lexer.get_next_token();
+  Token s3 = lexer.get_next_token();
+  EXPECT_NE(s1.symbol, s2.symbol);
+  EXPECT_EQ(s1.symbol, s3.symbol);
+  EXPECT_NE(s1.symbol, a.symbol);
+  EXPECT_EQ(lexer.symbols().view(s1.symbol), "abc");
+  EXPECT_EQ(lexer.get_next_token().type, TokenType::END);
+}
+
 // --- Interpreter Tests ---
 TEST(InterpreterTest, ComplexCalculation) {
   std::string code1 = "PROGRAM Test; VAR x, y, z : REAL; BEGIN x := 2 + 3 * 4; "
@@ -83,6 +113,146 @@ TEST(InterpreterTest, UndefinedVariable) {
   EXPECT_THROW(i5.interpret(ast5.get()), std::runtime_error);
 }
 
+// --- SemanticAnalyzer Tests ---
+TEST(SemanticTest, ResolvesVariablesToSlots) {
+  Lexer lexer("PROGRAM Test; VAR a, b : REAL; c : INTEGER; "
+              "BEGIN c := 1; BEGIN a := b + c END END.");
+  Parser parser(lexer);
+  auto ast = parser.parse();
+  SemanticAnalyzer().analyze(ast.get());
+
+  const AST &tree = *ast;
+  NodeId block = tree.b[tree.root];
+  EXPECT_TRUE(tree.analyzed);
+  EXPECT_EQ(tree.c[block], 3u); // frame_size
+  NodeId body = tree.b[block];
+  NodeId inner = tree.list(tree.a[body])[1];
+  NodeId assign = tree.list(tree.a[inner])[0];
+  NodeId var = tree.a[assign];
+  NodeId sum = tree.b[assign];
+  EXPECT_EQ(tree.b[var], 0u); // slot
+  EXPECT_EQ(tree.c[var], 0u); // depth
+  EXPECT_EQ(tree.b[tree.a[sum]], 1u);
+  EXPECT_EQ(tree.b[tree.b[sum]], 2u);
+  EXPECT_EQ(tree.type[sum], ValueType::REAL);
+}
+
+// --- Parser Tests ---
+TEST(ParserTest, FlatTreeWithInternedNames) {
+  Lexer lexer("PROGRAM Test; VAR x : REAL; "
+              "BEGIN x := 1; x := x + 'x'; BEGIN END END.");
+  Parser parser(lexer);
+  auto ast = parser.parse();
+  const AST &tree = *ast;
+
+  ASSERT_EQ(tree.kind[tree.root], NodeKind::PROGRAM);
+  EXPECT_EQ(tree.text(tree.root), "TEST");
+  NodeId block = tree.b[tree.root];
+  ASSERT_EQ(tree.kind[block], NodeKind::BLOCK);
+  ASSERT_EQ(tree.list(tree.a[block]).size(), 1u);
+  auto statements = tree.list(tree.a[tree.b[block]]);
+  ASSERT_EQ(statements.size(), 3u);
+  EXPECT_EQ(tree.kind[statements[2]], NodeKind::COMPOUND);
+
+  // Все вхождения X - один символ; строка 'x' - отдельный символ
+  NodeId first = tree.a[statements[0]];
+  NodeId second = tree.a[statements[1]];
+  NodeId sum = tree.b[statements[1]];
+  EXPECT_EQ(tree.a[first], tree.a[second]);
+  EXPECT_EQ(tree.a[first], tree.a[tree.a[sum]]);
+  EXPECT_EQ(tree.kind[tree.b[sum]], NodeKind::STRING_LITERAL);
+  EXPECT_EQ(tree.text(tree.b[sum]), "x");
+  EXPECT_NE(tree.a[tree.b[sum]], tree.a[first]);
+  EXPECT_EQ(tree.strings.size(), 3u); // TEST, X, x
+}
+
+// --- VM Tests ---
+std::map<std::string, Value> run_vm(const std::string &code) {
+  Lexer lexer(code);
+  Parser parser(lexer);
+  auto ast = parser.parse();
+  BytecodeCompiler compiler;
+  VM vm;
+  return vm.run(compiler.compile(ast.get()));
+}
+
+// Текст ошибки, с которой падает исполнение; пустая строка - без ошибки
+template <typename Run> std::string error_of(Run run) {
+  try {
+    run();
+  } catch (const std::runtime_error &e) {
+    return e.what();
+  }
+  return "";
+}
+
+TEST(VMTest, ComplexCalculation) {
+  auto res = run_vm("PROGRAM Test; VAR x, y, z : REAL; i : INTEGER; s : STRING; "
+                    "BEGIN x := 2 + 3 * 4; y := -(2 + 3) * 4; z := 10 / 2 - 1; "
+                    "i := 7 / 2; s := 'a' + 'b' + 'c' END.");
+  EXPECT_DOUBLE_EQ(get_double_test(res["X"]), 14.0);
+  EXPECT_DOUBLE_EQ(get_double_test(res["Y"]), -20.0);
+  EXPECT_DOUBLE_EQ(get_double_test(res["Z"]), 4.0);
+  // Присваивание REAL в INTEGER отбрасывает дробную часть, как в Interpreter
+  EXPECT_EQ(std::get<int>(res["I"]), 3);
+  EXPECT_EQ(std::get<std::string>(res["S"]), "abc");
+}
+
+TEST(VMTest, ReusesTemporaryRegisters) {
+  Lexer lexer("PROGRAM Test; VAR x : REAL; "
+              "BEGIN x := ((1 + 2) * (3 + 4)) - (5 * (6 + x)); x := x + 1 END.");
+  Parser parser(lexer);
+  auto ast = parser.parse();
+  Chunk chunk = BytecodeCompiler().compile(ast.get());
+  // 1 переменная, 6 разных литералов и не больше 3 временных регистров
+  EXPECT_LE(chunk.reals.size(), 1u + 6u + 3u);
+  EXPECT_DOUBLE_EQ(get_double_test(VM().run(chunk)["X"]), -8.0);
+}
+
+TEST(VMTest, SelectsOpcodesByStaticType) {
+  Lexer lexer("PROGRAM Test; VAR i : INTEGER; r : REAL; "
+              "BEGIN i := 3; r := i * 2; i := r END.");
+  Parser parser(lexer);
+  auto ast = parser.parse();
+  Chunk chunk = BytecodeCompiler().compile(ast.get());
+  std::vector<OpCode> ops;
+  for (const auto &ins : chunk.code) {
+    ops.push_back(ins.op);
+  }
+  // i := 3 - литерал REAL в INTEGER; i * 2 - умножение REAL с приведением i
+  std::vector<OpCode> expected = {OpCode::REAL_TO_INT, OpCode::INT_TO_REAL,
+                                  OpCode::MUL_REAL, OpCode::REAL_TO_INT};
+  EXPECT_EQ(ops, expected);
+  auto res = VM().run(chunk);
+  EXPECT_EQ(std::get<int>(res["I"]), 6);
+  EXPECT_DOUBLE_EQ(std::get<double>(res["R"]), 6.0);
+}
+
+TEST(VMTest, RuntimeErrorsMatchInterpreter) {
+  const char *programs[] = {
+      "PROGRAM Test; VAR x : REAL; BEGIN x := 10 / 0 END.",
+      "PROGRAM Test; VAR x : REAL; BEGIN x := y + 1 END.",
+      "PROGRAM Test; VAR x : REAL; BEGIN y := x + 1 END.",
+      "PROGRAM Test; VAR s : STRING; BEGIN s := 123 END.",
+      "PROGRAM Test; VAR b : BOOLEAN; r : REAL; BEGIN b := TRUE; r := b + 10 END.",
+      "PROGRAM Test; VAR s : STRING; BEGIN s := 1 / 0 + y END.",
+      "PROGRAM Test; VAR s : STRING; r : REAL; BEGIN r := -s END.",
+      "PROGRAM Test; VAR s : STRING; r : REAL; BEGIN r := 1 + s * 2 END.",
+      "PROGRAM Test; VAR s : STRING; i : INTEGER; BEGIN i := s + 'a' END.",
+      "PROGRAM Test; VAR b : BOOLEAN; BEGIN b := 1 + 2 END.",
+  };
+  for (const char *code : programs) {
+    std::string expected = error_of([&] {
+      Lexer lexer(code);
+      Parser parser(lexer);
+      auto ast = parser.parse();
+      Interpreter().interpret(ast.get());
+    });
+    EXPECT_FALSE(expected.empty()) << code;
+    EXPECT_EQ(error_of([&] { run_vm(code); }), expected) << code;
+  }
+}
+
 // --- AppUtils Tests ---
 TEST(AppUtilsTest, JsonOutput) {
   std::map<std::string, Value> mem = {{"a", 1.0}, {"b", 2.2}};